@@ -174,6 +174,7 @@ void Action::commit(DirtyList* dirty_list)
 
 				Tile* oldtile = editor.map.swapTile(pos, newtile);
 				TileLocation* location = newtile->getLocation();
+				editor.map.minimap_cache.invalidate(pos);
 
 				// Update other nodes in the network
 				if(editor.IsLiveServer() && dirty_list)
@@ -182,6 +183,9 @@ void Action::commit(DirtyList* dirty_list)
 
 				newtile->update();
 
+				editor.map.statistics.removeTile(oldtile);
+				editor.map.statistics.addTile(newtile);
+
 				//std::cout << "\tSwitched tile at " << pos.x << ";" << pos.y << ";" << pos.z << " from " << (void*)oldtile << " to " << *data <<  std::endl;
 				if(newtile->isSelected())
 					editor.selection.addInternal(newtile);
@@ -332,11 +336,15 @@ void Action::undo(DirtyList* dirty_list)
 				}
 
 				Tile* newtile = editor.map.swapTile(pos, oldtile);
+				editor.map.minimap_cache.invalidate(pos);
 
 				// Update server side change list (for broadcast)
 				if(editor.IsLiveServer() && dirty_list)
 					dirty_list->AddPosition(pos.x, pos.y, pos.z);
 
+				editor.map.statistics.removeTile(newtile);
+				editor.map.statistics.addTile(oldtile);
+
 
 				if(oldtile->isSelected())
 					editor.selection.addInternal(oldtile);
@@ -701,15 +709,18 @@ DirtyList::~DirtyList()
 void DirtyList::AddPosition(int x, int y, int z)
 {
 	uint32_t m = ((x >> 2) << 18) | ((y >> 2) << 4);
+	uint16_t tile = 1 << ((x & 3) * 4 + (y & 3));
 	ValueType fi = {m, 0};
 	SetType::iterator s = iset.find(fi);
 	if(s != iset.end()) {
 		ValueType v = *s;
 		iset.erase(s);
 		v.floors = (1 << z) | v.floors;
+		v.tiles[z] |= tile;
 		iset.insert(v);
 	} else {
 		ValueType v = {m, (uint32_t)(1 << z)};
+		v.tiles[z] = tile;
 		iset.insert(v);
 	}
 }
@@ -71,6 +71,8 @@ public:
 	struct ValueType {
 		uint32_t pos;
 		uint32_t floors;
+		// Changed tiles of each floor, same bit order as Floor::locs
+		uint16_t tiles[MAP_LAYERS];
 	};
 
 	uint32_t owner;
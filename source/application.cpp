@@ -29,6 +29,12 @@
 #include "main_menubar.h"
 #include "updater.h"
 #include "artprovider.h"
+#include "live_dedicated.h"
+#include "live_bench.h"
+#include "minimap_export.h"
+#include "software_renderer.h"
+#include "tile_pyramid_export.h"
+#include "batch_command.h"
 
 #include "materials.h"
 #include "map.h"
@@ -111,6 +117,75 @@ bool Application::OnInit()
 
 	// Tell that we are the real thing
 	wxAppConsole::SetInstance(this);
+
+	// A dedicated live server never shows a window, so none of the GUI is set up
+	m_dedicated_server = nullptr;
+	m_startup = false;
+	if(LiveDedicatedServer::IsRequested(argv.GetArguments())) {
+		g_settings.load();
+		ClientVersion::loadVersions();
+
+		m_dedicated_server = newd LiveDedicatedServer();
+		if(!m_dedicated_server->Start(argv.GetArguments())) {
+			wxDELETE(m_dedicated_server);
+			return false;
+		}
+		return true;
+	}
+
+	if(LiveBenchmark::IsRequested(argv.GetArguments())) {
+		LiveBenchmark benchmark;
+		if(!benchmark.Run(argv.GetArguments())) {
+			return false;
+		}
+		CallAfter([this]() { ExitMainLoop(); });
+		return true;
+	}
+
+	if(MinimapExportCommand::IsRequested(argv.GetArguments())) {
+		g_settings.load();
+		ClientVersion::loadVersions();
+
+		if(!MinimapExportCommand::Run(argv.GetArguments())) {
+			return false;
+		}
+		CallAfter([this]() { ExitMainLoop(); });
+		return true;
+	}
+
+	if(RegionRenderCommand::IsRequested(argv.GetArguments())) {
+		g_settings.load();
+		ClientVersion::loadVersions();
+
+		if(!RegionRenderCommand::Run(argv.GetArguments())) {
+			return false;
+		}
+		CallAfter([this]() { ExitMainLoop(); });
+		return true;
+	}
+
+	if(TilePyramidCommand::IsRequested(argv.GetArguments())) {
+		g_settings.load();
+		ClientVersion::loadVersions();
+
+		if(!TilePyramidCommand::Run(argv.GetArguments())) {
+			return false;
+		}
+		CallAfter([this]() { ExitMainLoop(); });
+		return true;
+	}
+
+	if(BatchCommand::IsRequested(argv.GetArguments())) {
+		g_settings.load();
+		ClientVersion::loadVersions();
+
+		if(!BatchCommand::Run(argv.GetArguments())) {
+			return false;
+		}
+		CallAfter([this]() { ExitMainLoop(); });
+		return true;
+	}
+
 	wxArtProvider::Push(new ArtProvider());
 
 #if defined(__LINUX__) || defined(__WINDOWS__)
@@ -338,6 +413,7 @@ void Application::Unload()
 
 int Application::OnExit()
 {
+	wxDELETE(m_dedicated_server);
 #ifdef _USE_PROCESS_COM
 	wxDELETE(m_proc_server);
 	wxDELETE(m_single_instance_checker);
@@ -385,7 +461,7 @@ MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& si
 	}
 
 	wxStatusBar* statusbar = CreateStatusBar();
-	statusbar->SetFieldsCount(4);
+	statusbar->SetFieldsCount(5);
 	SetStatusText(wxString("Welcome to ") << __W_RME_APPLICATION_NAME__ << " " << __W_RME_VERSION__);
 
 	// Le sizer
@@ -404,7 +480,15 @@ MainFrame::~MainFrame() = default;
 
 void MainFrame::OnIdle(wxIdleEvent& event)
 {
-	////
+	// Fill the minimap cache a few areas at a time, so zooming out doesn't have to
+	if(!g_gui.IsEditorOpen())
+		return;
+	if(g_settings.getFloat(Config::MINIMAP_PYRAMID_ZOOM) <= 0.0f && !g_gui.IsMinimapVisible())
+		return;
+
+	Editor* editor = g_gui.GetCurrentEditor();
+	if(editor && editor->map.minimap_cache.buildStep(16))
+		event.RequestMore();
 }
 
 #ifdef _USE_UPDATER_
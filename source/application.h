@@ -35,6 +35,7 @@ class MainFrame;
 class MapWindow;
 class wxEventLoopBase;
 class wxSingleInstanceChecker;
+class LiveDedicatedServer;
 
 class Application : public wxApp
 {
@@ -49,6 +50,7 @@ public:
 private:
     bool m_startup;
     wxString m_file_to_open;
+	LiveDedicatedServer* m_dedicated_server;
 	void FixVersionDiscrapencies();
 	bool ParseCommandLineMap(wxString& fileName);
 
@@ -45,9 +45,27 @@ void BaseMap::clear(bool del)
 	}
 }
 
-void BaseMap::clearVisible(uint32_t mask)
+void BaseMap::getNodeAreas(int size, PositionVector& areas)
 {
-	root.clearVisible(mask);
+	getNodeAreas(&root, 0, 0, 0x10000, size, areas);
+}
+
+void BaseMap::getNodeAreas(QTreeNode* node, int x, int y, int span, int size, PositionVector& areas)
+{
+	if(span == size) {
+		areas.push_back(Position(x, y, 0));
+		return;
+	}
+
+	if(node->isLeaf)
+		return;
+
+	// Children are ordered row by row, four to a row
+	const int child_span = span / 4;
+	for(int i = 0; i < MAP_LAYERS; ++i) {
+		if(node->child[i])
+			getNodeAreas(node->child[i], x + (i & 3) * child_span, y + (i >> 2) * child_span, child_span, size, areas);
+	}
 }
 
 Tile* BaseMap::createTile(int x, int y, int z)
@@ -101,6 +101,8 @@ public:
 	// Get a Quad Tree Leaf from the map
 	QTreeNode* getLeaf(int x, int y) {return root.getLeaf(x, y);}
 	QTreeNode* createLeaf(int x, int y) {return root.getLeafForce(x, y);}
+	// Top-left corners of all size x size areas that hold leaves, size must be a power of four (4 to 16384)
+	void getNodeAreas(int size, PositionVector& areas);
 
 	// Assigns a tile, it might seem pointless to provide position, but it is not, as the passed tile may be nullptr
 	void setTile(int _x, int _y, int _z, Tile* newtile, bool remove = false);
@@ -110,9 +112,6 @@ public:
 	Tile* swapTile(int _x, int _y, int _z, Tile* newtile);
 	Tile* swapTile(const Position& pos, Tile* newtile) {return swapTile(pos.x, pos.y, pos.z, newtile);}
 
-	// Clears the visiblity according to the mask passed
-	void clearVisible(uint32_t mask);
-
 	uint64_t getTileCount() const {return tilecount;}
 
 public:
@@ -123,6 +122,8 @@ protected:
 
 	QTreeNode root; // The Quad Tree root
 
+	static void getNodeAreas(QTreeNode* node, int x, int y, int span, int size, PositionVector& areas);
+
 	friend class QTreeNode;
 };
 
@@ -0,0 +1,330 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "batch_command.h"
+#include "minimap_export.h"
+#include "unreachable_tiles.h"
+#include "editor.h"
+#include "tile.h"
+#include "monster.h"
+#include "gui.h"
+#include "client_version.h"
+
+#include <chrono>
+
+bool BatchCommand::IsRequested(const wxArrayString& arguments)
+{
+	return arguments.Index("--batch") != wxNOT_FOUND;
+}
+
+bool BatchCommand::parse(const wxArrayString& arguments, std::vector<Stage>& stages)
+{
+	bool opened = false;
+	for(size_t index = 1; index < arguments.size(); ++index) {
+		Stage stage;
+		stage.name = arguments[index];
+		if(stage.name == "--batch")
+			continue;
+
+		const bool has_value = index + 1 < arguments.size() && !arguments[index + 1].StartsWith("--");
+		if(stage.name == "--open" || stage.name == "--convert" || stage.name == "--minimap") {
+			if(!has_value) {
+				g_gui.PrintMessage("Missing value for \"" + stage.name + "\".");
+				return false;
+			}
+			stage.value = arguments[++index];
+		} else if(stage.name == "--save" || stage.name == "--bench-creatures") {
+			if(has_value)
+				stage.value = arguments[++index];
+		} else if(stage.name != "--borderize" && stage.name != "--randomize" && stage.name != "--clean" && stage.name != "--statistics"
+			&& stage.name != "--verify-unreachable" && stage.name != "--verify-creatures") {
+			g_gui.PrintMessage("Unknown argument \"" + stage.name + "\".");
+			return false;
+		}
+
+		// Checked before anything runs, so a typo doesn't fail a long batch halfway
+		if(stage.name == "--open")
+			opened = true;
+		else if(!opened) {
+			g_gui.PrintMessage("\"" + stage.name + "\" needs a map, open one with --open first.");
+			return false;
+		}
+		stages.push_back(stage);
+	}
+	return !stages.empty();
+}
+
+bool BatchCommand::convert(Editor& editor, const wxString& name)
+{
+	ClientVersion* version = ClientVersion::get(nstr(name));
+	if(!version) {
+		g_gui.PrintMessage("Unknown client version \"" + name + "\".");
+		return false;
+	}
+
+	Map& map = editor.map;
+	const MapVersion from = map.getVersion();
+	const MapVersion to(version->getPrefferedMapVersionID(), version->getID());
+
+	editor.selection.clear();
+	editor.actionQueue->clear();
+
+	// The same steps as the map properties dialog, items are replaced while the
+	// version they come from is loaded and checked against the new one after
+	wxString error;
+	wxArrayString warnings;
+	bool ok = true;
+	if(to.client < from.client) {
+		map.convert(to, true);
+		ok = g_gui.LoadVersion(to.client, error, warnings);
+		if(ok)
+			map.cleanInvalidTiles(true);
+	} else if(to.client > from.client) {
+		ok = g_gui.LoadVersion(to.client, error, warnings);
+		if(ok)
+			map.convert(to, true);
+	} else
+		map.convert(to, true);
+
+	g_gui.ListDialog("Warnings", warnings);
+	if(!ok) {
+		g_gui.PrintMessage("Could not load client version " + name + ": " + error);
+		return false;
+	}
+	return true;
+}
+
+bool BatchCommand::runStage(const Stage& stage, std::unique_ptr<Editor>& editor)
+{
+	if(stage.name == "--open") {
+		// The previous map goes first, the next one may need another client version
+		editor.reset();
+		try
+		{
+			editor.reset(newd Editor(g_gui.copybuffer, FileName(stage.value)));
+		}
+		catch(std::runtime_error& e)
+		{
+			g_gui.PrintMessage(wxString(e.what(), wxConvUTF8));
+			return false;
+		}
+
+		if(!editor->map.hasFile()) {
+			g_gui.PrintMessage("Could not load \"" + stage.value + "\": " + editor->map.getError());
+			return false;
+		}
+		g_gui.PrintMessage(wxString::Format("Loaded %lld tiles.", static_cast<long long>(editor->map.statistics.tile_count)));
+		return true;
+	}
+
+	Map& map = editor->map;
+	if(stage.name == "--save")
+		return editor->saveMap(FileName(stage.value), true);
+
+	if(stage.name == "--borderize") {
+		editor->borderizeMap(true);
+		return true;
+	}
+
+	if(stage.name == "--randomize") {
+		editor->randomizeMap(true);
+		return true;
+	}
+
+	if(stage.name == "--convert")
+		return convert(*editor, stage.value);
+
+	if(stage.name == "--clean") {
+		const int64_t items = map.statistics.item_count;
+		map.cleanInvalidTiles(true);
+		g_gui.PrintMessage(wxString::Format("Removed %lld invalid items.", static_cast<long long>(items - map.statistics.item_count)));
+		return true;
+	}
+
+	if(stage.name == "--minimap") {
+		MinimapExporter exporter(map);
+		if(!exporter.computeBounds()) {
+			g_gui.PrintMessage("The map has no tiles, nothing to export.");
+			return true;
+		}
+
+		FileName directory;
+		directory.AssignDir(stage.value);
+		directory.MakeAbsolute();
+		if(!directory.Mkdir(0755, wxPATH_MKDIR_FULL)) {
+			g_gui.PrintMessage("Could not create \"" + directory.GetFullPath() + "\".");
+			return false;
+		}
+
+		std::vector<int> floors;
+		for(int z = 0; z <= MAP_MAX_LAYER; ++z)
+			floors.push_back(z);
+
+		if(!exporter.exportFloors(directory, FileName(wxstr(map.getFilename())).GetName(), floors, "png", 0, true)) {
+			g_gui.PrintMessage(exporter.getError());
+			return false;
+		}
+		return true;
+	}
+
+	if(stage.name == "--statistics") {
+		g_gui.PrintMessage(wxstr(map.getStatisticsReport()));
+		return true;
+	}
+
+	if(stage.name == "--verify-unreachable") {
+		uint64_t checked = 0;
+		const uint64_t mismatches = UnreachableTiles::verify(map, checked);
+		g_gui.PrintMessage(wxString::Format("Checked %llu tiles, %llu differ from the scan.",
+			static_cast<unsigned long long>(checked), static_cast<unsigned long long>(mismatches)));
+		return mismatches == 0;
+	}
+
+	if(stage.name == "--verify-creatures") {
+		// Creatures keep the type they resolved until the database changes, each
+		// run resolves it through that cache and compares it with a fresh lookup
+		uint64_t checked = 0, stale = 0;
+		for(MapIterator mit = map.begin(); mit != map.end(); ++mit) {
+			Tile* tile = (*mit)->get();
+			if(tile->monster) {
+				++checked;
+				if(!tile->monster->hasCurrentType())
+					++stale;
+			}
+			if(tile->npc) {
+				++checked;
+				if(!tile->npc->hasCurrentType())
+					++stale;
+			}
+		}
+		g_gui.PrintMessage(wxString::Format("Checked %llu creatures, %llu have a stale type.",
+			static_cast<unsigned long long>(checked), static_cast<unsigned long long>(stale)));
+		return stale == 0;
+	}
+
+	if(stage.name == "--bench-creatures")
+		return benchCreatures(map, stage.value);
+	return false;
+}
+
+bool BatchCommand::benchCreatures(Map& map, const wxString& value)
+{
+	long rounds = 100;
+	if(!value.empty() && (!value.ToLong(&rounds) || rounds <= 0)) {
+		g_gui.PrintMessage("Invalid round count \"" + value + "\".");
+		return false;
+	}
+
+	std::vector<const Monster*> monsters;
+	std::vector<const Npc*> npcs;
+	std::vector<std::string> monster_names, npc_names;
+	for(MapIterator mit = map.begin(); mit != map.end(); ++mit) {
+		Tile* tile = (*mit)->get();
+		if(tile->monster) {
+			monsters.push_back(tile->monster);
+			monster_names.push_back(tile->monster->getName());
+		}
+		if(tile->npc) {
+			npcs.push_back(tile->npc);
+			npc_names.push_back(tile->npc->getName());
+		}
+	}
+	if(monsters.empty() && npcs.empty()) {
+		g_gui.PrintMessage("The map has no creatures to look up.");
+		return true;
+	}
+
+	// The outfit lookup the drawer does for every creature it shows, once with
+	// the cached type and once looking the type up by name as it was before
+	typedef std::chrono::steady_clock Clock;
+	uint64_t cached_sum = 0, lookup_sum = 0;
+
+	const Clock::time_point cached_start = Clock::now();
+	for(long round = 0; round < rounds; ++round) {
+		for(const Monster* monster : monsters)
+			cached_sum += monster->getLookType().lookType;
+		for(const Npc* npc : npcs)
+			cached_sum += npc->getLookType().lookType;
+	}
+	const double cached_seconds = std::chrono::duration<double>(Clock::now() - cached_start).count();
+
+	const Clock::time_point lookup_start = Clock::now();
+	for(long round = 0; round < rounds; ++round) {
+		for(const std::string& name : monster_names) {
+			MonsterType* type = g_monsters[name];
+			lookup_sum += type ? type->outfit.lookType : 0;
+		}
+		for(const std::string& name : npc_names) {
+			NpcType* type = g_npcs[name];
+			lookup_sum += type ? type->outfit.lookType : 0;
+		}
+	}
+	const double lookup_seconds = std::chrono::duration<double>(Clock::now() - lookup_start).count();
+
+	const double lookups = static_cast<double>(rounds) * (monsters.size() + npcs.size());
+	g_gui.PrintMessage(wxString::Format("%.0f creature lookups: cached type %.1f ns each, by name %.1f ns each (%.1fx).",
+		lookups, 1e9 * cached_seconds / lookups, 1e9 * lookup_seconds / lookups,
+		cached_seconds > 0 ? lookup_seconds / cached_seconds : 0.0));
+
+	// Both must have found the same outfits, or the cache is stale
+	if(cached_sum != lookup_sum) {
+		g_gui.PrintMessage("The cached types don't match the database.");
+		return false;
+	}
+	return true;
+}
+
+bool BatchCommand::Run(const wxArrayString& arguments)
+{
+	g_gui.SetHeadless(true);
+
+	std::vector<Stage> stages;
+	if(!parse(arguments, stages)) {
+		g_gui.PrintMessage("Usage: rme --batch --open <map.otbm> [--save [file.otbm]] [--borderize] [--randomize] "
+			"[--convert version] [--clean] [--minimap dir] [--statistics] [--verify-unreachable] [--verify-creatures] "
+			"[--bench-creatures [rounds]] ...");
+		return false;
+	}
+
+	if(ClientVersion::getLatestVersion() == nullptr) {
+		g_gui.PrintMessage("No client versions are configured, run the editor once to set them up.");
+		return false;
+	}
+
+	std::unique_ptr<Editor> editor;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(std::vector<Stage>::const_iterator it = stages.begin(); it != stages.end(); ++it) {
+		wxString label = it->name.Mid(2);
+		if(!it->value.empty())
+			label << " " << it->value;
+
+		const std::chrono::steady_clock::time_point stage_start = std::chrono::steady_clock::now();
+		const bool ok = runStage(*it, editor);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - stage_start).count();
+		if(!ok) {
+			g_gui.PrintMessage(wxString::Format("%s failed after %.2f seconds.", label, seconds));
+			return false;
+		}
+		g_gui.PrintMessage(wxString::Format("%s took %.2f seconds.", label, seconds));
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	g_gui.PrintMessage(wxString::Format("Finished %d operations in %.2f seconds.", int(stages.size()), seconds));
+	return true;
+}
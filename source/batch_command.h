@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_BATCH_COMMAND_H_
+#define RME_BATCH_COMMAND_H_
+
+#include <memory>
+
+class Editor;
+class Map;
+
+// Runs map operations one after another without opening a window, started with
+//   rme --batch --open map.otbm [operation...]
+// The operations run in the order given:
+//   --open file.otbm    loads a map, the client version it needs is loaded with it
+//   --save [file.otbm]  saves the map, to where it was opened from by default
+//   --borderize         borderizes the whole map
+//   --randomize         randomizes the grounds of the whole map
+//   --convert version   converts the map to a client version, e.g. 10.98
+//   --clean             removes items that don't exist in the client version
+//   --minimap dir       exports the minimap of every floor as PNGs
+//   --statistics        prints the map statistics
+//   --verify-unreachable  checks the unreachable tile search against a scan of
+//                       the area around every tile, fails on any difference
+//   --verify-creatures  checks the cached type of every creature against the
+//                       database, run it before and after --convert to see
+//                       that reloading the databases drops the cached types
+//   --bench-creatures [rounds]  times the outfit lookup of every creature
+//                       through the cached type against a lookup by name,
+//                       100 rounds by default
+// Every stage prints how long it took. The first one that fails stops the
+// batch and the editor exits with an error.
+class BatchCommand
+{
+public:
+	static bool IsRequested(const wxArrayString& arguments);
+	static bool Run(const wxArrayString& arguments);
+
+protected:
+	struct Stage {
+		wxString name;
+		wxString value;
+	};
+
+	static bool parse(const wxArrayString& arguments, std::vector<Stage>& stages);
+	static bool runStage(const Stage& stage, std::unique_ptr<Editor>& editor);
+	static bool convert(Editor& editor, const wxString& name);
+	static bool benchCreatures(Map& map, const wxString& value);
+};
+
+#endif
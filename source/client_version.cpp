@@ -496,6 +496,8 @@ bool ClientVersion::loadValidPaths()
 		message << "Attempted sprites file: %s\n";
 
 		g_gui.PopupDialog("Error", wxString::Format(message, name, metadata_path.GetFullPath(), sprites_path.GetFullPath()), wxOK);
+		if(g_gui.IsHeadless())
+			return false;
 
 		wxString dirHelpText("Select assets directory.");
 		wxDirDialog file_dlg(nullptr, dirHelpText, "", wxDD_DIR_MUST_EXIST);
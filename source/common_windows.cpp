@@ -32,6 +32,7 @@
 #include "application.h"
 #include "common_windows.h"
 #include "positionctrl.h"
+#include "minimap_export.h"
 
 #ifdef _MSC_VER
 	#pragma warning(disable:4018) // signed/unsigned mismatch
@@ -620,12 +621,14 @@ void ExportMiniMapWindow::OnClickOK(wxCommandEvent& WXUNUSED(event))
 		switch(floor_options->GetSelection())
 		{
 			case 0: { // All floors
-				for(int floor = 0; floor < MAP_LAYERS; ++floor) {
-					g_gui.SetLoadScale(int(floor*(100.f/16.f)), int((floor+1)*(100.f/16.f)));
-					FileName file(file_name_text_field->GetValue() + "_" + i2ws(floor) + ".bmp");
-					file.Normalize(wxPATH_NORM_ALL, directory.GetFullPath());
-					editor.exportMiniMap(file, floor, true);
-				}
+				std::vector<int> floors;
+				for(int floor = 0; floor < MAP_LAYERS; ++floor)
+					floors.push_back(floor);
+
+				// Floors are written side by side, sharing one pass over the bounds
+				MinimapExporter exporter(editor.map);
+				if(exporter.computeBounds() && !exporter.exportFloors(directory, file_name_text_field->GetValue(), floors, "bmp", 0, true))
+					g_gui.PopupDialog("Error", exporter.getError(), wxOK);
 				break;
 			}
 
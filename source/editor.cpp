@@ -179,7 +179,7 @@ void Editor::addAction(Action* action, int stacking_delay )
 	g_gui.UpdateMenus();
 }
 
-void Editor::saveMap(FileName filename, bool showdialog)
+bool Editor::saveMap(FileName filename, bool showdialog)
 {
 	std::string savefile = filename.GetFullPath().mb_str(wxConvUTF8).data();
 	bool save_as = false;
@@ -320,7 +320,7 @@ void Editor::saveMap(FileName filename, bool showdialog)
 
 		// If failure, don't run the rest of the function
 		if(!success)
-			return;
+			return false;
 	}
 
 
@@ -374,6 +374,7 @@ void Editor::saveMap(FileName filename, bool showdialog)
 	}
 
 	map.clearChanges();
+	return true;
 }
 
 bool Editor::importMiniMap(FileName filename, int import, int import_x_offset, int import_y_offset, int import_z_offset)
@@ -851,6 +852,10 @@ bool Editor::importMap(FileName filename, int import_x_offset, int import_y_offs
 
 	g_gui.DestroyLoadBar();
 
+	// Imported tiles were moved in without going through actions
+	map.statistics.recount(map);
+	map.minimap_cache.clear();
+
 	map.setWidth(newsize_x);
 	map.setHeight(newsize_y);
 	g_gui.PopupDialog("Success", "Map imported successfully, " + i2ws(discarded_tiles) + " tiles were discarded as invalid.", wxOK);
@@ -892,7 +897,12 @@ void Editor::borderizeMap(bool showdialog)
 		Tile* tile = tileLocation->get();
 		ASSERT(tile);
 
+		// Borders are changed in place, so the tile is counted again after
+		map.statistics.removeTile(tile);
 		tile->borderize(&map);
+		tile->update();
+		map.statistics.addTile(tile);
+		map.minimap_cache.invalidate(tile->getPosition());
 		++tiles_done;
 	}
 
@@ -945,6 +955,7 @@ void Editor::randomizeMap(bool showdialog)
 
 		GroundBrush* groundBrush = tile->getGroundBrush();
 		if(groundBrush) {
+			map.statistics.removeTile(tile);
 			Item* oldGround = tile->ground;
 
 			uint16_t actionId, uniqueId;
@@ -963,6 +974,8 @@ void Editor::randomizeMap(bool showdialog)
 				newGround->setUniqueID(uniqueId);
 			}
 			tile->update();
+			map.statistics.addTile(tile);
+			map.minimap_cache.invalidate(tile->getPosition());
 		}
 		++tiles_done;
 	}
@@ -2016,3 +2029,16 @@ void Editor::SendNodeRequests()
 	}
 }
 
+void Editor::UpdateViewport(int start_x, int start_y, int end_x, int end_y, int floor)
+{
+	if(live_client) {
+		LiveViewport viewport;
+		viewport.startX = std::max(start_x, 0);
+		viewport.startY = std::max(start_y, 0);
+		viewport.endX = std::max(end_x, 0);
+		viewport.endY = std::max(end_y, 0);
+		viewport.floor = floor;
+		live_client->updateViewport(viewport);
+	}
+}
+
@@ -71,10 +71,11 @@ public: // Functions
 	// Client side
 	void QueryNode(int ndx, int ndy, bool underground);
 	void SendNodeRequests();
+	void UpdateViewport(int start_x, int start_y, int end_x, int end_y, int floor);
 
 
 	// Map handling
-	void saveMap(FileName filename, bool showdialog); // "" means default filename
+	bool saveMap(FileName filename, bool showdialog); // "" means default filename
 
 	uint16_t getMapWidth() const { return map.width; }
 	uint16_t getMapHeight() const { return map.height; }
@@ -76,6 +76,7 @@ public:
 	FORCEINLINE bool getSByte(int8_t& i8) { return getType(i8); }
 	FORCEINLINE bool getU16(uint16_t& u16) {return getType(u16);}
 	FORCEINLINE bool getU32(uint32_t& u32) {return getType(u32);}
+	FORCEINLINE bool getU64(uint64_t& u64) {return getType(u64);}
 	FORCEINLINE bool get32(int32_t& i32) { return getType(i32); }
 	bool getRAW(uint8_t* ptr, size_t sz);
 	bool getRAW(std::string& str, size_t sz);
@@ -20,6 +20,7 @@
 
 #include "sprites.h"
 #include "graphics.h"
+#include "sprite_loader.h"
 #include "filehandle.h"
 #include "settings.h"
 #include "gui.h"
@@ -30,6 +31,14 @@
 #include <wx/dir.h>
 #include "pngfiles.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define RME_SSE2
+#endif
+
+// 2 MB of 32x32 textures, more would show as a hitch when panning into new areas
+static const size_t SPRITE_UPLOADS_PER_FRAME = 512;
+
 // All 133 template colors
 static uint32_t TemplateOutfitLookupTable[] = {
 	0xFFFFFF, 0xFFD4BF, 0xFFE9BF, 0xFFFFBF, 0xE9FFBF, 0xD4FFBF,
@@ -60,14 +69,15 @@ static uint32_t TemplateOutfitLookupTable[] = {
 GraphicManager::GraphicManager() :
 	client_version(nullptr),
 	unloaded(true),
+	memcached_sprites(false),
 	dat_format(DAT_FORMAT_UNKNOWN),
 	otfi_found(false),
 	is_extended(false),
 	has_transparency(false),
 	has_frame_durations(false),
 	has_frame_groups(false),
-	loaded_textures(0),
-	lastclean(0)
+	decode_queue(nullptr),
+	decode_refresh_posted(false)
 {
 	animation_timer = newd wxStopWatch();
 	animation_timer->Start();
@@ -75,12 +85,18 @@ GraphicManager::GraphicManager() :
 
 GraphicManager::~GraphicManager()
 {
-	for(SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
+	delete decode_queue;
+
+	for(SpriteMap::iterator iter = editor_sprite_space.begin(); iter != editor_sprite_space.end(); ++iter) {
 		delete iter->second;
 	}
 
-	for(ImageMap::iterator iter = image_space.begin(); iter != image_space.end(); ++iter) {
-		delete iter->second;
+	for(GameSprite* sprite : sprite_space) {
+		delete sprite;
+	}
+
+	for(GameSprite::NormalImage* image : image_space) {
+		delete image;
 	}
 
 	delete animation_timer;
@@ -96,6 +112,11 @@ bool GraphicManager::isUnloaded() const
 	return unloaded;
 }
 
+bool GraphicManager::hasMemcachedSprites() const
+{
+	return memcached_sprites;
+}
+
 GLuint GraphicManager::getFreeTextureID()
 {
 	static GLuint id_counter = 0x10000000;
@@ -104,27 +125,25 @@ GLuint GraphicManager::getFreeTextureID()
 
 void GraphicManager::clear()
 {
-	SpriteMap new_sprite_space;
-	for(SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
-		if(iter->first >= 0) { // Don't clean internal sprites
-			delete iter->second;
-		} else {
-			new_sprite_space.insert(std::make_pair(iter->first, iter->second));
-		}
+	// Workers may still be reading sprites
+	delete decode_queue;
+	decode_queue = nullptr;
+
+	// Internal editor sprites are kept
+	for(GameSprite* sprite : sprite_space) {
+		delete sprite;
 	}
 
-	for(ImageMap::iterator iter = image_space.begin(); iter != image_space.end(); ++iter) {
-		delete iter->second;
+	for(GameSprite::NormalImage* image : image_space) {
+		delete image;
 	}
 
-	sprite_space.swap(new_sprite_space);
-	image_space.clear();
+	std::vector<GameSprite*>().swap(sprite_space);
+	std::vector<GameSprite::NormalImage*>().swap(image_space);
 	cleanup_list.clear();
 
 	item_count = 0;
 	creature_count = 0;
-	loaded_textures = 0;
-	lastclean = time(nullptr);
 	spritefile = "";
 
 	unloaded = true;
@@ -132,17 +151,25 @@ void GraphicManager::clear()
 
 void GraphicManager::cleanSoftwareSprites()
 {
-	for(SpriteMap::iterator iter = sprite_space.begin(); iter != sprite_space.end(); ++iter) {
-		if(iter->first >= 0) { // Don't clean internal sprites
-			iter->second->unloadDC();
+	// Don't clean internal sprites
+	for(GameSprite* sprite : sprite_space) {
+		if(sprite) {
+			sprite->unloadDC();
 		}
 	}
 }
 
 Sprite* GraphicManager::getSprite(int id)
 {
-	SpriteMap::iterator it = sprite_space.find(id);
-	if(it != sprite_space.end()) {
+	if(id >= 0) {
+		if(static_cast<size_t>(id) < sprite_space.size()) {
+			return sprite_space[id];
+		}
+		return nullptr;
+	}
+
+	SpriteMap::iterator it = editor_sprite_space.find(id);
+	if(it != editor_sprite_space.end()) {
 		return it->second;
 	}
 	return nullptr;
@@ -154,9 +181,9 @@ GameSprite* GraphicManager::getCreatureSprite(int id)
 		return nullptr;
 	}
 
-	SpriteMap::iterator it = sprite_space.find(id+item_count);
-	if(it != sprite_space.end()) {
-		return static_cast<GameSprite*>(it->second);
+	const size_t index = static_cast<size_t>(id) + item_count;
+	if(index < sprite_space.size()) {
+		return sprite_space[index];
 	}
 	return nullptr;
 }
@@ -183,150 +210,150 @@ inline wxBitmap* _wxGetBitmapFromMemory(const unsigned char* data, int length)
 bool GraphicManager::loadEditorSprites()
 {
 	// Unused graphics MIGHT be loaded here, but it's a neglectable loss
-	sprite_space[EDITOR_SPRITE_SELECTION_MARKER] =
+	editor_sprite_space[EDITOR_SPRITE_SELECTION_MARKER] =
 		newd EditorSprite(
 			newd wxBitmap(selection_marker_xpm16x16),
 			newd wxBitmap(selection_marker_xpm32x32)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_1x1] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_CD_1x1] =
 		newd EditorSprite(
 			loadPNGFile(circular_1_small_png),
 			loadPNGFile(circular_1_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_3x3] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_CD_3x3] =
 		newd EditorSprite(
 			loadPNGFile(circular_2_small_png),
 			loadPNGFile(circular_2_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_5x5] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_CD_5x5] =
 		newd EditorSprite(
 			loadPNGFile(circular_3_small_png),
 			loadPNGFile(circular_3_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_7x7] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_CD_7x7] =
 		newd EditorSprite(
 			loadPNGFile(circular_4_small_png),
 			loadPNGFile(circular_4_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_9x9] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_CD_9x9] =
 		newd EditorSprite(
 			loadPNGFile(circular_5_small_png),
 			loadPNGFile(circular_5_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_15x15] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_CD_15x15] =
 		newd EditorSprite(
 			loadPNGFile(circular_6_small_png),
 			loadPNGFile(circular_6_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_CD_19x19] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_CD_19x19] =
 		newd EditorSprite(
 			loadPNGFile(circular_7_small_png),
 			loadPNGFile(circular_7_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_1x1] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_SD_1x1] =
 		newd EditorSprite(
 			loadPNGFile(rectangular_1_small_png),
 			loadPNGFile(rectangular_1_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_3x3] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_SD_3x3] =
 		newd EditorSprite(
 			loadPNGFile(rectangular_2_small_png),
 			loadPNGFile(rectangular_2_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_5x5] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_SD_5x5] =
 		newd EditorSprite(
 			loadPNGFile(rectangular_3_small_png),
 			loadPNGFile(rectangular_3_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_7x7] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_SD_7x7] =
 		newd EditorSprite(
 			loadPNGFile(rectangular_4_small_png),
 			loadPNGFile(rectangular_4_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_9x9] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_SD_9x9] =
 		newd EditorSprite(
 			loadPNGFile(rectangular_5_small_png),
 			loadPNGFile(rectangular_5_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_15x15] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_SD_15x15] =
 		newd EditorSprite(
 			loadPNGFile(rectangular_6_small_png),
 			loadPNGFile(rectangular_6_png)
 		);
-	sprite_space[EDITOR_SPRITE_BRUSH_SD_19x19] =
+	editor_sprite_space[EDITOR_SPRITE_BRUSH_SD_19x19] =
 		newd EditorSprite(
 			loadPNGFile(rectangular_7_small_png),
 			loadPNGFile(rectangular_7_png)
 		);
 
-	sprite_space[EDITOR_SPRITE_OPTIONAL_BORDER_TOOL] =
+	editor_sprite_space[EDITOR_SPRITE_OPTIONAL_BORDER_TOOL] =
 		newd EditorSprite(
 			loadPNGFile(optional_border_small_png),
 			loadPNGFile(optional_border_png)
 		);
-	sprite_space[EDITOR_SPRITE_ERASER] =
+	editor_sprite_space[EDITOR_SPRITE_ERASER] =
 		newd EditorSprite(
 			loadPNGFile(eraser_small_png),
 			loadPNGFile(eraser_png)
 		);
-	sprite_space[EDITOR_SPRITE_PZ_TOOL] =
+	editor_sprite_space[EDITOR_SPRITE_PZ_TOOL] =
 		newd EditorSprite(
 			loadPNGFile(protection_zone_small_png),
 			loadPNGFile(protection_zone_png)
 		);
-	sprite_space[EDITOR_SPRITE_PVPZ_TOOL] =
+	editor_sprite_space[EDITOR_SPRITE_PVPZ_TOOL] =
 		newd EditorSprite(
 			loadPNGFile(pvp_zone_small_png),
 			loadPNGFile(pvp_zone_png)
 		);
-	sprite_space[EDITOR_SPRITE_NOLOG_TOOL] =
+	editor_sprite_space[EDITOR_SPRITE_NOLOG_TOOL] =
 		newd EditorSprite(
 			loadPNGFile(no_logout_small_png),
 			loadPNGFile(no_logout_png)
 		);
-	sprite_space[EDITOR_SPRITE_NOPVP_TOOL] =
+	editor_sprite_space[EDITOR_SPRITE_NOPVP_TOOL] =
 		newd EditorSprite(
 			loadPNGFile(no_pvp_small_png),
 			loadPNGFile(no_pvp_png)
 		);
 
-	sprite_space[EDITOR_SPRITE_DOOR_NORMAL] =
+	editor_sprite_space[EDITOR_SPRITE_DOOR_NORMAL] =
 		newd EditorSprite(
 			loadPNGFile(door_normal_small_png),
 			loadPNGFile(door_normal_png)
 		);
-	sprite_space[EDITOR_SPRITE_DOOR_LOCKED] =
+	editor_sprite_space[EDITOR_SPRITE_DOOR_LOCKED] =
 		newd EditorSprite(
 			loadPNGFile(door_locked_small_png),
 			loadPNGFile(door_locked_png)
 		);
-	sprite_space[EDITOR_SPRITE_DOOR_MAGIC] =
+	editor_sprite_space[EDITOR_SPRITE_DOOR_MAGIC] =
 		newd EditorSprite(
 			loadPNGFile(door_magic_small_png),
 			loadPNGFile(door_magic_png)
 		);
-	sprite_space[EDITOR_SPRITE_DOOR_QUEST] =
+	editor_sprite_space[EDITOR_SPRITE_DOOR_QUEST] =
 		newd EditorSprite(
 			loadPNGFile(door_quest_small_png),
 			loadPNGFile(door_quest_png)
 		);
-	sprite_space[EDITOR_SPRITE_WINDOW_NORMAL] =
+	editor_sprite_space[EDITOR_SPRITE_WINDOW_NORMAL] =
 		newd EditorSprite(
 			loadPNGFile(window_normal_small_png),
 			loadPNGFile(window_normal_png)
 		);
-	sprite_space[EDITOR_SPRITE_WINDOW_HATCH] =
+	editor_sprite_space[EDITOR_SPRITE_WINDOW_HATCH] =
 		newd EditorSprite(
 			loadPNGFile(window_hatch_small_png),
 			loadPNGFile(window_hatch_png)
 		);
 
-	sprite_space[EDITOR_SPRITE_SELECTION_GEM] =
+	editor_sprite_space[EDITOR_SPRITE_SELECTION_GEM] =
 		newd EditorSprite(
 			loadPNGFile(gem_edit_png),
 			nullptr
 		);
-	sprite_space[EDITOR_SPRITE_DRAWING_GEM] =
+	editor_sprite_space[EDITOR_SPRITE_DRAWING_GEM] =
 		newd EditorSprite(
 			loadPNGFile(gem_move_png),
 			nullptr
@@ -406,6 +433,8 @@ bool GraphicManager::loadSpriteMetadata(const FileName& datafile, wxString& erro
 		has_frame_groups = dat_format >= DAT_FORMAT_11;
 	}
 
+	sprite_space.assign(maxID + 1, nullptr);
+
 	uint16_t id = minID;
 	// loop through all ItemDatabase until we reach the end of file
 	while(id <= maxID) {
@@ -488,17 +517,23 @@ bool GraphicManager::loadSpriteMetadata(const FileName& datafile, wxString& erro
 					sprite_id = u16;
 				}
 
-				if(image_space[sprite_id] == nullptr) {
-					GameSprite::NormalImage* img = newd GameSprite::NormalImage();
+				if(sprite_id >= image_space.size()) {
+					image_space.resize(std::max<size_t>(sprite_id + 1, image_space.size() * 2), nullptr);
+				}
+
+				GameSprite::NormalImage*& img = image_space[sprite_id];
+				if(img == nullptr) {
+					img = newd GameSprite::NormalImage();
 					img->id = sprite_id;
-					image_space[sprite_id] = img;
 				}
-				sType->spriteList.push_back(static_cast<GameSprite::NormalImage*>(image_space[sprite_id]));
+				sType->spriteList.push_back(img);
 			}
 		}
 		++id;
 	}
 
+	image_space.shrink_to_fit();
+
 	return true;
 }
 
@@ -647,7 +682,8 @@ bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, w
 		total_pics = u16;
 	}
 
-	if(!g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
+	memcached_sprites = g_settings.getInteger(Config::USE_MEMCACHED_SPRITES) != 0;
+	if(!memcached_sprites) {
 		spritefile = nstr(datafile.GetFullPath());
 		unloaded = false;
 		return true;
@@ -668,10 +704,9 @@ bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, w
 		uint16_t size;
 		safe_get(U16, size);
 
-		ImageMap::iterator it = image_space.find(id);
-		if(it != image_space.end()) {
-			GameSprite::NormalImage* spr = dynamic_cast<GameSprite::NormalImage*>(it->second);
-			if(spr && size > 0) {
+		GameSprite::NormalImage* spr = static_cast<size_t>(id) < image_space.size() ? image_space[id] : nullptr;
+		if(spr) {
+			if(size > 0) {
 				if(spr->size > 0) {
 					wxString ss;
 					ss << "items.spr: Duplicate GameSprite id " << id;
@@ -698,7 +733,7 @@ bool GraphicManager::loadSpriteData(const FileName& datafile, wxString& error, w
 
 bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite_id)
 {
-	if(g_settings.getInteger(Config::USE_MEMCACHED_SPRITES))
+	if(memcached_sprites)
 		return false;
 
 	if(sprite_id == 0) {
@@ -709,10 +744,14 @@ bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite
 	}
 
 	FileReadHandle fh(spritefile);
-	if(!fh.isOk())
+	if(!fh.isOk() || !readSpriteDump(fh, target, size, sprite_id))
 		return false;
 	unloaded = false;
+	return true;
+}
 
+bool GraphicManager::readSpriteDump(FileReadHandle& fh, uint8_t*& target, uint16_t& size, int sprite_id) const
+{
 	if(!fh.seek((is_extended ? 4 : 2) + sprite_id * sizeof(uint32_t)))
 		return false;
 
@@ -733,6 +772,114 @@ bool GraphicManager::loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite
 	return false;
 }
 
+uint8_t* GraphicManager::decodeSprite(uint32_t id, FileReadHandle* file) const
+{
+	if(memcached_sprites) {
+		// Memcached dumps stay until the graphics are cleared, which stops the workers first
+		const GameSprite::NormalImage* image = id < image_space.size() ? image_space[id] : nullptr;
+		if(!image || !image->dump) {
+			return nullptr;
+		}
+		return GameSprite::NormalImage::decodeRGBA(image->dump, image->size, has_transparency);
+	}
+
+	// Only callers that decode a single sprite come without a handle
+	std::unique_ptr<FileReadHandle> temporary;
+	if(!file) {
+		temporary.reset(newd FileReadHandle(spritefile));
+		file = temporary.get();
+	}
+
+	uint8_t* dump = nullptr;
+	uint16_t size = 0;
+	if(!file->isOk() || !readSpriteDump(*file, dump, size, id)) {
+		return nullptr;
+	}
+
+	uint8_t* rgba = GameSprite::NormalImage::decodeRGBA(dump, size, has_transparency);
+	delete[] dump;
+	return rgba;
+}
+
+uint8_t* GraphicManager::decodeSpriteRGBA(uint32_t id, FileReadHandle* file) const
+{
+	if(id == 0 || unloaded) {
+		return nullptr;
+	}
+	return decodeSprite(id, file);
+}
+
+FileReadHandle* GraphicManager::openSpriteFile() const
+{
+	if(memcached_sprites || unloaded) {
+		return nullptr;
+	}
+	return newd FileReadHandle(spritefile);
+}
+
+bool GraphicManager::requestSpriteDecode(uint32_t id, bool prefetch)
+{
+	if(id == 0 || unloaded) {
+		return false;
+	}
+
+	if(!decode_queue) {
+		const int threads = g_settings.getInteger(Config::SPRITE_DECODE_THREADS);
+		if(threads <= 0) {
+			return false;
+		}
+
+		decode_queue = newd SpriteDecodeQueue(
+			[this]() -> SpriteDecodeQueue::DecodeFunction {
+				// Every worker keeps its own handle instead of opening the file per sprite
+				std::shared_ptr<FileReadHandle> file(openSpriteFile());
+				return [this, file](uint32_t id) { return decodeSprite(id, file.get()); };
+			},
+			[this]() { postDecodeRefresh(); },
+			threads
+		);
+	}
+
+	if(decode_queue->request(id, prefetch) && !prefetch) {
+		++texture_cache.misses;
+	}
+	return true;
+}
+
+void GraphicManager::postDecodeRefresh()
+{
+	// One repaint picks up everything that became ready until then
+	if(!decode_refresh_posted.exchange(true) && wxTheApp) {
+		wxTheApp->CallAfter([]() {
+			g_gui.RefreshView();
+		});
+	}
+}
+
+void GraphicManager::uploadDecodedSprites()
+{
+	if(!decode_queue) {
+		return;
+	}
+
+	decode_refresh_posted = false;
+
+	std::vector<DecodedSprite> sprites;
+	decode_queue->takeReady(sprites, SPRITE_UPLOADS_PER_FRAME);
+	for(DecodedSprite& sprite : sprites) {
+		GameSprite::NormalImage* image = sprite.id < image_space.size() ? image_space[sprite.id] : nullptr;
+		if(image && !image->isGLLoaded) {
+			image->uploadGLTexture(sprite.id, sprite.rgba);
+		}
+		delete[] sprite.rgba;
+	}
+
+	// The rest goes up next frame
+	if(decode_queue->getReadyCount() > 0) {
+		postDecodeRefresh();
+	}
+}
+
 void GraphicManager::addSpriteToCleanup(GameSprite* spr)
 {
 	cleanup_list.push_back(spr);
@@ -747,24 +894,99 @@ void GraphicManager::addSpriteToCleanup(GameSprite* spr)
 
 void GraphicManager::garbageCollection()
 {
+	size_t budget = std::numeric_limits<size_t>::max();
 	if(g_settings.getInteger(Config::TEXTURE_MANAGEMENT)) {
-		int t = time(nullptr);
-		if(loaded_textures > g_settings.getInteger(Config::TEXTURE_CLEAN_THRESHOLD) &&
-			t - lastclean > g_settings.getInteger(Config::TEXTURE_CLEAN_PULSE)) {
-			ImageMap::iterator iit = image_space.begin();
-			while(iit != image_space.end()) {
-				iit->second->clean(t);
-				++iit;
-			}
-			SpriteMap::iterator sit = sprite_space.begin();
-			while(sit != sprite_space.end()) {
-				GameSprite* gs = dynamic_cast<GameSprite*>(sit->second);
-				if(gs) gs->clean(t);
-				++sit;
-			}
-			lastclean = t;
-		}
+		budget = static_cast<size_t>(std::max<int>(1, g_settings.getInteger(Config::TEXTURE_CACHE_BUDGET))) * 1024 * 1024;
+	}
+	texture_cache.endFrame(budget);
+}
+
+// ============================================================================
+// TextureCache
+
+TextureCache::TextureCache() :
+	hits(0),
+	misses(0),
+	uploads(0),
+	evictions(0),
+	head(nullptr),
+	tail(nullptr),
+	frame(0),
+	bytes(0),
+	count(0)
+{
+	////
+}
+
+void TextureCache::touch(GameSprite::Image* image)
+{
+	++hits;
+	image->lruFrame = frame;
+	if(image == head) {
+		return;
+	}
+
+	// Unlink
+	image->lruPrev->lruNext = image->lruNext;
+	if(image->lruNext) {
+		image->lruNext->lruPrev = image->lruPrev;
+	} else {
+		tail = image->lruPrev;
+	}
+
+	// Relink at the front
+	image->lruPrev = nullptr;
+	image->lruNext = head;
+	head->lruPrev = image;
+	head = image;
+}
+
+void TextureCache::insert(GameSprite::Image* image, size_t size)
+{
+	++uploads;
+	image->lruFrame = frame;
+	image->lruPrev = nullptr;
+	image->lruNext = head;
+	if(head) {
+		head->lruPrev = image;
+	} else {
+		tail = image;
+	}
+	head = image;
+
+	bytes += size;
+	++count;
+}
+
+void TextureCache::remove(GameSprite::Image* image, size_t size)
+{
+	if(image->lruPrev) {
+		image->lruPrev->lruNext = image->lruNext;
+	} else {
+		head = image->lruNext;
+	}
+	if(image->lruNext) {
+		image->lruNext->lruPrev = image->lruPrev;
+	} else {
+		tail = image->lruPrev;
+	}
+	image->lruPrev = nullptr;
+	image->lruNext = nullptr;
+
+	bytes -= size;
+	--count;
+}
+
+void TextureCache::endFrame(size_t budget)
+{
+	// Everything drawn this frame is in front of the first stale texture
+	while(bytes > budget && tail && tail->lruFrame != frame) {
+		GameSprite::Image* image = tail;
+		image->unloadGLTexture(0);
+		image->onEvicted();
+		++evictions;
 	}
+	++frame;
 }
 
 EditorSprite::EditorSprite(wxBitmap* b16x16, wxBitmap* b32x32)
@@ -794,7 +1016,6 @@ void EditorSprite::unloadDC()
 }
 
 GameSprite::GameSprite() :
-	id(0),
 	height(0),
 	width(0),
 	layers(0),
@@ -802,11 +1023,12 @@ GameSprite::GameSprite() :
 	pattern_y(0),
 	pattern_z(0),
 	frames(0),
-	numsprites(0),
-	animator(nullptr),
 	draw_height(0),
 	drawoffset_x(0),
 	drawoffset_y(0),
+	numsprites(0),
+	id(0),
+	animator(nullptr),
 	minimap_color(0)
 {
 	dc[SPRITE_SIZE_16x16] = nullptr;
@@ -816,22 +1038,13 @@ GameSprite::GameSprite() :
 GameSprite::~GameSprite()
 {
 	unloadDC();
-	for(std::list<TemplateImage*>::iterator iter = instanced_templates.begin(); iter != instanced_templates.end(); ++iter) {
-		delete *iter;
+	for(auto& templateEntry : instanced_templates) {
+		delete templateEntry.second;
 	}
 
 	delete animator;
 }
 
-void GameSprite::clean(int time) {
-	for(std::list<TemplateImage*>::iterator iter = instanced_templates.begin();
-			iter != instanced_templates.end();
-			++iter)
-	{
-		(*iter)->clean(time);
-	}
-}
-
 void GameSprite::unloadDC()
 {
 	delete dc[SPRITE_SIZE_16x16];
@@ -840,16 +1053,6 @@ void GameSprite::unloadDC()
 	dc[SPRITE_SIZE_32x32] = nullptr;
 }
 
-int GameSprite::getDrawHeight() const
-{
-	return draw_height;
-}
-
-std::pair<int, int> GameSprite::getDrawOffset() const
-{
-	return std::make_pair(drawoffset_x, drawoffset_y);
-}
-
 uint8_t GameSprite::getMiniMapColor() const
 {
 	return minimap_color;
@@ -866,7 +1069,7 @@ int GameSprite::getIndex(int width, int height, int layer, int pattern_x, int pa
 		this->width + width;
 }
 
-GLuint GameSprite::getHardwareID(int _x, int _y, int _layer, int _count, int _pattern_x, int _pattern_y, int _pattern_z, int _frame)
+uint32_t GameSprite::getSpriteIndex(int _x, int _y, int _layer, int _count, int _pattern_x, int _pattern_y, int _pattern_z, int _frame) const
 {
 	uint32_t v;
 	if(_count >= 0 && height <= 1 && width <= 1) {
@@ -881,32 +1084,10 @@ GLuint GameSprite::getHardwareID(int _x, int _y, int _layer, int _count, int _pa
 			v %= numsprites;
 		}
 	}
-	return spriteList[v]->getHardwareID();
-}
-
-GameSprite::TemplateImage* GameSprite::getTemplateImage(int sprite_index, const Outfit& outfit)
-{
-	if(instanced_templates.empty()) {
-		TemplateImage* img = newd TemplateImage(this, sprite_index, outfit);
-		instanced_templates.push_back(img);
-		return img;
-	}
-	// While this is linear lookup, it is very rare for the list to contain more than 4-8 entries, so it's faster than a hashmap anyways.
-	for(std::list<TemplateImage*>::iterator iter = instanced_templates.begin(); iter != instanced_templates.end(); ++iter) {
-		TemplateImage* img = *iter;
-		if(img->sprite_index == sprite_index) {
-			uint32_t lookHash = img->lookHead << 24 | img->lookBody << 16 | img->lookLegs << 8 | img->lookFeet;
-			if(outfit.getColorHash() == lookHash) {
-				return img;
-			}
-		}
-	}
-	TemplateImage* img = newd TemplateImage(this, sprite_index, outfit);
-	instanced_templates.push_back(img);
-	return img;
+	return v;
 }
 
-GLuint GameSprite::getHardwareID(int _x, int _y, int _dir, const Outfit& _outfit, int _frame)
+uint32_t GameSprite::getSpriteIndex(int _x, int _y, int _dir) const
 {
 	uint32_t v;
 	v = ((((_dir) * layers) * height+_y) * width+_x);
@@ -917,6 +1098,57 @@ GLuint GameSprite::getHardwareID(int _x, int _y, int _dir, const Outfit& _outfit
 			v %= numsprites;
 		}
 	}
+	return v;
+}
+
+uint32_t GameSprite::getSpriteID(uint32_t index) const
+{
+	return index < spriteList.size() ? spriteList[index]->id : 0;
+}
+
+GLuint GameSprite::getHardwareID(int _x, int _y, int _layer, int _count, int _pattern_x, int _pattern_y, int _pattern_z, int _frame)
+{
+	return spriteList[getSpriteIndex(_x, _y, _layer, _count, _pattern_x, _pattern_y, _pattern_z, _frame)]->getHardwareID();
+}
+
+void GameSprite::prefetchTextures()
+{
+	// Frames are the outermost index, so the first frame comes first
+	const uint32_t count = std::min<uint32_t>(numsprites, width * height * layers * pattern_x * pattern_y * pattern_z);
+	for(uint32_t i = 0; i < count; ++i) {
+		NormalImage* image = spriteList[i];
+		if(image->isGLLoaded || image->id == 0) {
+			continue;
+		}
+		// Sprites are decoded synchronously
+		if(!g_gui.gfx.requestSpriteDecode(image->id, true)) {
+			return;
+		}
+	}
+}
+
+GameSprite::TemplateImage* GameSprite::getTemplateImage(int sprite_index, const Outfit& outfit)
+{
+	const uint64_t key = static_cast<uint64_t>(sprite_index) << 32 | outfit.getColorHash();
+	auto it = instanced_templates.find(key);
+	if(it != instanced_templates.end()) {
+		return it->second;
+	}
+
+	TemplateImage* img = newd TemplateImage(this, sprite_index, outfit, key);
+	instanced_templates.emplace(key, img);
+	return img;
+}
+
+void GameSprite::removeTemplateImage(TemplateImage* image)
+{
+	instanced_templates.erase(image->key);
+	delete image;
+}
+
+GLuint GameSprite::getHardwareID(int _x, int _y, int _dir, const Outfit& _outfit, int _frame)
+{
+	const uint32_t v = getSpriteIndex(_x, _y, _dir);
 	if(layers > 1) { // Template
 		TemplateImage* img = getTemplateImage(v, _outfit);
 		return img->getHardwareID();
@@ -942,6 +1174,7 @@ wxMemoryDC* GameSprite::getDC(SpriteSize size)
 				for(uint8_t h = 0; h < height; h++) {
 					const int i = getIndex(w, h, l, 0, 0, 0, 0);
 					uint8_t* data = spriteList[i]->getRGBData();
+					spriteList[i]->releaseDump();
 					if(data) {
 						wxImage img(SPRITE_PIXELS, SPRITE_PIXELS, data);
 						img.SetMaskColour(0xFF, 0x00, 0xFF);
@@ -983,27 +1216,45 @@ void GameSprite::DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int w
 
 GameSprite::Image::Image() :
 	isGLLoaded(false),
-	lastaccess(0)
+	lruPrev(nullptr),
+	lruNext(nullptr),
+	lruFrame(0)
 {
 	////
 }
 
 GameSprite::Image::~Image()
 {
-	unloadGLTexture(0);
+	// Derived images unload their own texture, this only keeps the cache consistent
+	if(isGLLoaded) {
+		isGLLoaded = false;
+		g_gui.gfx.texture_cache.remove(this, SPRITE_PIXELS_SIZE * 4);
+	}
 }
 
 void GameSprite::Image::createGLTexture(GLuint whatid)
 {
 	ASSERT(!isGLLoaded);
 
+	++g_gui.gfx.texture_cache.misses;
+
 	uint8_t* rgba = getRGBAData();
 	if(!rgba) {
 		return;
 	}
 
+	uploadGLTexture(whatid, rgba);
+
+	delete[] rgba;
+	#undef SPRITE_SIZE
+}
+
+void GameSprite::Image::uploadGLTexture(GLuint whatid, const uint8_t* rgba)
+{
+	ASSERT(!isGLLoaded);
+
 	isGLLoaded = true;
-	g_gui.gfx.loaded_textures += 1;
+	g_gui.gfx.texture_cache.insert(this, SPRITE_PIXELS_SIZE * 4);
 
 	glBindTexture(GL_TEXTURE_2D, whatid);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Linear Filtering
@@ -1011,28 +1262,22 @@ void GameSprite::Image::createGLTexture(GLuint whatid)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SPRITE_PIXELS, SPRITE_PIXELS, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
-
-	delete[] rgba;
-	#undef SPRITE_SIZE
 }
 
 void GameSprite::Image::unloadGLTexture(GLuint whatid)
 {
+	if(!isGLLoaded) {
+		return;
+	}
+
 	isGLLoaded = false;
-	g_gui.gfx.loaded_textures -= 1;
+	g_gui.gfx.texture_cache.remove(this, SPRITE_PIXELS_SIZE * 4);
 	glDeleteTextures(1, &whatid);
 }
 
 void GameSprite::Image::visit()
 {
-	lastaccess = time(nullptr);
-}
-
-void GameSprite::Image::clean(int time)
-{
-	if(isGLLoaded && time - lastaccess > g_settings.getInteger(Config::TEXTURE_LONGEVITY)) {
-		unloadGLTexture(0);
-	}
+	g_gui.gfx.texture_cache.touch(this);
 }
 
 GameSprite::NormalImage::NormalImage() :
@@ -1045,13 +1290,13 @@ GameSprite::NormalImage::NormalImage() :
 
 GameSprite::NormalImage::~NormalImage()
 {
+	unloadGLTexture();
 	delete[] dump;
 }
 
-void GameSprite::NormalImage::clean(int time)
+void GameSprite::NormalImage::releaseDump()
 {
-	Image::clean(time);
-	if(time - lastaccess > 5 && !g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) { // We keep dumps around for 5 seconds.
+	if(!g_gui.gfx.hasMemcachedSprites()) {
 		delete[] dump;
 		dump = nullptr;
 	}
@@ -1060,7 +1305,7 @@ void GameSprite::NormalImage::clean(int time)
 uint8_t* GameSprite::NormalImage::getRGBData()
 {
 	if(!dump) {
-		if(g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
+		if(g_gui.gfx.hasMemcachedSprites()) {
 			return nullptr;
 		}
 
@@ -1111,7 +1356,7 @@ uint8_t* GameSprite::NormalImage::getRGBData()
 uint8_t* GameSprite::NormalImage::getRGBAData()
 {
 	if(!dump) {
-		if(g_settings.getInteger(Config::USE_MEMCACHED_SPRITES)) {
+		if(g_gui.gfx.hasMemcachedSprites()) {
 			return nullptr;
 		}
 
@@ -1120,9 +1365,13 @@ uint8_t* GameSprite::NormalImage::getRGBAData()
 		}
 	}
 
+	return decodeRGBA(dump, size, g_gui.gfx.hasTransparency());
+}
+
+uint8_t* GameSprite::NormalImage::decodeRGBA(const uint8_t* dump, uint16_t size, bool use_alpha)
+{
 	const int pixels_data_size = SPRITE_PIXELS_SIZE * 4;
 	uint8_t* data = newd uint8_t[pixels_data_size];
-	bool use_alpha = g_gui.gfx.hasTransparency();
 	uint8_t bpp = use_alpha ? 4 : 3;
 	int write = 0;
 	int read = 0;
@@ -1167,15 +1416,22 @@ uint8_t* GameSprite::NormalImage::getRGBAData()
 GLuint GameSprite::NormalImage::getHardwareID()
 {
 	if(!isGLLoaded) {
+		// Drawn as nothing until the workers have decoded it
+		if(g_gui.gfx.requestSpriteDecode(id)) {
+			return 0;
+		}
 		createGLTexture(id);
+	} else {
+		visit();
 	}
-	visit();
 	return id;
 }
 
 void GameSprite::NormalImage::createGLTexture(GLuint ignored)
 {
 	Image::createGLTexture(id);
+	// The texture holds the pixels now
+	releaseDump();
 }
 
 void GameSprite::NormalImage::unloadGLTexture(GLuint ignored)
@@ -1183,9 +1439,10 @@ void GameSprite::NormalImage::unloadGLTexture(GLuint ignored)
 	Image::unloadGLTexture(id);
 }
 
-GameSprite::TemplateImage::TemplateImage(GameSprite* parent, int v, const Outfit& outfit) :
+GameSprite::TemplateImage::TemplateImage(GameSprite* parent, int v, const Outfit& outfit, uint64_t key) :
 	gl_tid(0),
 	parent(parent),
+	key(key),
 	sprite_index(v),
 	lookHead(outfit.lookHead),
 	lookBody(outfit.lookBody),
@@ -1197,17 +1454,79 @@ GameSprite::TemplateImage::TemplateImage(GameSprite* parent, int v, const Outfit
 
 GameSprite::TemplateImage::~TemplateImage()
 {
-	////
-}
-
-void GameSprite::TemplateImage::colorizePixel(uint8_t color, uint8_t& red, uint8_t& green, uint8_t& blue) {
-	// Thanks! Khaos, or was it mips? Hmmm... =)
-	uint8_t ro = (TemplateOutfitLookupTable[color] & 0xFF0000) >> 16; // rgb outfit
-	uint8_t go = (TemplateOutfitLookupTable[color] & 0xFF00) >> 8;
-	uint8_t bo = (TemplateOutfitLookupTable[color] & 0xFF);
-	red = (uint8_t)(red * (ro / 255.f));
-	green = (uint8_t)(green * (go / 255.f));
-	blue = (uint8_t)(blue * (bo / 255.f));
+	unloadGLTexture();
+}
+
+void GameSprite::TemplateImage::onEvicted()
+{
+	parent->removeTemplateImage(this);
+}
+
+void GameSprite::TemplateImage::colorize(uint8_t* pixels, int bpp, const uint8_t* template_rgb)
+{
+	Outfit outfit;
+	outfit.lookHead = lookHead;
+	outfit.lookBody = lookBody;
+	outfit.lookLegs = lookLegs;
+	outfit.lookFeet = lookFeet;
+	GameSprite::colorizeOutfit(pixels, bpp, template_rgb, outfit);
+}
+
+void GameSprite::colorizeOutfit(uint8_t* pixels, int bpp, const uint8_t* template_rgb, const Outfit& outfit)
+{
+	const int colorCount = sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]);
+	const int lookHead = outfit.lookHead >= 0 && outfit.lookHead < colorCount ? outfit.lookHead : 0;
+	const int lookBody = outfit.lookBody >= 0 && outfit.lookBody < colorCount ? outfit.lookBody : 0;
+	const int lookLegs = outfit.lookLegs >= 0 && outfit.lookLegs < colorCount ? outfit.lookLegs : 0;
+	const int lookFeet = outfit.lookFeet >= 0 && outfit.lookFeet < colorCount ? outfit.lookFeet : 0;
+
+	// Template pixel (red, green, blue set) => color it gets multiplied with
+	uint32_t partColors[8];
+	std::fill(partColors, partColors + 8, 0xFFFFFF);
+	partColors[6] = TemplateOutfitLookupTable[lookHead]; // yellow => head
+	partColors[4] = TemplateOutfitLookupTable[lookBody]; // red => body
+	partColors[2] = TemplateOutfitLookupTable[lookLegs]; // green => legs
+	partColors[1] = TemplateOutfitLookupTable[lookFeet]; // blue => feet
+
+	// First pass builds a multiplier for every channel, alpha stays as is
+	alignas(16) uint8_t multipliers[SPRITE_PIXELS_SIZE * 4];
+	for(int i = 0; i < SPRITE_PIXELS_SIZE; ++i) {
+		const uint8_t* t = template_rgb + i * 3;
+		const uint32_t color = partColors[(t[0] != 0) << 2 | (t[1] != 0) << 1 | (t[2] != 0)];
+		multipliers[i * 4 + 0] = (color >> 16) & 0xFF;
+		multipliers[i * 4 + 1] = (color >> 8) & 0xFF;
+		multipliers[i * 4 + 2] = color & 0xFF;
+		multipliers[i * 4 + 3] = 0xFF;
+	}
+
+	// Second pass: pixel * multiplier / 255, v / 255 == (v + 1 + (v >> 8)) >> 8 for any product of two bytes
+	if(bpp == 4) {
+		int i = 0;
+#ifdef RME_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi16(1);
+		for(; i < SPRITE_PIXELS_SIZE * 4; i += 16) {
+			const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+			const __m128i m = _mm_load_si128(reinterpret_cast<const __m128i*>(multipliers + i));
+			__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), _mm_unpacklo_epi8(m, zero));
+			__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), _mm_unpackhi_epi8(m, zero));
+			lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), _mm_packus_epi16(lo, hi));
+		}
+#endif
+		for(; i < SPRITE_PIXELS_SIZE * 4; ++i) {
+			const uint32_t v = pixels[i] * multipliers[i];
+			pixels[i] = uint8_t((v + 1 + (v >> 8)) >> 8);
+		}
+	} else {
+		for(int i = 0; i < SPRITE_PIXELS_SIZE; ++i) {
+			for(int c = 0; c < 3; ++c) {
+				const uint32_t v = pixels[i * bpp + c] * multipliers[i * 4 + c];
+				pixels[i * bpp + c] = uint8_t((v + 1 + (v >> 8)) >> 8);
+			}
+		}
+	}
 }
 
 uint8_t* GameSprite::TemplateImage::getRGBData()
@@ -1224,40 +1543,7 @@ uint8_t* GameSprite::TemplateImage::getRGBData()
 		return nullptr;
 	}
 
-	if(lookHead > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookHead = 0;
-	}
-	if(lookBody > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookBody = 0;
-	}
-	if(lookLegs > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookLegs = 0;
-	}
-	if(lookFeet > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookFeet = 0;
-	}
-
-	for(int y = 0; y < SPRITE_PIXELS; ++y) {
-		for(int x = 0; x < SPRITE_PIXELS; ++x) {
-			uint8_t& red   = rgbdata[y*SPRITE_PIXELS*3 + x*3 + 0];
-			uint8_t& green = rgbdata[y*SPRITE_PIXELS*3 + x*3 + 1];
-			uint8_t& blue  = rgbdata[y*SPRITE_PIXELS*3 + x*3 + 2];
-
-			uint8_t& tred   = template_rgbdata[y*SPRITE_PIXELS*3 + x*3 + 0];
-			uint8_t& tgreen = template_rgbdata[y*SPRITE_PIXELS*3 + x*3 + 1];
-			uint8_t& tblue  = template_rgbdata[y*SPRITE_PIXELS*3 + x*3 + 2];
-
-			if(tred && tgreen && !tblue) { // yellow => head
-				colorizePixel(lookHead, red, green, blue);
-			} else if(tred && !tgreen && !tblue) { // red => body
-				colorizePixel(lookBody, red, green, blue);
-			} else if(!tred && tgreen && !tblue) { // green => legs
-				colorizePixel(lookLegs, red, green, blue);
-			} else if(!tred && !tgreen && tblue) { // blue => feet
-				colorizePixel(lookFeet, red, green, blue);
-			}
-		}
-	}
+	colorize(rgbdata, 3, template_rgbdata);
 	delete[] template_rgbdata;
 	return rgbdata;
 }
@@ -1276,40 +1562,7 @@ uint8_t* GameSprite::TemplateImage::getRGBAData()
 		return nullptr;
 	}
 
-	if(lookHead > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookHead = 0;
-	}
-	if(lookBody > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookBody = 0;
-	}
-	if(lookLegs > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookLegs = 0;
-	}
-	if(lookFeet > (sizeof(TemplateOutfitLookupTable) / sizeof(TemplateOutfitLookupTable[0]))) {
-		lookFeet = 0;
-	}
-
-	for(int y = 0; y < SPRITE_PIXELS; ++y) {
-		for(int x = 0; x < SPRITE_PIXELS; ++x) {
-			uint8_t& red   = rgbadata[y*SPRITE_PIXELS*4 + x*4 + 0];
-			uint8_t& green = rgbadata[y*SPRITE_PIXELS*4 + x*4 + 1];
-			uint8_t& blue  = rgbadata[y*SPRITE_PIXELS*4 + x*4 + 2];
-
-			uint8_t& tred   = template_rgbdata[y*SPRITE_PIXELS*3 + x*3 + 0];
-			uint8_t& tgreen = template_rgbdata[y*SPRITE_PIXELS*3 + x*3 + 1];
-			uint8_t& tblue  = template_rgbdata[y*SPRITE_PIXELS*3 + x*3 + 2];
-
-			if(tred && tgreen && !tblue) { // yellow => head
-				colorizePixel(lookHead, red, green, blue);
-			} else if(tred && !tgreen && !tblue) { // red => body
-				colorizePixel(lookBody, red, green, blue);
-			} else if(!tred && tgreen && !tblue) { // green => legs
-				colorizePixel(lookLegs, red, green, blue);
-			} else if(!tred && !tgreen && tblue) { // blue => feet
-				colorizePixel(lookFeet, red, green, blue);
-			}
-		}
-	}
+	colorize(rgbadata, 4, template_rgbdata);
 	delete[] template_rgbdata;
 	return rgbadata;
 }
@@ -1324,8 +1577,9 @@ GLuint GameSprite::TemplateImage::getHardwareID()
 		if(!isGLLoaded) {
 			return 0;
 		}
+	} else {
+		visit();
 	}
-	visit();
 	return gl_tid;
 }
 
@@ -20,7 +20,9 @@
 
 #include "outfit.h"
 #include "common.h"
+#include <atomic>
 #include <deque>
+#include <unordered_map>
 
 #include "client_version.h"
 
@@ -42,6 +44,8 @@ enum ItemAnimationDuration {
 
 class MapCanvas;
 class GraphicManager;
+class TextureCache;
+class SpriteDecodeQueue;
 class FileReadHandle;
 class Animator;
 
@@ -70,30 +74,54 @@ protected:
 
 
 class GameSprite : public Sprite{
+protected:
+	class Image;
+	class NormalImage;
+	class TemplateImage;
+
 public:
+	// Everything drawing a sprite reads, kept together at the front of the object
+	uint8_t height;
+	uint8_t width;
+	uint8_t layers;
+	uint8_t pattern_x;
+	uint8_t pattern_y;
+	uint8_t pattern_z;
+	uint8_t frames;
+	uint16_t draw_height;
+	uint16_t drawoffset_x;
+	uint16_t drawoffset_y;
+	uint32_t numsprites;
+	std::vector<NormalImage*> spriteList;
+
 	GameSprite();
 	~GameSprite();
 
 	int getIndex(int width, int height, int layer, int pattern_x, int pattern_y, int pattern_z, int frame) const;
 	GLuint getHardwareID(int _x, int _y, int _layer, int _subtype, int _pattern_x, int _pattern_y, int _pattern_z, int _frame);
 	GLuint getHardwareID(int _x, int _y, int _dir, const Outfit& _outfit, int _frame); // CreatureDatabase
+	// Index into spriteList of the image the above draw, an outfit template is width * height images further
+	uint32_t getSpriteIndex(int _x, int _y, int _layer, int _subtype, int _pattern_x, int _pattern_y, int _pattern_z, int _frame) const;
+	uint32_t getSpriteIndex(int _x, int _y, int _dir) const;
+	uint32_t getSpriteID(uint32_t index) const;
 	virtual void DrawTo(wxDC* dc, SpriteSize sz, int start_x, int start_y, int width = -1, int height = -1);
 
 	virtual void unloadDC();
 
-	void clean(int time);
+	// Queues the first animation frame for decoding before it comes into view
+	void prefetchTextures();
 
-	int getDrawHeight() const;
-	std::pair<int, int> getDrawOffset() const;
+	int getDrawHeight() const { return draw_height; }
+	std::pair<int, int> getDrawOffset() const { return std::make_pair(drawoffset_x, drawoffset_y); }
 	uint8_t getMiniMapColor() const;
 
-protected:
-	class Image;
-	class NormalImage;
-	class TemplateImage;
+	// Multiplies RGB(A) pixels with the outfit colors where the template marks a body part
+	static void colorizeOutfit(uint8_t* pixels, int bpp, const uint8_t* template_rgb, const Outfit& outfit);
 
+protected:
 	wxMemoryDC* getDC(SpriteSize size);
 	TemplateImage* getTemplateImage(int sprite_index, const Outfit& outfit);
+	void removeTemplateImage(TemplateImage* image);
 
 	class Image {
 	public:
@@ -101,10 +129,13 @@ protected:
 		virtual ~Image();
 
 		bool isGLLoaded;
-		int lastaccess;
+
+		// Position in the texture cache, only linked while the texture is loaded
+		Image* lruPrev;
+		Image* lruNext;
+		uint32_t lruFrame;
 
 		void visit();
-		virtual void clean(int time);
 
 		virtual GLuint getHardwareID() = 0;
 		virtual uint8_t* getRGBData() = 0;
@@ -112,6 +143,12 @@ protected:
 	protected:
 		virtual void createGLTexture(GLuint whatid);
 		virtual void unloadGLTexture(GLuint whatid);
+		void uploadGLTexture(GLuint whatid, const uint8_t* rgba);
+		// The texture cache unloaded the texture to stay within its budget
+		virtual void onEvicted() {}
+
+		friend class TextureCache;
+		friend class GraphicManager;
 	};
 
 	class NormalImage : public Image {
@@ -126,11 +163,15 @@ protected:
 		uint16_t size;
 		uint8_t* dump;
 
-		virtual void clean(int time);
-
 		virtual GLuint getHardwareID();
 		virtual uint8_t* getRGBData();
 		virtual uint8_t* getRGBAData();
+
+		// Dumps read from the sprite file are dropped once the pixels live elsewhere
+		void releaseDump();
+
+		// Returns newd RGBA pixels, safe to call from any thread
+		static uint8_t* decodeRGBA(const uint8_t* dump, uint16_t size, bool use_alpha);
 	protected:
 		virtual void createGLTexture(GLuint ignored = 0);
 		virtual void unloadGLTexture(GLuint ignored = 0);
@@ -138,7 +179,7 @@ protected:
 
 	class TemplateImage : public Image {
 	public:
-		TemplateImage(GameSprite* parent, int v, const Outfit& outfit);
+		TemplateImage(GameSprite* parent, int v, const Outfit& outfit, uint64_t key);
 		virtual ~TemplateImage();
 
 		virtual GLuint getHardwareID();
@@ -147,13 +188,18 @@ protected:
 
 		GLuint gl_tid;
 		GameSprite* parent;
+		uint64_t key;
 		int sprite_index;
 		uint8_t lookHead;
 		uint8_t lookBody;
 		uint8_t lookLegs;
 		uint8_t lookFeet;
 	protected:
-		void colorizePixel(uint8_t color, uint8_t &r, uint8_t &b, uint8_t &g);
+		// Colors the pixels with the outfit of this image
+		void colorize(uint8_t* pixels, int bpp, const uint8_t* template_rgb);
+
+		// Recolored outfits aren't worth keeping once their texture is gone
+		virtual void onEvicted();
 
 		virtual void createGLTexture(GLuint ignored = 0);
 		virtual void unloadGLTexture(GLuint ignored = 0);
@@ -163,28 +209,49 @@ protected:
 	wxMemoryDC* dc[SPRITE_SIZE_COUNT];
 
 public:
-	// GameSprite info
-	uint8_t height;
-	uint8_t width;
-	uint8_t layers;
-	uint8_t pattern_x;
-	uint8_t pattern_y;
-	uint8_t pattern_z;
-	uint8_t frames;
-	uint32_t numsprites;
-
 	Animator* animator;
 
-	uint16_t draw_height;
-	uint16_t drawoffset_x;
-	uint16_t drawoffset_y;
-
 	uint16_t minimap_color;
 
-	std::vector<NormalImage*> spriteList;
-	std::list<TemplateImage*> instanced_templates; // Templates that use this sprite
+	// Recolored images of this sprite, by sprite index and outfit colors
+	std::unordered_map<uint64_t, TemplateImage*> instanced_templates;
 
 	friend class GraphicManager;
+	friend class TextureCache;
+};
+
+// Tracks the GL textures of sprite images, least recently drawn first.
+// Images are stamped with the current frame when drawn, and once the loaded
+// textures exceed the byte budget the oldest ones are unloaded from the tail.
+class TextureCache
+{
+public:
+	TextureCache();
+
+	// A texture was drawn, moves it to the front
+	void touch(GameSprite::Image* image);
+	// A texture was uploaded / unloaded
+	void insert(GameSprite::Image* image, size_t bytes);
+	void remove(GameSprite::Image* image, size_t bytes);
+
+	// Unloads textures not drawn this frame until the budget is met, and starts a new frame
+	void endFrame(size_t budget);
+
+	uint32_t getFrame() const { return frame; }
+	size_t getBytes() const { return bytes; }
+	size_t getCount() const { return count; }
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t uploads;
+	uint64_t evictions;
+
+private:
+	GameSprite::Image* head;
+	GameSprite::Image* tail;
+	uint32_t frame;
+	size_t bytes;
+	size_t count;
 };
 
 struct FrameDuration
@@ -276,8 +343,19 @@ public:
 	bool loadSpriteMetadataFlags(FileReadHandle& file, GameSprite* sType, wxString& error, wxArrayString& warnings);
 	bool loadSpriteData(const FileName& datafile, wxString& error, wxArrayString& warnings);
 
-	// Cleans old & unused textures according to config settings
+	// Frees the least recently drawn textures beyond the configured budget, call once per frame
 	void garbageCollection();
+	const TextureCache& getTextureCache() const { return texture_cache; }
+
+	// Queues a sprite image for decoding on the worker threads, false if sprites are decoded synchronously
+	bool requestSpriteDecode(uint32_t id, bool prefetch = false);
+	// Returns newd RGBA pixels of a sprite image without touching its texture, safe to call from any thread.
+	// Threads decoding many sprites pass their own handle from openSpriteFile.
+	uint8_t* decodeSpriteRGBA(uint32_t id, FileReadHandle* file = nullptr) const;
+	// newd handle on the sprite file for one thread, nullptr if sprites are memcached
+	FileReadHandle* openSpriteFile() const;
+	// Uploads a bounded number of the sprites decoded meanwhile, call with the GL context current
+	void uploadDecodedSprites();
 	void addSpriteToCleanup(GameSprite* spr);
 
 	wxFileName getMetadataFileName() const { return metadata_file; }
@@ -285,19 +363,28 @@ public:
 
 	bool hasTransparency() const;
 	bool isUnloaded() const;
+	bool hasMemcachedSprites() const;
 
 	ClientVersion *client_version;
 
 private:
-	bool unloaded;
+	// Read by the decoding threads, the decode queue is stopped before the graphics are cleared
+	std::atomic<bool> unloaded;
+	// USE_MEMCACHED_SPRITES as it was when the sprites were loaded
+	bool memcached_sprites;
 	// This is used if memcaching is NOT on
 	std::string spritefile;
 	bool loadSpriteDump(uint8_t*& target, uint16_t& size, int sprite_id);
+	bool readSpriteDump(FileReadHandle& fh, uint8_t*& target, uint16_t& size, int sprite_id) const;
+	uint8_t* decodeSprite(uint32_t id, FileReadHandle* file) const;
+	void postDecodeRefresh();
 
+	// Internal editor sprites, their ids are negative
 	typedef std::map<int, Sprite*> SpriteMap;
-	SpriteMap sprite_space;
-	typedef std::map<int, GameSprite::Image*> ImageMap;
-	ImageMap image_space;
+	SpriteMap editor_sprite_space;
+	// Game sprites and their images, indexed by id
+	std::vector<GameSprite*> sprite_space;
+	std::vector<GameSprite::NormalImage*> image_space;
 	std::deque<GameSprite*> cleanup_list;
 
 	DatFormat dat_format;
@@ -311,8 +398,9 @@ private:
 	wxFileName metadata_file;
 	wxFileName sprites_file;
 
-	int loaded_textures;
-	int lastclean;
+	TextureCache texture_cache;
+	SpriteDecodeQueue* decode_queue;
+	std::atomic<bool> decode_refresh_posted;
 
 	wxStopWatch* animation_timer;
 
@@ -79,6 +79,7 @@ GUI::GUI() :
 	mode(SELECTION_MODE),
 	pasting(false),
 	hotkeys_enabled(true),
+	headless(false),
 
 	current_brush(nullptr),
 	previous_brush(nullptr),
@@ -262,7 +263,7 @@ bool GUI::LoadVersion(ClientVersionID version, wxString& error, wxArrayString& w
 	}
 
 	if(version != loaded_version || force) {
-		if(getLoadedVersion() != nullptr)
+		if(getLoadedVersion() != nullptr && !headless)
 			// There is another version loaded right now, save window layout
 			g_gui.SavePerspective();
 
@@ -284,10 +285,10 @@ bool GUI::LoadVersion(ClientVersionID version, wxString& error, wxArrayString& w
 		}
 
 		bool ret = LoadDataFiles(error, warnings);
-		if(ret)
-			g_gui.LoadPerspective();
-		else
+		if(!ret)
 			loaded_version = CLIENT_VERSION_NONE;
+		else if(!headless)
+			g_gui.LoadPerspective();
 
 		return ret;
 	}
@@ -757,6 +758,9 @@ bool GUI::CloseLiveEditors(LiveSocket* sock)
 
 bool GUI::CloseAllEditors()
 {
+	if(!tabbook)
+		return true;
+
 	for(int i = 0; i < tabbook->GetTabCount(); ++i) {
 		auto *mapTab = dynamic_cast<MapTab*>(tabbook->GetTab(i));
 		if(mapTab) {
@@ -986,6 +990,9 @@ void GUI::ActivatePalette(PaletteWindow* p)
 
 void GUI::DestroyPalettes()
 {
+	if(!aui_manager)
+		return;
+
 	for (auto palette : palettes) {
 		aui_manager->DetachPane(palette);
 		palette->Destroy();
@@ -1096,6 +1103,10 @@ bool GUI::IsMinimapVisible() const
 
 void GUI::RefreshView()
 {
+	if(!tabbook) {
+		return;
+	}
+
 	EditorTab* editorTab = GetCurrentTab();
 	if(!editorTab) {
 		return;
@@ -1119,6 +1130,20 @@ void GUI::RefreshView()
 	}
 }
 
+void GUI::RefreshViewOverlay()
+{
+	if(!tabbook) {
+		return;
+	}
+
+	for(int32_t index = 0; index < tabbook->GetTabCount(); ++index) {
+		auto* mapTab = dynamic_cast<MapTab*>(tabbook->GetTab(index));
+		if(mapTab) {
+			mapTab->GetCanvas()->RefreshOverlay();
+		}
+	}
+}
+
 void GUI::CreateLoadBar(wxString message, bool canCancel /* = false */ )
 {
 	progressText = message;
@@ -1127,6 +1152,11 @@ void GUI::CreateLoadBar(wxString message, bool canCancel /* = false */ )
 	progressTo = 100;
 	currentProgress = -1;
 
+	if(headless) {
+		PrintMessage(progressText + "...");
+		return;
+	}
+
 	progressBar = newd wxGenericProgressDialog("Loading", progressText + " (0%)", 100, root,
 		wxPD_APP_MODAL | wxPD_SMOOTH | (canCancel ? wxPD_CAN_ABORT : 0)
 	);
@@ -1163,6 +1193,15 @@ bool GUI::SetLoadDone(int32_t done, const wxString& newMessage)
 	int32_t newProgress = progressFrom + static_cast<int32_t>((done / 100.f) * (progressTo - progressFrom));
 	newProgress = std::max<int32_t>(0, std::min<int32_t>(100, newProgress));
 
+	if(headless) {
+		// Only every tenth percent, a log isn't a progress bar
+		if(newProgress / 10 != currentProgress / 10) {
+			PrintMessage(wxString::Format("%s (%d%%)", progressText, newProgress));
+		}
+		currentProgress = newProgress;
+		return false;
+	}
+
 	bool skip = false;
 	if(progressBar) {
 		progressBar->Update(
@@ -1188,9 +1227,9 @@ bool GUI::SetLoadDone(int32_t done, const wxString& newMessage)
 
 void GUI::DestroyLoadBar()
 {
+	currentProgress = -1;
 	if(progressBar) {
 		progressBar->Show(false);
-		currentProgress = -1;
 
 		progressBar->Destroy();
 		progressBar = nullptr;
@@ -1382,9 +1421,17 @@ void GUI::ChangeFloor(int new_floor)
 
 void GUI::SetStatusText(wxString text)
 {
+	if(headless)
+		return;
+
 	g_gui.root->SetStatusText(text, 0);
 }
 
+void GUI::PrintMessage(const wxString& message) const
+{
+	std::cout << wxDateTime::Now().Format("[%H:%M:%S] ") << message << std::endl;
+}
+
 void GUI::SetTitle(wxString title)
 {
 	if(g_gui.root == nullptr)
@@ -1427,6 +1474,9 @@ void GUI::SetTitle(wxString title)
 
 void GUI::UpdateTitle()
 {
+	if(!tabbook)
+		return;
+
 	if(tabbook->GetTabCount() > 0) {
 		SetTitle(tabbook->GetCurrentTab()->GetTitle());
 		for(int idx = 0; idx < tabbook->GetTabCount(); ++idx) {
@@ -1440,6 +1490,9 @@ void GUI::UpdateTitle()
 
 void GUI::UpdateMenus()
 {
+	if(!root)
+		return;
+
 	wxCommandEvent evt(EVT_UPDATE_MENUS);
 	g_gui.root->AddPendingEvent(evt);
 }
@@ -1902,6 +1955,12 @@ long GUI::PopupDialog(wxWindow* parent, wxString title, wxString text, long styl
 	if(text.empty())
 		return wxID_ANY;
 
+	if(headless) {
+		// Nobody can answer, so questions are declined
+		PrintMessage(title + ": " + text);
+		return (style & wxYES) ? wxID_NO : wxID_OK;
+	}
+
 	wxMessageDialog dlg(parent, text, title, style);
 	return dlg.ShowModal();
 }
@@ -1916,6 +1975,14 @@ void GUI::ListDialog(wxWindow* parent, wxString title, const wxArrayString& para
 	if(param_items.empty())
 		return;
 
+	if(headless) {
+		PrintMessage(title + ":");
+		for(const wxString& item : param_items) {
+			PrintMessage("  " + item);
+		}
+		return;
+	}
+
 	wxArrayString list_items(param_items);
 
 	// Create the window
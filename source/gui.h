@@ -180,6 +180,11 @@ public:
 	void ShowToolbar(ToolBarID id, bool show);
 	void SetStatusText(wxString text);
 
+	// Without windows (dedicated live server) dialogs and progress are printed to stdout
+	void SetHeadless(bool enable) { headless = enable; }
+	bool IsHeadless() const { return headless; }
+	void PrintMessage(const wxString& message) const;
+
 	long PopupDialog(wxWindow* parent, wxString title, wxString text, long style, wxString configsavename = wxEmptyString, uint32_t configsavevalue = 0);
 	long PopupDialog(wxString title, wxString text, long style, wxString configsavename = wxEmptyString, uint32_t configsavevalue = 0);
 
@@ -277,6 +282,8 @@ public:
 	void SetScreenCenterPosition(Position pos);
 	// Refresh the view canvas
 	void RefreshView();
+	// Refresh only what is drawn on top of the map (live cursors)
+	void RefreshViewOverlay();
 	// Fit all/specified current map view to map dimensions
 	void FitViewToMap();
 	void FitViewToMap(MapTab* mt);
@@ -413,6 +420,7 @@ protected:
 
 	Hotkey hotkeys[10];
 	bool hotkeys_enabled;
+	bool headless;
 
 	//=========================================================================
 	// Internal brush data
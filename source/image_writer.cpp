@@ -0,0 +1,367 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "image_writer.h"
+#include "graphics.h"
+
+namespace
+{
+	// Deflated bytes collected before they are written out as one IDAT chunk
+	const size_t PNG_CHUNK_SIZE = 256 * 1024;
+
+	void putU32BE(uint8_t* out, uint32_t value)
+	{
+		out[0] = uint8_t(value >> 24);
+		out[1] = uint8_t(value >> 16);
+		out[2] = uint8_t(value >> 8);
+		out[3] = uint8_t(value);
+	}
+}
+
+ImageWriter::ImageWriter() :
+	width(0), height(0), rows_left(0), format(PIXEL_MINIMAP)
+{
+	////
+}
+
+ImageWriter::~ImageWriter()
+{
+	////
+}
+
+ImageWriter* ImageWriter::create(const std::string& extension)
+{
+	std::string lower = as_lower_str(extension);
+	if(lower == "png")
+		return newd PNGWriter;
+	if(lower == "bmp")
+		return newd BMPWriter;
+	return nullptr;
+}
+
+int ImageWriter::getBytesPerPixel(PixelFormat format)
+{
+	switch(format) {
+		case PIXEL_RGB: return 3;
+		case PIXEL_RGBA: return 4;
+		default: return 1;
+	}
+}
+
+bool BMPWriter::open(const std::string& path, int width, int height, PixelFormat format)
+{
+	if(!supports(format) || width <= 0 || height <= 0)
+		return false;
+
+	file.reset(newd FileWriteHandle(path));
+	if(!file->isOpen())
+		return false;
+
+	this->width = width;
+	this->height = height;
+	this->format = format;
+	rows_left = height;
+
+	// Rows are padded to four bytes
+	const uint32_t stride = (width + 3) & ~3;
+
+	file->addRAW("BM");
+	file->addU32(14 + 40 + 256 * 4 + stride * height); // File size
+	file->addU16(0); // Reserved
+	file->addU16(0);
+	file->addU32(14 + 40 + 256 * 4); // Pixel data offset
+
+	file->addU32(40); // Header size
+	file->addU32(width);
+	file->addU32(height);
+	file->addU16(1); // Colour planes
+	file->addU16(8); // Bits per pixel
+	file->addU32(0); // No compression
+	file->addU32(0); // Image size, may be 0 when uncompressed
+	file->addU32(4000); // Pixels per meter
+	file->addU32(4000);
+	file->addU32(256); // Palette size
+	file->addU32(0); // Important colours, 0 is all
+
+	for(int i = 0; i < 256; ++i)
+		file->addU32(uint32_t(minimap_color[i]));
+
+	return file->isOk();
+}
+
+bool BMPWriter::writeRow(const uint8_t* row)
+{
+	if(!file || rows_left == 0)
+		return false;
+
+	static const uint8_t padding[3] = { 0, 0, 0 };
+	file->addRAW(row, width);
+	if(width & 3)
+		file->addRAW(padding, 4 - (width & 3));
+
+	--rows_left;
+	return file->isOk();
+}
+
+bool BMPWriter::close()
+{
+	if(!file)
+		return false;
+
+	bool ok = rows_left == 0 && file->isOk();
+	file->close();
+	file.reset();
+	return ok;
+}
+
+PNGWriter::PNGWriter() :
+	stream_ready(false),
+	buffered(0),
+	adler(0)
+{
+	memset(&stream, 0, sizeof(stream));
+}
+
+PNGWriter::~PNGWriter()
+{
+	if(stream_ready)
+		deflateEnd(&stream);
+}
+
+bool PNGWriter::open(const std::string& path, int width, int height, PixelFormat format)
+{
+	if(width <= 0 || height <= 0)
+		return false;
+
+	file.reset(newd FileWriteHandle(path));
+	if(!file->isOpen())
+		return false;
+
+	this->width = width;
+	this->height = height;
+	this->format = format;
+	rows_left = height;
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file->addRAW(signature, sizeof(signature));
+
+	uint8_t header[13];
+	putU32BE(header, width);
+	putU32BE(header + 4, height);
+	header[8] = 8; // Bit depth
+	header[9] = format == PIXEL_MINIMAP ? 3 : (format == PIXEL_RGB ? 2 : 6); // Colour type
+	header[10] = 0; // Deflate
+	header[11] = 0; // Adaptive filtering, only "none" is used
+	header[12] = 0; // Not interlaced
+	if(!writeChunk("IHDR", header, sizeof(header)))
+		return false;
+
+	if(format == PIXEL_MINIMAP) {
+		uint8_t palette[256 * 3];
+		for(int i = 0; i < 256; ++i) {
+			palette[i * 3] = minimap_color[i].red;
+			palette[i * 3 + 1] = minimap_color[i].green;
+			palette[i * 3 + 2] = minimap_color[i].blue;
+		}
+		if(!writeChunk("PLTE", palette, sizeof(palette)))
+			return false;
+	}
+
+	if(stream_ready)
+		deflateEnd(&stream);
+	memset(&stream, 0, sizeof(stream));
+	stream_ready = deflateInit(&stream, Z_DEFAULT_COMPRESSION) == Z_OK;
+
+	buffer.resize(PNG_CHUNK_SIZE);
+	buffered = 0;
+	return stream_ready;
+}
+
+bool PNGWriter::writeRow(const uint8_t* row)
+{
+	if(!file || !stream_ready || rows_left == 0)
+		return false;
+	// Rows were already given by writeCompressedRows
+	if(rows_left != height && stream.total_in == 0)
+		return false;
+
+	// Every row starts with its filter type, 0 leaves it as is
+	static const uint8_t filter = 0;
+	if(!compress(&filter, 1, Z_NO_FLUSH))
+		return false;
+
+	--rows_left;
+	return compress(row, size_t(width) * getBytesPerPixel(format), rows_left == 0 ? Z_FINISH : Z_NO_FLUSH);
+}
+
+bool PNGWriter::close()
+{
+	if(!file)
+		return false;
+
+	bool ok = rows_left == 0 && stream_ready && writeChunk("IEND", nullptr, 0);
+	file->close();
+	file.reset();
+	return ok;
+}
+
+bool PNGWriter::compress(const uint8_t* data, size_t size, int flush)
+{
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = static_cast<uInt>(size);
+
+	while(true) {
+		stream.next_out = &buffer[buffered];
+		stream.avail_out = static_cast<uInt>(buffer.size() - buffered);
+
+		int result = deflate(&stream, flush);
+		if(result == Z_STREAM_ERROR)
+			return false;
+
+		buffered = buffer.size() - stream.avail_out;
+		if(buffered == buffer.size()) {
+			if(!writeChunk("IDAT", buffer.data(), buffered))
+				return false;
+			buffered = 0;
+			continue;
+		}
+
+		// Room left in the buffer, so deflate has taken all the input it was given
+		if(flush != Z_FINISH || result == Z_STREAM_END)
+			break;
+	}
+
+	if(flush == Z_FINISH && buffered > 0) {
+		if(!writeChunk("IDAT", buffer.data(), buffered))
+			return false;
+		buffered = 0;
+	}
+	return true;
+}
+
+bool PNGWriter::compressRows(const uint8_t* rows, int count, int width, PixelFormat format, CompressedRows& out)
+{
+	z_stream band;
+	memset(&band, 0, sizeof(band));
+	// A raw stream, the zlib header and checksum are written once for the whole image
+	if(deflateInit2(&band, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	const size_t row_size = size_t(width) * getBytesPerPixel(format);
+	out.length = (row_size + 1) * count;
+	out.rows = count;
+	out.adler = adler32(0L, Z_NULL, 0);
+	out.data.resize(deflateBound(&band, static_cast<uLong>(out.length)) + 16);
+	band.next_out = out.data.data();
+	band.avail_out = static_cast<uInt>(out.data.size());
+
+	static const uint8_t filter = 0;
+	bool ok = true;
+	for(int row = 0; row < count && ok; ++row) {
+		const uint8_t* pixels = rows + row * row_size;
+		out.adler = adler32(out.adler, &filter, 1);
+		out.adler = adler32(out.adler, pixels, static_cast<uInt>(row_size));
+
+		band.next_in = const_cast<Bytef*>(&filter);
+		band.avail_in = 1;
+		ok = deflate(&band, Z_NO_FLUSH) != Z_STREAM_ERROR;
+
+		band.next_in = const_cast<Bytef*>(pixels);
+		band.avail_in = static_cast<uInt>(row_size);
+		// A sync flush ends the band on a byte boundary without ending the stream
+		ok = ok && deflate(&band, row + 1 == count ? Z_SYNC_FLUSH : Z_NO_FLUSH) != Z_STREAM_ERROR && band.avail_in == 0;
+	}
+
+	out.data.resize(out.data.size() - band.avail_out);
+	deflateEnd(&band);
+	return ok;
+}
+
+bool PNGWriter::writeCompressedRows(const CompressedRows& rows)
+{
+	if(!file || rows.rows > rows_left || stream.total_in > 0)
+		return false;
+
+	if(rows_left == height) {
+		// zlib header: deflate with a 32K window, default compression
+		static const uint8_t header[2] = { 0x78, 0x9C };
+		if(!append(header, sizeof(header)))
+			return false;
+		adler = adler32(0L, Z_NULL, 0);
+	}
+
+	if(!append(rows.data.data(), rows.data.size()))
+		return false;
+	adler = adler32_combine(adler, rows.adler, static_cast<z_off_t>(rows.length));
+	rows_left -= rows.rows;
+
+	if(rows_left == 0) {
+		// An empty final block and the checksum of everything
+		uint8_t trailer[6] = { 0x03, 0x00 };
+		putU32BE(trailer + 2, adler);
+		if(!append(trailer, sizeof(trailer)) || !flushChunk())
+			return false;
+	}
+	return true;
+}
+
+bool PNGWriter::append(const uint8_t* data, size_t size)
+{
+	while(size > 0) {
+		const size_t count = std::min(size, buffer.size() - buffered);
+		memcpy(&buffer[buffered], data, count);
+		buffered += count;
+		data += count;
+		size -= count;
+
+		if(buffered == buffer.size() && !flushChunk())
+			return false;
+	}
+	return true;
+}
+
+bool PNGWriter::flushChunk()
+{
+	if(buffered == 0)
+		return true;
+
+	if(!writeChunk("IDAT", buffer.data(), buffered))
+		return false;
+	buffered = 0;
+	return true;
+}
+
+bool PNGWriter::writeChunk(const char* type, const uint8_t* data, size_t size)
+{
+	uint8_t length[4];
+	putU32BE(length, static_cast<uint32_t>(size));
+	file->addRAW(length, 4);
+	file->addRAW(reinterpret_cast<const uint8_t*>(type), 4);
+	if(size > 0)
+		file->addRAW(data, size);
+
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+	if(size > 0)
+		crc = crc32(crc, data, static_cast<uInt>(size));
+
+	uint8_t checksum[4];
+	putU32BE(checksum, static_cast<uint32_t>(crc));
+	file->addRAW(checksum, 4);
+	return file->isOk();
+}
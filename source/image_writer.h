@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_IMAGE_WRITER_H_
+#define RME_IMAGE_WRITER_H_
+
+#include "filehandle.h"
+
+#include <zlib.h>
+#include <memory>
+#include <vector>
+
+// Writes an image to disk a row at a time, so exports never need the whole
+// image in memory. Rows are passed in the order isBottomUp asks for.
+class ImageWriter
+{
+public:
+	enum PixelFormat {
+		PIXEL_MINIMAP, // One byte per pixel, an index into minimap_color
+		PIXEL_RGB,
+		PIXEL_RGBA,
+	};
+
+	ImageWriter();
+	virtual ~ImageWriter();
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	// Picks the writer for a file extension ("png" or "bmp"), nullptr if there is none
+	static ImageWriter* create(const std::string& extension);
+
+	virtual bool open(const std::string& path, int width, int height, PixelFormat format) = 0;
+	virtual bool writeRow(const uint8_t* row) = 0;
+	virtual bool close() = 0;
+	virtual bool isBottomUp() const { return false; }
+	virtual bool supports(PixelFormat format) const = 0;
+
+	static int getBytesPerPixel(PixelFormat format);
+
+protected:
+	std::unique_ptr<FileWriteHandle> file;
+	int width;
+	int height;
+	int rows_left;
+	PixelFormat format;
+};
+
+// 8-bit minimap BMPs, in the layout Map::exportMinimap always wrote
+class BMPWriter : public ImageWriter
+{
+public:
+	bool open(const std::string& path, int width, int height, PixelFormat format);
+	bool writeRow(const uint8_t* row);
+	bool close();
+	bool isBottomUp() const { return true; }
+	bool supports(PixelFormat format) const { return format == PIXEL_MINIMAP; }
+};
+
+// PNGs deflated on the fly, each filled output buffer goes out as an IDAT chunk
+class PNGWriter : public ImageWriter
+{
+public:
+	PNGWriter();
+	~PNGWriter();
+
+	bool open(const std::string& path, int width, int height, PixelFormat format);
+	bool writeRow(const uint8_t* row);
+	bool close();
+	bool supports(PixelFormat format) const { return true; }
+
+	// Rows deflated apart from the writer, so bands can be compressed on
+	// several threads. Each ends on a byte boundary and they are joined in order.
+	struct CompressedRows {
+		std::vector<uint8_t> data;
+		uint32_t adler;
+		size_t length;
+		int rows;
+	};
+	static bool compressRows(const uint8_t* rows, int count, int width, PixelFormat format, CompressedRows& out);
+	// Either this or writeRow is used for a whole image
+	bool writeCompressedRows(const CompressedRows& rows);
+
+protected:
+	bool writeChunk(const char* type, const uint8_t* data, size_t size);
+	bool compress(const uint8_t* data, size_t size, int flush);
+	// Adds deflated bytes, writing an IDAT chunk whenever the buffer fills up
+	bool append(const uint8_t* data, size_t size);
+	bool flushChunk();
+
+	z_stream stream;
+	bool stream_ready;
+	std::vector<uint8_t> buffer;
+	size_t buffered;
+	uint32_t adler;
+};
+
+#endif
@@ -874,6 +874,7 @@ bool IOMapOTBM::loadMap(Map& map, NodeFileReadHandle& f)
 						house->addTile(tile);
 
 					map.setTile(pos.x, pos.y, pos.z, tile);
+					map.statistics.addTile(tile);
 				} else {
 					warning("Unknown type of tile node");
 				}
@@ -1023,8 +1024,10 @@ bool IOMapOTBM::loadSpawnsMonster(Map& map, pugi::xml_document& doc)
 			map.setTile(spawnPosition, tile);
 		}
 
+		map.statistics.removeTile(tile);
 		tile->spawnMonster = spawnMonster;
 		map.addSpawnMonster(tile);
+		map.statistics.addTile(tile);
 
 		for(pugi::xml_node monsterNode = spawnNode.first_child(); monsterNode; monsterNode = monsterNode.next_sibling()) {
 			const std::string& monsterNodeName = as_lower_str(monsterNode.name());
@@ -1098,6 +1101,7 @@ bool IOMapOTBM::loadSpawnsMonster(Map& map, pugi::xml_document& doc)
 			Monster* monster = newd Monster(type);
 			monster->setDirection(direction);
 			monster->setSpawnMonsterTime(spawntime);
+			map.statistics.removeTile(monsterTile);
 			monsterTile->monster = monster;
 
 			if(monsterTile->getLocation()->getSpawnMonsterCount() == 0) {
@@ -1107,6 +1111,7 @@ bool IOMapOTBM::loadSpawnsMonster(Map& map, pugi::xml_document& doc)
 				monsterTile->spawnMonster = spawnMonster;
 				map.addSpawnMonster(monsterTile);
 			}
+			map.statistics.addTile(monsterTile);
 		}
 	}
 	return true;
@@ -1241,8 +1246,10 @@ bool IOMapOTBM::loadSpawnsNpc(Map& map, pugi::xml_document& doc)
 			map.setTile(spawnPosition, spawnTile);
 		}
 
+		map.statistics.removeTile(spawnTile);
 		spawnTile->spawnNpc = spawnNpc;
 		map.addSpawnNpc(spawnTile);
+		map.statistics.addTile(spawnTile);
 
 		for(pugi::xml_node npcNode = spawnNpcNode.first_child(); npcNode; npcNode = npcNode.next_sibling()) {
 			const std::string& npcNodeName = as_lower_str(npcNode.name());
@@ -1316,6 +1323,7 @@ bool IOMapOTBM::loadSpawnsNpc(Map& map, pugi::xml_document& doc)
 			Npc* npc = newd Npc(type);
 			npc->setDirection(direction);
 			npc->setSpawnNpcTime(spawntime);
+			map.statistics.removeTile(npcTile);
 			npcTile->npc = npc;
 
 			if(npcTile->getLocation()->getSpawnNpcCount() == 0) {
@@ -1325,6 +1333,7 @@ bool IOMapOTBM::loadSpawnsNpc(Map& map, pugi::xml_document& doc)
 				npcTile->spawnNpc = spawnNpc;
 				map.addSpawnNpc(npcTile);
 			}
+			map.statistics.addTile(npcTile);
 		}
 	}
 	return true;
@@ -515,6 +515,7 @@ bool IOMapOTMM::loadMap(Map& map, NodeFileReadHandle& f, const FileName& identif
 						house->addTile(tile);
 					}
 					map.setTile(pos, tile);
+					map.statistics.addTile(tile);
 				} while(tileNode->advance());
 			} break;
 			case OTMM_SPAWN_MONSTER_DATA: {
@@ -564,8 +565,10 @@ bool IOMapOTMM::loadMap(Map& map, NodeFileReadHandle& f, const FileName& identif
 						spawnMonsterTile = map.allocator(spawnPos);
 						map.setTile(spawnPos, spawnMonsterTile);
 					}
+					map.statistics.removeTile(spawnMonsterTile);
 					spawnMonsterTile->spawnMonster = spawnMonster;
 					map.addSpawnMonster(spawnMonsterTile);
+					map.statistics.addTile(spawnMonsterTile);
 
 					// Read any monsters associated with the spawnMonster
 					BinaryNode* monsterNode = spawnMonsterNode->getChild();
@@ -629,6 +632,7 @@ bool IOMapOTMM::loadMap(Map& map, NodeFileReadHandle& f, const FileName& identif
 						}
 						Monster* monster = newd Monster(type);
 						monster->setSpawnMonsterTime(spawntime);
+						map.statistics.removeTile(monster_tile);
 						monster_tile->monster = monster;
 						if(monster_tile->spawn_monster_count == 0) {
 							// No monster spawn, create a newd one (this happends if the radius of the monster spawn has been decreased due to g_settings)
@@ -637,6 +641,7 @@ bool IOMapOTMM::loadMap(Map& map, NodeFileReadHandle& f, const FileName& identif
 							monster_tile->spawnMonster = spawnMonster;
 							map.addSpawnMonster(monster_tile);
 						}
+						map.statistics.addTile(monster_tile);
 					} while(monsterNode->advance());
 				} while(spawnMonsterNode->advance());
 			} break;
@@ -687,8 +692,10 @@ bool IOMapOTMM::loadMap(Map& map, NodeFileReadHandle& f, const FileName& identif
 						spawnNpcTile = map.allocator(spawnNpcPos);
 						map.setTile(spawnNpcPos, spawnNpcTile);
 					}
+					map.statistics.removeTile(spawnNpcTile);
 					spawnNpcTile->spawnNpc = spawnNpc;
 					map.addSpawnNpc(spawnNpcTile);
+					map.statistics.addTile(spawnNpcTile);
 
 					// Read any npc associated with the npc spawn
 					BinaryNode* npcNode = spawnNpcNode->getChild();
@@ -748,6 +755,7 @@ bool IOMapOTMM::loadMap(Map& map, NodeFileReadHandle& f, const FileName& identif
 						}
 						Npc* npc = newd Npc(type);
 						npc->setSpawnNpcTime(spawntime);
+						map.statistics.removeTile(npcTile);
 						npcTile->npc = npc;
 						if(npcTile->spawn_npc_count == 0) {
 							// No npc spawn, create a newd one (this happends if the radius of the npc spawn has been decreased due to g_settings)
@@ -756,6 +764,7 @@ bool IOMapOTMM::loadMap(Map& map, NodeFileReadHandle& f, const FileName& identif
 							npcTile->spawnNpc = spawnNpc;
 							map.addSpawnNpc(npcTile);
 						}
+						map.statistics.addTile(npcTile);
 					} while(npcNode->advance());
 				} while(spawnNpcNode->advance());
 			} break;
@@ -0,0 +1,644 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "live_bench.h"
+#include "iomap_otbm.h"
+#include "gui.h"
+
+#include <csignal>
+
+#ifdef __LINUX__
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Tiles a simulated screen shows
+	const int32_t BENCH_VIEW_WIDTH = 32;
+	const int32_t BENCH_VIEW_HEIGHT = 24;
+
+	volatile std::sig_atomic_t stopRequested = 0;
+
+	void requestStop(int)
+	{
+		stopRequested = 1;
+	}
+
+	// CPU seconds a process has used so far, negative if unknown
+	double getProcessTime(long pid)
+	{
+#ifdef __LINUX__
+		std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+		std::string stat;
+		std::getline(file, stat);
+
+		// The command name may contain spaces, so fields are counted after it
+		const size_t end = stat.rfind(')');
+		if(end == std::string::npos) {
+			return -1.0;
+		}
+
+		std::istringstream fields(stat.substr(end + 1));
+		std::string field;
+		unsigned long long ticks = 0;
+		for(int32_t index = 3; index <= 15 && fields >> field; ++index) {
+			if(index >= 14) {
+				ticks += std::stoull(field);
+			}
+		}
+		return static_cast<double>(ticks) / sysconf(_SC_CLK_TCK);
+#else
+		return -1.0;
+#endif
+	}
+}
+
+LiveBenchClient::LiveBenchClient(LiveBenchmark& benchmark, boost::asio::io_service& service, uint32_t index, uint32_t seed) : LiveSocket(),
+	random(seed), viewport(), brush(),
+	benchmark(benchmark), socket(service), strand(service), readMessage(),
+	index(index), bytesSent(0), bytesReceived(0), connected(false), started(false)
+{
+	name = wxString::Format("bench-%u", index);
+}
+
+LiveBenchClient::~LiveBenchClient()
+{
+	//
+}
+
+bool LiveBenchClient::connect(const boost::asio::ip::tcp::endpoint& endpoint, const wxString& newPassword, uint8_t compression)
+{
+	boost::system::error_code error;
+	socket.connect(endpoint, error);
+	if(error) {
+		setLastError("Could not connect: " + error.message());
+		return false;
+	}
+	socket.set_option(boost::asio::ip::tcp::no_delay(true), error);
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_HELLO_FROM_CLIENT);
+	message.write<uint32_t>(__RME_VERSION_ID__);
+	message.write<uint32_t>(__LIVE_NET_VERSION__);
+	// No data files are loaded, the server answers with its own version
+	message.write<uint32_t>(CLIENT_VERSION_NONE);
+	message.write<std::string>(nstr(name));
+	message.write<std::string>(nstr(newPassword));
+	message.write<uint8_t>(compression);
+	send(message);
+
+	// Cursors of people already mapping may arrive in between
+	bool ready = false;
+	while(true) {
+		if(!readBlocking(message)) {
+			setLastError("Connection closed during login, wrong password?");
+			return false;
+		}
+
+		const uint8_t packetType = message.read<uint8_t>();
+		if(packetType == PACKET_KICK) {
+			setLastError("Kicked: " + wxstr(message.read<std::string>()));
+			return false;
+		} else if(!ready && (packetType == PACKET_ACCEPTED_CLIENT || packetType == PACKET_CHANGE_CLIENT_VERSION)) {
+			message.clear();
+			message.write<uint8_t>(PACKET_READY_CLIENT);
+			send(message);
+			ready = true;
+		} else if(ready && packetType == PACKET_HELLO_FROM_SERVER) {
+			message.read<std::string>();
+			message.read<uint16_t>();
+			message.read<uint16_t>();
+			compressionEnabled = message.read<uint8_t>() != LIVE_COMPRESSION_NONE;
+			break;
+		}
+	}
+
+	connected = true;
+	return true;
+}
+
+void LiveBenchClient::close()
+{
+	connected = false;
+	strand.post([this]() {
+		boost::system::error_code error;
+		socket.close(error);
+	});
+}
+
+bool LiveBenchClient::writeBlocking(const NetworkMessage& message)
+{
+	boost::system::error_code error;
+	boost::asio::write(socket, boost::asio::buffer(&message.buffer[0], message.size + 4), error);
+	return !error;
+}
+
+bool LiveBenchClient::readBlocking(NetworkMessage& message)
+{
+	boost::system::error_code error;
+	message.buffer.resize(4);
+	boost::asio::read(socket, boost::asio::buffer(&message.buffer[0], 4), error);
+	if(error) {
+		return false;
+	}
+
+	uint32_t header;
+	memcpy(&header, &message.buffer[0], 4);
+
+	const uint32_t packetSize = header & ~NETWORK_MESSAGE_COMPRESSED;
+	message.buffer.resize(packetSize + 4);
+	boost::asio::read(socket, boost::asio::buffer(&message.buffer[4], packetSize), error);
+	if(error) {
+		return false;
+	}
+
+	bytesReceived += packetSize + 4;
+	message.position = 4;
+	message.size = packetSize;
+	return !(header & NETWORK_MESSAGE_COMPRESSED) || compressor.decompress(message);
+}
+
+void LiveBenchClient::receiveHeader()
+{
+	started = true;
+	readMessage.buffer.resize(4);
+	boost::asio::async_read(socket, boost::asio::buffer(&readMessage.buffer[0], 4), strand.wrap(
+		[this](const boost::system::error_code& error, size_t) -> void {
+			if(error) {
+				connected = false;
+				return;
+			}
+
+			uint32_t header;
+			memcpy(&header, &readMessage.buffer[0], 4);
+			receive(header);
+		}
+	));
+}
+
+void LiveBenchClient::receive(uint32_t header)
+{
+	const uint32_t packetSize = header & ~NETWORK_MESSAGE_COMPRESSED;
+	readMessage.buffer.resize(packetSize + 4);
+	boost::asio::async_read(socket, boost::asio::buffer(&readMessage.buffer[4], packetSize), strand.wrap(
+		[this, header, packetSize](const boost::system::error_code& error, size_t) -> void {
+			if(error) {
+				connected = false;
+				return;
+			}
+
+			bytesReceived += packetSize + 4;
+			readMessage.position = 4;
+			readMessage.size = packetSize;
+			if((header & NETWORK_MESSAGE_COMPRESSED) && !compressor.decompress(readMessage)) {
+				connected = false;
+				return;
+			}
+
+			parsePacket(readMessage);
+			receiveHeader();
+		}
+	));
+}
+
+void LiveBenchClient::parsePacket(NetworkMessage& message)
+{
+	// Only the first packet matters, PACKET_TILES and PACKET_NODE always come alone
+	const uint8_t packetType = message.read<uint8_t>();
+	if(packetType == PACKET_TILES) {
+		benchmark.onTiles(*this, message.read<uint32_t>(), message.size);
+	} else if(packetType == PACKET_NODE) {
+		benchmark.onNode(message.read<uint32_t>(), message.size);
+	} else if(packetType == PACKET_KICK) {
+		connected = false;
+	}
+}
+
+void LiveBenchClient::send(NetworkMessage& message)
+{
+	SharedNetworkMessage prepared = prepareMessage(message, compressionEnabled);
+	bytesSent += prepared->size + 4;
+	if(!started) {
+		writeBlocking(*prepared);
+		return;
+	}
+
+	strand.post([this, prepared]() {
+		if(!writeBlocking(*prepared)) {
+			connected = false;
+		}
+	});
+}
+
+void LiveBenchClient::updateCursor(const Position& position)
+{
+	LiveCursor cursor;
+	cursor.id = 0; // The server fills in our id
+	cursor.pos = position;
+	cursor.color = wxColor(static_cast<uint8_t>(index * 47), static_cast<uint8_t>(index * 89), static_cast<uint8_t>(index * 131));
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_CLIENT_UPDATE_CURSOR);
+	writeCursor(message, cursor);
+	send(message);
+}
+
+void LiveBenchClient::updateViewport(const LiveViewport& newViewport)
+{
+	viewport = newViewport;
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_CLIENT_UPDATE_VIEWPORT);
+	writeViewport(message, viewport);
+	send(message);
+}
+
+void LiveBenchClient::sendStroke(const std::vector<Position>& positions, uint16_t itemId)
+{
+	// Same stream LiveClient::sendChanges builds from real tiles
+	mapWriter.reset();
+	for(const Position& position : positions) {
+		mapWriter.addNode(OTBM_TILE);
+		mapWriter.addU16(position.x);
+		mapWriter.addU16(position.y);
+		mapWriter.addU8(position.z);
+		mapWriter.addByte(OTBM_ATTR_ITEM);
+		mapWriter.addU16(itemId);
+		mapWriter.endNode();
+
+		benchmark.onEdit(*this, ((position.x >> 2) << 18) | ((position.y >> 2) << 4) | (position.z > GROUND_LAYER ? 1 : 0));
+	}
+	mapWriter.endNode();
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_CHANGE_LIST);
+
+	message.writeSpan(mapWriter.getMemory(), mapWriter.getSize());
+	send(message);
+}
+
+void LiveBenchClient::requestNodes(const std::vector<uint32_t>& nodes)
+{
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_REQUEST_NODES);
+
+	message.write<uint32_t>(nodes.size());
+	for(uint32_t node : nodes) {
+		message.write<uint32_t>(node);
+	}
+	send(message);
+}
+
+LiveBenchmark::LiveBenchmark() :
+	service(), editCount(0),
+	host("127.0.0.1"), password(), port(31313),
+	clientCount(8), duration(30), interval(100),
+	areaX(1000), areaY(1000), areaWidth(64), areaHeight(64), areaFloor(GROUND_LAYER),
+	itemId(4526), seed(0), serverPid(0), compression(LIVE_COMPRESSION_ZLIB)
+{
+	//
+}
+
+LiveBenchmark::~LiveBenchmark()
+{
+	service.stop();
+	for(std::thread& thread : threads) {
+		thread.join();
+	}
+	clients.clear();
+}
+
+bool LiveBenchmark::IsRequested(const wxArrayString& arguments)
+{
+	return arguments.Index("--live-bench") != wxNOT_FOUND;
+}
+
+bool LiveBenchmark::ParseArguments(const wxArrayString& arguments)
+{
+	for(size_t index = 1; index < arguments.size(); ++index) {
+		const wxString& argument = arguments[index];
+		if(argument == "--live-bench") {
+			continue;
+		}
+
+		if(index + 1 == arguments.size()) {
+			g_gui.PrintMessage("Missing value for \"" + argument + "\".");
+			return false;
+		}
+
+		const wxString& value = arguments[++index];
+		bool valid = true;
+		if(argument == "--host") {
+			host = value;
+		} else if(argument == "--port") {
+			valid = value.ToLong(&port);
+		} else if(argument == "--password") {
+			password = value;
+		} else if(argument == "--clients") {
+			valid = value.ToLong(&clientCount) && clientCount > 0;
+		} else if(argument == "--duration") {
+			valid = value.ToLong(&duration) && duration > 0;
+		} else if(argument == "--interval") {
+			valid = value.ToLong(&interval) && interval > 0;
+		} else if(argument == "--area") {
+			wxArrayString parts = wxSplit(value, ',');
+			valid = parts.size() == 5 &&
+				parts[0].ToLong(&areaX) && parts[1].ToLong(&areaY) &&
+				parts[2].ToLong(&areaWidth) && parts[3].ToLong(&areaHeight) &&
+				parts[4].ToLong(&areaFloor) &&
+				areaWidth > 0 && areaHeight > 0 && areaFloor >= 0 && areaFloor <= MAP_MAX_LAYER;
+		} else if(argument == "--item") {
+			valid = value.ToLong(&itemId) && itemId > 0 && itemId <= 0xFFFF;
+		} else if(argument == "--seed") {
+			valid = value.ToLong(&seed);
+		} else if(argument == "--server-pid") {
+			valid = value.ToLong(&serverPid);
+		} else if(argument == "--compression") {
+			valid = value == "zlib" || value == "none";
+			compression = value == "zlib" ? LIVE_COMPRESSION_ZLIB : LIVE_COMPRESSION_NONE;
+		} else {
+			g_gui.PrintMessage("Unknown argument \"" + argument + "\".");
+			return false;
+		}
+
+		if(!valid) {
+			g_gui.PrintMessage("Invalid value \"" + value + "\" for \"" + argument + "\".");
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LiveBenchmark::Run(const wxArrayString& arguments)
+{
+	g_gui.SetHeadless(true);
+	if(!ParseArguments(arguments)) {
+		g_gui.PrintMessage("Usage: rme --live-bench [--host H] [--port N] [--password P] [--clients N] [--duration seconds] [--interval ms] [--area x,y,width,height,floor] [--item id] [--seed N] [--server-pid PID] [--compression zlib|none]");
+		return false;
+	}
+
+	boost::system::error_code error;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(nstr(host), error), port);
+	if(error) {
+		g_gui.PrintMessage("Invalid host \"" + host + "\", use an IP address.");
+		return false;
+	}
+
+	for(long index = 0; index < clientCount; ++index) {
+		std::unique_ptr<LiveBenchClient> client(newd LiveBenchClient(*this, service, index, seed + index));
+		if(!client->connect(endpoint, password, compression)) {
+			g_gui.PrintMessage(wxString::Format("Client %ld: ", index) + client->getLastError());
+			return false;
+		}
+
+		std::uniform_int_distribution<int32_t> x(areaX, areaX + areaWidth - 1);
+		std::uniform_int_distribution<int32_t> y(areaY, areaY + areaHeight - 1);
+		client->brush = Position(x(client->random), y(client->random), areaFloor);
+		client->receiveHeader();
+		clients.push_back(std::move(client));
+	}
+	g_gui.PrintMessage(wxString::Format("%ld clients connected to %s:%ld.", clientCount, host, port));
+
+	const uint32_t threadCount = std::max<uint32_t>(2, std::thread::hardware_concurrency());
+	for(uint32_t index = 0; index < threadCount; ++index) {
+		threads.emplace_back([this]() { service.run(); });
+	}
+
+	for(auto& client : clients) {
+		Pan(*client);
+	}
+
+	std::signal(SIGINT, requestStop);
+	const double serverStart = serverPid > 0 ? getProcessTime(serverPid) : -1.0;
+	const Clock::time_point start = Clock::now();
+	const Clock::time_point end = start + std::chrono::seconds(duration);
+
+	Clock::time_point next = start;
+	while(next < end && !stopRequested) {
+		for(auto& client : clients) {
+			if(client->isConnected()) {
+				Step(*client);
+			}
+		}
+		next += std::chrono::milliseconds(interval);
+		std::this_thread::sleep_until(next);
+	}
+
+	// Give the last broadcasts a moment to arrive
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	const double serverEnd = serverPid > 0 ? getProcessTime(serverPid) : -1.0;
+	RequestBroadcastNodes();
+	PrintReport(seconds, serverStart >= 0 && serverEnd >= 0 ? serverEnd - serverStart : -1.0);
+
+	for(auto& client : clients) {
+		client->close();
+	}
+	return true;
+}
+
+void LiveBenchmark::Step(LiveBenchClient& client)
+{
+	std::uniform_int_distribution<int32_t> roll(0, 99);
+	const int32_t action = roll(client.random);
+	if(action < 10) {
+		Pan(client);
+		return;
+	}
+
+	if(action < 40) {
+		std::uniform_int_distribution<int32_t> x(client.viewport.startX, client.viewport.endX);
+		std::uniform_int_distribution<int32_t> y(client.viewport.startY, client.viewport.endY);
+		client.updateCursor(Position(x(client.random), y(client.random), areaFloor));
+		return;
+	}
+
+	// A short straight stroke, the cursor follows the brush
+	std::uniform_int_distribution<int32_t> length(3, 8);
+	std::uniform_int_distribution<int32_t> direction(0, 3);
+	const int32_t dx[] = { 1, -1, 0, 0 };
+	const int32_t dy[] = { 0, 0, 1, -1 };
+
+	const int32_t way = direction(client.random);
+	std::vector<Position> positions;
+	Position& brush = client.brush;
+	for(int32_t step = length(client.random); step > 0; --step) {
+		brush.x = std::max<int32_t>(areaX, std::min<int32_t>(areaX + areaWidth - 1, brush.x + dx[way]));
+		brush.y = std::max<int32_t>(areaY, std::min<int32_t>(areaY + areaHeight - 1, brush.y + dy[way]));
+		positions.push_back(brush);
+	}
+
+	client.sendStroke(positions, itemId);
+	client.updateCursor(brush);
+}
+
+void LiveBenchmark::Pan(LiveBenchClient& client)
+{
+	std::uniform_int_distribution<int32_t> x(areaX, std::max<int32_t>(areaX, areaX + areaWidth - BENCH_VIEW_WIDTH));
+	std::uniform_int_distribution<int32_t> y(areaY, std::max<int32_t>(areaY, areaY + areaHeight - BENCH_VIEW_HEIGHT));
+
+	LiveViewport viewport;
+	viewport.startX = x(client.random);
+	viewport.startY = y(client.random);
+	viewport.endX = viewport.startX + BENCH_VIEW_WIDTH - 1;
+	viewport.endY = viewport.startY + BENCH_VIEW_HEIGHT - 1;
+	viewport.floor = areaFloor;
+	client.updateViewport(viewport);
+}
+
+void LiveBenchmark::RequestBroadcastNodes()
+{
+	LiveBenchClient* requester = nullptr;
+	for(auto& client : clients) {
+		if(client->isConnected()) {
+			requester = client.get();
+			break;
+		}
+	}
+
+	std::vector<uint32_t> nodes;
+	{
+		std::lock_guard<std::mutex> lock(editMutex);
+		for(auto& entry : nodeBytes) {
+			nodes.push_back(entry.first);
+		}
+	}
+	if(!requester || nodes.empty()) {
+		return;
+	}
+
+	// The nodes hold the last edits by now, close enough since every stroke
+	// paints the same item
+	const size_t batchSize = 256;
+	for(size_t first = 0; first < nodes.size(); first += batchSize) {
+		const size_t last = std::min(nodes.size(), first + batchSize);
+		requester->requestNodes(std::vector<uint32_t>(nodes.begin() + first, nodes.begin() + last));
+	}
+
+	const Clock::time_point timeout = Clock::now() + std::chrono::seconds(5);
+	while(Clock::now() < timeout && requester->isConnected()) {
+		{
+			std::lock_guard<std::mutex> lock(editMutex);
+			bool complete = true;
+			for(auto& entry : nodeBytes) {
+				if(entry.second.node == 0) {
+					complete = false;
+					break;
+				}
+			}
+			if(complete) {
+				return;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+void LiveBenchmark::onEdit(const LiveBenchClient& client, uint32_t ind)
+{
+	std::lock_guard<std::mutex> lock(editMutex);
+	edits[ind] = Edit { Clock::now(), client.getIndex() };
+	++editCount;
+}
+
+void LiveBenchmark::onTiles(const LiveBenchClient& client, uint32_t ind, size_t size)
+{
+	const Clock::time_point now = Clock::now();
+
+	std::lock_guard<std::mutex> lock(editMutex);
+	NodeBytes& bytes = nodeBytes[ind];
+	++bytes.broadcasts;
+	bytes.tiles += size;
+
+	auto it = edits.find(ind);
+	if(it == edits.end() || it->second.client == client.getIndex()) {
+		return;
+	}
+	latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - it->second.time).count());
+}
+
+void LiveBenchmark::onNode(uint32_t ind, size_t size)
+{
+	std::lock_guard<std::mutex> lock(editMutex);
+	auto it = nodeBytes.find(ind);
+	if(it != nodeBytes.end()) {
+		it->second.node = size;
+	}
+}
+
+void LiveBenchmark::PrintReport(double seconds, double serverSeconds)
+{
+	std::lock_guard<std::mutex> lock(editMutex);
+
+	size_t dropped = 0;
+	uint64_t sent = 0, received = 0, maxReceived = 0;
+	for(auto& client : clients) {
+		sent += client->getBytesSent();
+		received += client->getBytesReceived();
+		maxReceived = std::max<uint64_t>(maxReceived, client->getBytesReceived());
+		if(!client->isConnected()) {
+			++dropped;
+		}
+	}
+
+	g_gui.PrintMessage(wxString::Format("Ran %.1fs with %d clients, %d of them were dropped.",
+		seconds, static_cast<int>(clients.size()), static_cast<int>(dropped)));
+	g_gui.PrintMessage(wxString::Format("Edited %llu tiles (%.1f/s), %d broadcasts matched an edit.",
+		static_cast<unsigned long long>(editCount), editCount / seconds, static_cast<int>(latencies.size())));
+
+	if(!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [this](double fraction) -> double {
+			const size_t index = std::min<size_t>(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+			return latencies[index] / 1000.0;
+		};
+		g_gui.PrintMessage(wxString::Format("Edit to broadcast: p50 %.2fms, p90 %.2fms, p99 %.2fms, max %.2fms.",
+			percentile(0.5), percentile(0.9), percentile(0.99), latencies.back() / 1000.0));
+	}
+
+	// Only nodes that came back whole are compared, every broadcast of them
+	// would have been a PACKET_NODE before
+	uint64_t broadcasts = 0, tilesBytes = 0, nodesBytes = 0;
+	for(auto& entry : nodeBytes) {
+		const NodeBytes& bytes = entry.second;
+		if(bytes.node != 0) {
+			broadcasts += bytes.broadcasts;
+			tilesBytes += bytes.tiles;
+			nodesBytes += bytes.broadcasts * bytes.node;
+		}
+	}
+	if(broadcasts != 0) {
+		g_gui.PrintMessage(wxString::Format("Payload per broadcast over %llu broadcasts: PACKET_TILES %.1f bytes, PACKET_NODE %.1f bytes (%.1f%%).",
+			static_cast<unsigned long long>(broadcasts), static_cast<double>(tilesBytes) / broadcasts,
+			static_cast<double>(nodesBytes) / broadcasts, 100.0 * tilesBytes / nodesBytes));
+	} else if(!nodeBytes.empty()) {
+		g_gui.PrintMessage("Payload per broadcast: no node came back to compare with.");
+	}
+
+	const double perClient = 1024.0 * seconds * clients.size();
+	g_gui.PrintMessage(wxString::Format("Per client: %.1f KiB/s received (max %.1f KiB/s), %.1f KiB/s sent.",
+		received / perClient, maxReceived / (1024.0 * seconds), sent / perClient));
+
+	if(serverSeconds >= 0) {
+		g_gui.PrintMessage(wxString::Format("Server CPU: %.1f%% of one core.", 100.0 * serverSeconds / seconds));
+	} else if(serverPid > 0) {
+		g_gui.PrintMessage("Server CPU: not available on this platform.");
+	}
+}
@@ -0,0 +1,147 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _RME_LIVE_BENCH_H_
+#define _RME_LIVE_BENCH_H_
+
+#include "live_socket.h"
+
+#include <random>
+#include <chrono>
+
+class LiveBenchmark;
+
+// A scripted client speaking the live protocol, it keeps no map of its own
+class LiveBenchClient : public LiveSocket
+{
+	public:
+		LiveBenchClient(LiveBenchmark& benchmark, boost::asio::io_service& service, uint32_t index, uint32_t seed);
+		~LiveBenchClient();
+
+		// Blocking login, done before the network threads are started
+		bool connect(const boost::asio::ip::tcp::endpoint& endpoint, const wxString& password, uint8_t compression);
+		void close();
+
+		void receiveHeader();
+		void receive(uint32_t packetSize);
+		void send(NetworkMessage& message);
+
+		void updateCursor(const Position& position);
+		void updateViewport(const LiveViewport& viewport);
+		// Paints itemId as the ground of every position
+		void sendStroke(const std::vector<Position>& positions, uint16_t itemId);
+		void requestNodes(const std::vector<uint32_t>& nodes);
+
+		bool isConnected() const { return connected; }
+		uint32_t getIndex() const { return index; }
+		uint64_t getBytesSent() const { return bytesSent; }
+		uint64_t getBytesReceived() const { return bytesReceived; }
+
+		std::mt19937 random;
+		LiveViewport viewport;
+		Position brush;
+
+	protected:
+		bool writeBlocking(const NetworkMessage& message);
+		bool readBlocking(NetworkMessage& message);
+		void parsePacket(NetworkMessage& message);
+
+		LiveBenchmark& benchmark;
+		boost::asio::ip::tcp::socket socket;
+		boost::asio::io_service::strand strand;
+		NetworkMessage readMessage;
+
+		uint32_t index;
+		std::atomic<uint64_t> bytesSent;
+		std::atomic<uint64_t> bytesReceived;
+		std::atomic<bool> connected;
+		bool started;
+};
+
+// Load generator for a live server, started with
+//   rme --live-bench [--host H] [--port N] [--password P] [--clients N]
+//       [--duration seconds] [--interval ms] [--area x,y,width,height,floor]
+//       [--item id] [--seed N] [--server-pid PID] [--compression zlib|none]
+// Every client paints strokes, moves its cursor and pans its viewport inside
+// the area. Tiles broadcast to the other clients are matched with the edit
+// of their node to measure edit-to-broadcast latency. After the run the
+// broadcast nodes are requested whole, to compare the PACKET_TILES payload
+// of the edits with what PACKET_NODE would have cost for them.
+class LiveBenchmark
+{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		LiveBenchmark();
+		~LiveBenchmark();
+
+		static bool IsRequested(const wxArrayString& arguments);
+
+		// Runs the whole session and prints the report, false if it couldn't start
+		bool Run(const wxArrayString& arguments);
+
+		// Network threads
+		void onEdit(const LiveBenchClient& client, uint32_t ind);
+		void onTiles(const LiveBenchClient& client, uint32_t ind, size_t size);
+		void onNode(uint32_t ind, size_t size);
+
+	protected:
+		struct Edit {
+			Clock::time_point time;
+			uint32_t client;
+		};
+
+		// Uncompressed payload bytes received for a node half
+		struct NodeBytes {
+			uint64_t broadcasts;
+			uint64_t tiles;
+			size_t node;
+		};
+
+		bool ParseArguments(const wxArrayString& arguments);
+		void Step(LiveBenchClient& client);
+		void Pan(LiveBenchClient& client);
+		// Requests every broadcast node as PACKET_NODE and waits for them
+		void RequestBroadcastNodes();
+		void PrintReport(double seconds, double serverSeconds);
+
+		boost::asio::io_service service;
+		std::vector<std::unique_ptr<LiveBenchClient>> clients;
+		std::vector<std::thread> threads;
+
+		std::mutex editMutex;
+		// Latest edit of every node half, keyed like PACKET_TILES
+		std::unordered_map<uint32_t, Edit> edits;
+		std::vector<uint32_t> latencies; // microseconds
+		uint64_t editCount;
+		std::unordered_map<uint32_t, NodeBytes> nodeBytes;
+
+		wxString host;
+		wxString password;
+		long port;
+		long clientCount;
+		long duration; // seconds
+		long interval; // milliseconds
+		long areaX, areaY, areaWidth, areaHeight, areaFloor;
+		long itemId;
+		long seed;
+		long serverPid;
+		// LiveCompressionFlags the clients offer
+		uint8_t compression;
+};
+
+#endif
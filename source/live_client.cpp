@@ -25,15 +25,28 @@
 #include <wx/event.h>
 
 LiveClient::LiveClient() : LiveSocket(),
-	readMessage(), queryNodeList(), currentOperation(),
-	resolver(nullptr), socket(nullptr), editor(nullptr), stopped(false)
+	readMessage(), receivedMessages(), cursorTimer([this]() {
+		if(cursorPending) {
+			cursorPending = false;
+			sendCursor(pendingCursor);
+			cursorTimer.StartOnce(g_settings.getInteger(Config::LIVE_CURSOR_INTERVAL));
+		}
+	}), pendingCursor(), cursorPending(false),
+	queryNodeList(), lastViewport(), currentOperation(),
+	resolver(nullptr), socket(nullptr), strand(), sendQueue(), editor(nullptr), fullSync(false), stopped(false)
 {
-	//
+	receivedMessages.setHandler([this](NetworkMessage& message) {
+		parsePacket(message);
+	});
+	lastViewport.floor = -1;
 }
 
 LiveClient::~LiveClient()
 {
-	//
+	// Handlers may still be queued for the socket, see close()
+	if(!stopped) {
+		close();
+	}
 }
 
 bool LiveClient::connect(const std::string& address, uint16_t port)
@@ -51,17 +64,26 @@ bool LiveClient::connect(const std::string& address, uint16_t port)
 
 	if(!socket) {
 		socket = std::make_shared<boost::asio::ip::tcp::socket>(service);
+		strand.reset(new boost::asio::io_service::strand(service));
+		sendQueue.reset(new NetworkSendQueue(*socket, *strand));
+		sendQueue->setHighWaterMark(g_settings.getInteger(Config::LIVE_SEND_HIGH_WATER_MARK) * 1024);
+		sendQueue->setErrorHandler([this](const boost::system::error_code& error) {
+			logMessage(wxString() + getHostName() + ": " + error.message());
+		});
 	}
 
 	boost::asio::ip::tcp::resolver::query query(address, std::to_string(port));
-	resolver->async_resolve(query, [this](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoint_iterator) -> void
+	std::shared_ptr<std::atomic<bool>> clientAlive = alive;
+	resolver->async_resolve(query, strand->wrap([this, clientAlive](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoint_iterator) -> void
 	{
-		if(error) {
+		if(!*clientAlive) {
+			return;
+		} else if(error) {
 			logMessage("Error: " + error.message());
 		} else {
 			tryConnect(endpoint_iterator);
 		}
-	});
+	}));
 
 	/*
 	if(!client->WaitOnConnect(5, 0)) {
@@ -102,15 +124,18 @@ void LiveClient::tryConnect(boost::asio::ip::tcp::resolver::iterator endpoint_it
 
 	logMessage("Joining server " + endpoint_iterator->host_name() + ":" + endpoint_iterator->service_name() + "...");
 
-	boost::asio::async_connect(*socket, endpoint_iterator, [this](boost::system::error_code error, boost::asio::ip::tcp::resolver::iterator endpoint_iterator) -> void
+	std::shared_ptr<std::atomic<bool>> clientAlive = alive;
+	boost::asio::async_connect(*socket, endpoint_iterator, strand->wrap([this, clientAlive](boost::system::error_code error, boost::asio::ip::tcp::resolver::iterator endpoint_iterator) -> void
 	{
-		if(!socket->is_open()) {
+		if(!*clientAlive) {
+			return;
+		} else if(!socket->is_open()) {
 			tryConnect(++endpoint_iterator);
 		} else if(error) {
 			if(handleError(error)) {
 				tryConnect(++endpoint_iterator);
 			} else {
-				wxTheApp->CallAfter([this]() {
+				callAfter([this]() {
 					close();
 					g_gui.CloseLiveEditors(this);
 				});
@@ -118,7 +143,7 @@ void LiveClient::tryConnect(boost::asio::ip::tcp::resolver::iterator endpoint_it
 		} else {
 			socket->set_option(boost::asio::ip::tcp::no_delay(true), error);
 			if(error) {
-				wxTheApp->CallAfter([this]() {
+				callAfter([this]() {
 					close();
 				});
 				return;
@@ -126,7 +151,7 @@ void LiveClient::tryConnect(boost::asio::ip::tcp::resolver::iterator endpoint_it
 			sendHello();
 			receiveHeader();
 		}
-	});
+	}));
 }
 
 void LiveClient::close()
@@ -136,9 +161,20 @@ void LiveClient::close()
 	}
 
 	if(socket) {
-		socket->close();
+		// Closed on the strand so it can't race a read or write in flight, no
+		// handler touches the client afterwards, so it can be deleted
+		NetworkConnection::getInstance().runOnStrand(*strand, [this]() {
+			*alive = false;
+			sendQueue->stop();
+
+			boost::system::error_code error;
+			socket->close(error);
+		});
 	}
 
+	cursorTimer.Stop();
+	cursorPending = false;
+
 	if(log) {
 		log->Message("Disconnected from server.");
 		log->Disconnect();
@@ -151,7 +187,7 @@ void LiveClient::close()
 bool LiveClient::handleError(const boost::system::error_code& error)
 {
 	if(error == boost::asio::error::eof || error == boost::asio::error::connection_reset) {
-		wxTheApp->CallAfter([this]() {
+		callAfter([this]() {
 			log->Message(wxString() + getHostName() + ": disconnected.");
 			close();
 		});
@@ -173,11 +209,16 @@ std::string LiveClient::getHostName() const
 
 void LiveClient::receiveHeader()
 {
+	readMessage.clear();
 	readMessage.position = 0;
+
+	std::shared_ptr<std::atomic<bool>> clientAlive = alive;
 	boost::asio::async_read(*socket,
-		boost::asio::buffer(readMessage.buffer, 4),
-		[this](const boost::system::error_code& error, size_t bytesReceived) -> void {
-			if(error) {
+		boost::asio::buffer(readMessage.buffer, 4), strand->wrap(
+		[this, clientAlive](const boost::system::error_code& error, size_t bytesReceived) -> void {
+			if(!*clientAlive) {
+				return;
+			} else if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
 				}
@@ -187,42 +228,56 @@ void LiveClient::receiveHeader()
 				receive(readMessage.read<uint32_t>());
 			}
 		}
-	);
+	));
 }
 
 void LiveClient::receive(uint32_t packetSize)
 {
+	const bool compressed = (packetSize & NETWORK_MESSAGE_COMPRESSED) != 0;
+	packetSize &= ~NETWORK_MESSAGE_COMPRESSED;
+	if(packetSize > NETWORK_MAX_MESSAGE_SIZE) {
+		logMessage(wxString() + getHostName() + ": Packet too large, disconnecting.");
+		callAfter([this]() {
+			close();
+		});
+		return;
+	}
+
 	readMessage.buffer.resize(readMessage.position + packetSize);
+
+	std::shared_ptr<std::atomic<bool>> clientAlive = alive;
 	boost::asio::async_read(*socket,
-		boost::asio::buffer(&readMessage.buffer[readMessage.position], packetSize),
-		[this](const boost::system::error_code& error, size_t bytesReceived) -> void {
-			if(error) {
+		boost::asio::buffer(&readMessage.buffer[readMessage.position], packetSize), strand->wrap(
+		[this, clientAlive, compressed](const boost::system::error_code& error, size_t bytesReceived) -> void {
+			if(!*clientAlive) {
+				return;
+			} else if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
 				}
 			} else if(bytesReceived < readMessage.buffer.size() - 4) {
 				logMessage(wxString() + getHostName() + ": Could not receive packet[size: " + std::to_string(bytesReceived) + "], disconnecting client.");
-			} else {
-				wxTheApp->CallAfter([this]() {
-					parsePacket(std::move(readMessage));
-					receiveHeader();
+			} else if(compressed && !compressor.decompress(readMessage)) {
+				logMessage(wxString() + getHostName() + ": Could not decompress packet, disconnecting.");
+				callAfter([this]() {
+					close();
 				});
+			} else {
+				// Parsed on the UI thread, meanwhile the next packet is read
+				receivedMessages.push(std::move(readMessage));
+				receiveHeader();
 			}
 		}
-	);
+	));
 }
 
 void LiveClient::send(NetworkMessage& message)
 {
-	memcpy(&message.buffer[0], &message.size, 4);
-	boost::asio::async_write(*socket,
-		boost::asio::buffer(message.buffer, message.size + 4),
-		[this](const boost::system::error_code& error, size_t bytesTransferred) -> void {
-			if(error) {
-				logMessage(wxString() + getHostName() + ": " + error.message());
-			}
-		}
-	);
+	if(!sendQueue) {
+		return;
+	}
+
+	sendQueue->send(prepareMessage(message, compressionEnabled));
 }
 
 void LiveClient::updateCursor(const Position& position)
@@ -237,11 +292,32 @@ void LiveClient::updateCursor(const Position& position)
 		g_settings.getInteger(Config::CURSOR_ALPHA)
 	);
 
-	NetworkMessage message;
-	message.write<uint8_t>(PACKET_CLIENT_UPDATE_CURSOR);
-	writeCursor(message, cursor);
+	if(!sendQueue) {
+		return;
+	}
 
-	send(message);
+	if(cursorTimer.IsRunning()) {
+		pendingCursor = cursor;
+		cursorPending = true;
+		return;
+	}
+
+	sendCursor(cursor);
+	cursorTimer.StartOnce(g_settings.getInteger(Config::LIVE_CURSOR_INTERVAL));
+}
+
+void LiveClient::sendCursor(const LiveCursor& cursor)
+{
+	if(!sendQueue) {
+		return;
+	}
+
+	std::shared_ptr<NetworkMessage> message = std::make_shared<NetworkMessage>();
+	message->write<uint8_t>(PACKET_CLIENT_UPDATE_CURSOR);
+	writeCursor(*message, cursor);
+	memcpy(&message->buffer[0], &message->size, 4);
+
+	sendQueue->sendCursor(message, cursor.id);
 }
 
 LiveLogTab* LiveClient::createLogWindow(wxWindow* parent)
@@ -275,6 +351,21 @@ void LiveClient::sendHello()
 	message.write<uint32_t>(g_gui.GetCurrentVersionID());
 	message.write<std::string>(nstr(name));
 	message.write<std::string>(nstr(password));
+	message.write<uint8_t>(LIVE_COMPRESSION_ZLIB);
+
+	send(message);
+}
+
+void LiveClient::sendSnapshotRequest(const Position& start, const Position& end)
+{
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_REQUEST_SNAPSHOT);
+	message.write<uint16_t>(start.x);
+	message.write<uint16_t>(start.y);
+	message.write<uint16_t>(end.x);
+	message.write<uint16_t>(end.y);
+	message.write<uint8_t>(start.z);
+	message.write<uint8_t>(end.z);
 
 	send(message);
 }
@@ -321,8 +412,7 @@ void LiveClient::sendChanges(DirtyList& dirtyList)
 	NetworkMessage message;
 	message.write<uint8_t>(PACKET_CHANGE_LIST);
 
-	std::string data(reinterpret_cast<const char*>(mapWriter.getMemory()), mapWriter.getSize());
-	message.write<std::string>(data);
+	message.writeSpan(mapWriter.getMemory(), mapWriter.getSize());
 
 	send(message);
 }
@@ -351,7 +441,23 @@ void LiveClient::queryNode(int32_t ndx, int32_t ndy, bool underground)
 	queryNodeList.insert(nd);
 }
 
-void LiveClient::parsePacket(NetworkMessage message)
+void LiveClient::updateViewport(const LiveViewport& viewport)
+{
+	if(viewport.floor == lastViewport.floor &&
+		(viewport.startX >> 2) == (lastViewport.startX >> 2) && (viewport.startY >> 2) == (lastViewport.startY >> 2) &&
+		(viewport.endX >> 2) == (lastViewport.endX >> 2) && (viewport.endY >> 2) == (lastViewport.endY >> 2)) {
+		return;
+	}
+	lastViewport = viewport;
+
+	NetworkMessage message;
+	message.write<uint8_t>(PACKET_CLIENT_UPDATE_VIEWPORT);
+	writeViewport(message, viewport);
+
+	send(message);
+}
+
+void LiveClient::parsePacket(NetworkMessage& message)
 {
 	uint8_t packetType;
 	while(message.position < message.buffer.size()) {
@@ -375,8 +481,14 @@ void LiveClient::parsePacket(NetworkMessage message)
 			case PACKET_NODE:
 				parseNode(message);
 				break;
-			case PACKET_CURSOR_UPDATE:
-				parseCursorUpdate(message);
+			case PACKET_EVICT_NODES:
+				parseEvictNodes(message);
+				break;
+			case PACKET_TILES:
+				parseTiles(message);
+				break;
+			case PACKET_CURSOR_UPDATES:
+				parseCursorUpdates(message);
 				break;
 			case PACKET_START_OPERATION:
 				parseStartOperation(message);
@@ -402,8 +514,13 @@ void LiveClient::parseHello(NetworkMessage& message)
 	map.setName("Live Map - " + message.read<std::string>());
 	map.setWidth(message.read<uint16_t>());
 	map.setHeight(message.read<uint16_t>());
+	compressionEnabled = (message.read<uint8_t>() & LIVE_COMPRESSION_ZLIB) != 0;
 
 	createEditorWindow();
+
+	if(fullSync) {
+		sendSnapshotRequest(Position(0, 0, 0), Position(map.getWidth(), map.getHeight(), MAP_MAX_LAYER));
+	}
 }
 
 void LiveClient::parseKick(NetworkMessage& message)
@@ -461,12 +578,83 @@ void LiveClient::parseNode(NetworkMessage& message)
 	g_gui.UpdateMinimap();
 }
 
-void LiveClient::parseCursorUpdate(NetworkMessage& message)
+void LiveClient::parseTiles(NetworkMessage& message)
 {
-	LiveCursor cursor = readCursor(message);
-	cursors[cursor.id] = cursor;
+	uint32_t ind = message.read<uint32_t>();
+
+	// Extract node position
+	int32_t ndx = ind >> 18;
+	int32_t ndy = (ind >> 4) & 0x3FFF;
+
+	Action* action = editor->actionQueue->createAction(ACTION_REMOTE);
+	receiveTiles(message, *editor, action, ndx, ndy);
+	editor->actionQueue->addAction(action);
 
 	g_gui.RefreshView();
+	g_gui.UpdateMinimap();
+}
+
+void LiveClient::parseEvictNodes(NetworkMessage& message)
+{
+	Map& map = editor->map;
+
+	// Cleared like any other remote change, so spawns, houses and statistics
+	// follow and the removed tiles stay owned by the action queue
+	Action* action = editor->actionQueue->createAction(ACTION_REMOTE);
+	std::vector<std::pair<QTreeNode*, bool>> evicted;
+	for(uint32_t nodes = message.read<uint32_t>(); nodes != 0; --nodes) {
+		uint32_t ind = message.read<uint32_t>();
+
+		int32_t ndx = ind >> 18;
+		int32_t ndy = (ind >> 4) & 0x3FFF;
+		bool underground = ind & 1;
+
+		QTreeNode* node = map.getLeaf(ndx * 4, ndy * 4);
+		if(!node) {
+			continue;
+		}
+		evicted.push_back(std::make_pair(node, underground));
+
+		const int32_t startZ = underground ? GROUND_LAYER + 1 : 0;
+		const int32_t endZ = underground ? MAP_MAX_LAYER : GROUND_LAYER;
+		for(int32_t z = startZ; z <= endZ; ++z) {
+			Floor* floor = node->getFloor(z);
+			if(!floor) {
+				continue;
+			}
+
+			for(TileLocation& location : floor->locs) {
+				Tile* tile = location.get();
+				// Selected tiles stay, the selection still points to them
+				if(!tile || (tile->empty() && !tile->isHouseTile()) || tile->isSelected()) {
+					continue;
+				}
+				action->addChange(newd Change(map.allocator(&location)));
+			}
+		}
+	}
+
+	// Committed while the nodes are still visible, changes to hidden nodes are dropped
+	editor->actionQueue->addAction(action);
+
+	// The server no longer sends updates for them, they're queried again once they come into view
+	for(const auto& node : evicted) {
+		node.first->setVisible(node.second, false);
+		node.first->setRequested(node.second, false);
+	}
+
+	g_gui.UpdateMinimap();
+}
+
+void LiveClient::parseCursorUpdates(NetworkMessage& message)
+{
+	for(uint16_t count = message.read<uint16_t>(); count != 0; --count) {
+		LiveCursor cursor = readCursor(message);
+		cursors[cursor.id] = cursor;
+	}
+
+	// The map itself didn't change, only the cursors on top of it
+	g_gui.RefreshViewOverlay();
 }
 
 void LiveClient::parseStartOperation(NetworkMessage& message)
@@ -59,12 +59,19 @@ class LiveClient : public LiveSocket
 		void sendChanges(DirtyList& dirtyList);
 		void sendChat(const wxString& chatMessage);
 		void sendReady();
+		// Asks for every node in the area at once instead of waiting to scroll there
+		void sendSnapshotRequest(const Position& start, const Position& end);
+
+		// Download the whole map right after joining
+		void setFullSync(bool enabled) { fullSync = enabled; }
 
 		// Flags a node as queried and stores it, need to call SendNodeRequest to send it to server
 		void queryNode(int32_t ndx, int32_t ndy, bool underground);
+		// Only sent when the view moved to other nodes or floor
+		void updateViewport(const LiveViewport& viewport);
 
 	protected:
-		void parsePacket(NetworkMessage message);
+		void parsePacket(NetworkMessage& message);
 
 		// parse packets
 		void parseHello(NetworkMessage& message);
@@ -73,21 +80,35 @@ class LiveClient : public LiveSocket
 		void parseChangeClientVersion(NetworkMessage& message);
 		void parseServerTalk(NetworkMessage& message);
 		void parseNode(NetworkMessage& message);
-		void parseCursorUpdate(NetworkMessage& message);
+		void parseTiles(NetworkMessage& message);
+		void parseEvictNodes(NetworkMessage& message);
+		void parseCursorUpdates(NetworkMessage& message);
 		void parseStartOperation(NetworkMessage& message);
 		void parseUpdateOperation(NetworkMessage& message);
 
+		void sendCursor(const LiveCursor& cursor);
+
 		//
 		NetworkMessage readMessage;
+		NetworkMessageQueue receivedMessages;
+
+		// At most one cursor update per tick, the latest position wins
+		LiveTimer cursorTimer;
+		LiveCursor pendingCursor;
+		bool cursorPending;
 
 		std::set<uint32_t> queryNodeList;
+		LiveViewport lastViewport;
 		wxString currentOperation;
 
 		std::shared_ptr<boost::asio::ip::tcp::resolver> resolver;
 		std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+		std::unique_ptr<boost::asio::io_service::strand> strand;
+		std::unique_ptr<NetworkSendQueue> sendQueue;
 
 		Editor* editor;
 
+		bool fullSync;
 		bool stopped;
 };
 
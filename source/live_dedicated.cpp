@@ -0,0 +1,213 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "live_dedicated.h"
+#include "live_server.h"
+
+#include "editor.h"
+#include "gui.h"
+#include "client_version.h"
+
+#include <csignal>
+
+namespace
+{
+	// Set from the signal handler, the timer picks it up on the UI thread
+	volatile std::sig_atomic_t stopRequested = 0;
+
+	void requestStop(int)
+	{
+		stopRequested = 1;
+	}
+}
+
+LiveDedicatedServer::LiveDedicatedServer() :
+	editor(nullptr), server(nullptr), timer(this),
+	name("RME Live Server"), password(), port(31313),
+	autosaveInterval(10 * 60), statusInterval(60),
+	uptime(0), lastSave(0)
+{
+	Bind(wxEVT_TIMER, &LiveDedicatedServer::OnTimer, this);
+}
+
+LiveDedicatedServer::~LiveDedicatedServer()
+{
+	Stop();
+}
+
+bool LiveDedicatedServer::IsRequested(const wxArrayString& arguments)
+{
+	return arguments.Index("--live-server") != wxNOT_FOUND;
+}
+
+bool LiveDedicatedServer::ParseArguments(const wxArrayString& arguments)
+{
+	for(size_t index = 1; index < arguments.size(); ++index) {
+		const wxString& argument = arguments[index];
+		if(index + 1 == arguments.size()) {
+			g_gui.PrintMessage("Missing value for \"" + argument + "\".");
+			return false;
+		}
+
+		const wxString& value = arguments[++index];
+		bool valid = true;
+		if(argument == "--live-server") {
+			mapPath = value;
+		} else if(argument == "--port") {
+			valid = value.ToLong(&port);
+		} else if(argument == "--password") {
+			password = value;
+		} else if(argument == "--name") {
+			name = value;
+		} else if(argument == "--autosave") {
+			valid = value.ToLong(&autosaveInterval) && autosaveInterval >= 0;
+			autosaveInterval *= 60;
+		} else if(argument == "--status") {
+			valid = value.ToLong(&statusInterval) && statusInterval >= 0;
+		} else {
+			g_gui.PrintMessage("Unknown argument \"" + argument + "\".");
+			return false;
+		}
+
+		if(!valid) {
+			g_gui.PrintMessage("Invalid value \"" + value + "\" for \"" + argument + "\".");
+			return false;
+		}
+	}
+	return !mapPath.empty();
+}
+
+bool LiveDedicatedServer::Start(const wxArrayString& arguments)
+{
+	g_gui.SetHeadless(true);
+	if(!ParseArguments(arguments)) {
+		g_gui.PrintMessage("Usage: rme --live-server <map.otbm> [--port N] [--password P] [--name N] [--autosave minutes] [--status seconds]");
+		return false;
+	}
+
+	if(ClientVersion::getLatestVersion() == nullptr) {
+		g_gui.PrintMessage("No client versions are configured, run the editor once to set them up.");
+		return false;
+	}
+
+	try
+	{
+		editor = newd Editor(g_gui.copybuffer, FileName(mapPath));
+	}
+	catch(std::runtime_error& e)
+	{
+		g_gui.PrintMessage(wxString(e.what(), wxConvUTF8));
+		return false;
+	}
+
+	if(!editor->map.hasFile()) {
+		g_gui.PrintMessage("Could not load \"" + mapPath + "\": " + editor->map.getError());
+		delete editor;
+		editor = nullptr;
+		return false;
+	}
+	g_gui.ListDialog("Map loader errors", editor->map.getWarnings());
+
+	server = editor->StartLiveServer();
+	if(!server->setName(name) || !server->setPassword(password) || !server->setPort(port)) {
+		g_gui.PrintMessage(server->getLastError());
+		Stop();
+		return false;
+	}
+
+	if(!server->bind()) {
+		g_gui.PrintMessage("Could not bind port " + i2ws(port) + ": " + server->getLastError());
+		Stop();
+		return false;
+	}
+
+	g_gui.PrintMessage(wxString::Format("Serving %s (%llu tiles) on %s.",
+		wxstr(editor->map.getName()),
+		static_cast<unsigned long long>(editor->map.getTileCount()),
+		server->getHostName()
+	));
+
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+
+	timer.Start(1000);
+	return true;
+}
+
+void LiveDedicatedServer::Stop()
+{
+	timer.Stop();
+	if(!editor) {
+		return;
+	}
+
+	Save();
+	if(server) {
+		editor->CloseLiveServer();
+		server = nullptr;
+	}
+
+	delete editor;
+	editor = nullptr;
+}
+
+void LiveDedicatedServer::Save()
+{
+	lastSave = uptime;
+	if(!editor->map.hasChanged()) {
+		return;
+	}
+
+	// Edits are applied on this thread too, so nothing changes mid-save
+	g_gui.PrintMessage("Saving " + wxstr(editor->map.getFilename()) + "...");
+	editor->saveMap(FileName(), false);
+	if(!editor->map.hasChanged()) {
+		g_gui.PrintMessage("Map saved.");
+	}
+}
+
+void LiveDedicatedServer::PrintStatus()
+{
+	g_gui.PrintMessage(wxString::Format("Up %ldm, %d clients, %d subscribed nodes, %llu tiles, %s.",
+		uptime / 60,
+		static_cast<int>(server->getClientCount()),
+		static_cast<int>(server->getSubscribedNodeCount()),
+		static_cast<unsigned long long>(editor->map.getTileCount()),
+		editor->map.hasChanged() ? "unsaved changes" : "saved"
+	));
+}
+
+void LiveDedicatedServer::OnTimer(wxTimerEvent& WXUNUSED(event))
+{
+	if(stopRequested) {
+		g_gui.PrintMessage("Shutting down...");
+		Stop();
+		wxTheApp->ExitMainLoop();
+		return;
+	}
+
+	++uptime;
+	if(autosaveInterval > 0 && uptime - lastSave >= autosaveInterval) {
+		Save();
+	}
+
+	if(statusInterval > 0 && uptime % statusInterval == 0) {
+		PrintStatus();
+	}
+}
@@ -0,0 +1,63 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _RME_LIVE_DEDICATED_H_
+#define _RME_LIVE_DEDICATED_H_
+
+class Editor;
+class LiveServer;
+
+// Hosts a live session without any windows or GL context, started with
+//   rme --live-server map.otbm [--port N] [--password P] [--name N]
+//       [--autosave minutes] [--status seconds]
+class LiveDedicatedServer : public wxEvtHandler
+{
+	public:
+		LiveDedicatedServer();
+		~LiveDedicatedServer();
+
+		static bool IsRequested(const wxArrayString& arguments);
+
+		// Loads the map and starts listening, false if either failed
+		bool Start(const wxArrayString& arguments);
+		// Saves any pending changes and disconnects everyone
+		void Stop();
+
+	protected:
+		bool ParseArguments(const wxArrayString& arguments);
+		void Save();
+		void PrintStatus();
+
+		void OnTimer(wxTimerEvent& event);
+
+		Editor* editor;
+		LiveServer* server;
+		wxTimer timer;
+
+		wxString mapPath;
+		wxString name;
+		wxString password;
+		long port;
+		// Both in seconds, 0 turns them off
+		long autosaveInterval;
+		long statusInterval;
+
+		long uptime;
+		long lastSave;
+};
+
+#endif
@@ -29,9 +29,11 @@ enum LivePacketType
 	PACKET_ADD_HOUSE = 0x23,
 	PACKET_EDIT_HOUSE = 0x24,
 	PACKET_REMOVE_HOUSE = 0x25,
+	PACKET_REQUEST_SNAPSHOT = 0x26,
 
 	PACKET_CLIENT_TALK = 0x30,
 	PACKET_CLIENT_UPDATE_CURSOR = 0x31,
+	PACKET_CLIENT_UPDATE_VIEWPORT = 0x32,
 
 	PACKET_HELLO_FROM_SERVER = 0x80,
 	PACKET_KICK = 0x81,
@@ -40,10 +42,19 @@ enum LivePacketType
 	PACKET_SERVER_TALK = 0x84,
 
 	PACKET_NODE = 0x90,
-	PACKET_CURSOR_UPDATE = 0x91,
+	// Every cursor that moved during the last tick
+	PACKET_CURSOR_UPDATES = 0x91,
 	PACKET_START_OPERATION = 0x92,
 	PACKET_UPDATE_OPERATION = 0x93,
 	PACKET_CHAT_MESSAGE = 0x94,
+	PACKET_TILES = 0x95,
+	PACKET_EVICT_NODES = 0x96,
+};
+
+enum LiveCompressionFlags
+{
+	LIVE_COMPRESSION_NONE = 0x00,
+	LIVE_COMPRESSION_ZLIB = 0x01,
 };
 
 #endif
@@ -24,10 +24,47 @@
 
 #include "editor.h"
 
+// Nodes streamed around the viewport, so small scrolls never show holes
+const int32_t LIVE_INTEREST_MARGIN = 4;
+// How many view moves ahead to prefetch in the scroll direction
+const int32_t LIVE_PREFETCH_STEPS = 3;
+const int32_t LIVE_PREFETCH_MAX_NODES = 32;
+// Nodes further than this outside the interest area are evicted
+const int32_t LIVE_EVICT_MARGIN = 16;
+// Larger viewports (in tiles) are cut down around their center
+const int32_t LIVE_MAX_VIEWPORT_SIZE = 1024;
+// Missing nodes sent at once, the rest follow whenever the send queue drains
+const size_t LIVE_INTEREST_BATCH_SIZE = 256;
+// Payload bytes written per full sync batch before it's sent
+const size_t LIVE_SNAPSHOT_CHUNK_SIZE = 64 * 1024;
+
 LivePeer::LivePeer(LiveServer* server, boost::asio::ip::tcp::socket socket) : LiveSocket(),
-	readMessage(), server(server), socket(std::move(socket)), color(), id(0), clientId(0), connected(false)
+	readMessage(), receivedMessages(), server(server), socket(std::move(socket)),
+	strand(NetworkConnection::getInstance().get_service()), sendQueue(this->socket, strand), color(), id(0), clientId(0), connected(false), removed(false), compression(LIVE_COMPRESSION_NONE),
+	interestNodes(), pendingNodes(), interestPending(false), viewport(), hasViewport(false),
+	snapshotNodes(), snapshotArea(), snapshotHalves(0), snapshotTotal(0), snapshotActive(false), keepSnapshotNodes(false)
 {
 	ASSERT(server != nullptr);
+	sendQueue.setErrorHandler([this](const boost::system::error_code& error) {
+		logMessage(wxString() + getHostName() + ": " + error.message());
+	});
+	sendQueue.setIdleHandler([this]() {
+		if(snapshotActive || interestPending) {
+			callAfter([this]() {
+				sendSnapshotChunk();
+				sendPendingNodes();
+			});
+		}
+	});
+	receivedMessages.setHandler([this](NetworkMessage& message) {
+		if(removed) {
+			return;
+		} else if(connected) {
+			parseEditorPacket(message);
+		} else {
+			parseLoginPacket(message);
+		}
+	});
 }
 
 LivePeer::~LivePeer()
@@ -42,11 +79,24 @@ void LivePeer::close()
 	server->removeClient(id);
 }
 
+void LivePeer::shutdown()
+{
+	NetworkConnection::getInstance().runOnStrand(strand, [this]() {
+		*alive = false;
+		sendQueue.stop();
+
+		boost::system::error_code error;
+		socket.close(error);
+	});
+}
+
 bool LivePeer::handleError(const boost::system::error_code& error)
 {
 	if(error == boost::asio::error::eof || error == boost::asio::error::connection_reset) {
 		logMessage(wxString() + getHostName() + ": disconnected.");
-		close();
+		callAfter([this]() {
+			close();
+		});
 		return true;
 	} else if(error == boost::asio::error::connection_aborted) {
 		logMessage(name + " have left the server.");
@@ -62,11 +112,16 @@ std::string LivePeer::getHostName() const
 
 void LivePeer::receiveHeader()
 {
+	readMessage.clear();
 	readMessage.position = 0;
+
+	std::shared_ptr<std::atomic<bool>> peerAlive = alive;
 	boost::asio::async_read(socket,
-		boost::asio::buffer(readMessage.buffer, 4),
-		[this](const boost::system::error_code& error, size_t bytesReceived) -> void {
-			if(error) {
+		boost::asio::buffer(readMessage.buffer, 4), strand.wrap(
+		[this, peerAlive](const boost::system::error_code& error, size_t bytesReceived) -> void {
+			if(!*peerAlive) {
+				return;
+			} else if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
 				}
@@ -76,49 +131,76 @@ void LivePeer::receiveHeader()
 				receive(readMessage.read<uint32_t>());
 			}
 		}
-	);
+	));
 }
 
 void LivePeer::receive(uint32_t packetSize)
 {
+	const bool compressed = (packetSize & NETWORK_MESSAGE_COMPRESSED) != 0;
+	packetSize &= ~NETWORK_MESSAGE_COMPRESSED;
+	if(packetSize > NETWORK_MAX_MESSAGE_SIZE) {
+		reject("Packet too large.");
+		return;
+	}
+
 	readMessage.buffer.resize(readMessage.position + packetSize);
+
+	std::shared_ptr<std::atomic<bool>> peerAlive = alive;
 	boost::asio::async_read(socket,
-		boost::asio::buffer(&readMessage.buffer[readMessage.position], packetSize),
-		[this](const boost::system::error_code& error, size_t bytesReceived) -> void {
-			if(error) {
+		boost::asio::buffer(&readMessage.buffer[readMessage.position], packetSize), strand.wrap(
+		[this, peerAlive, compressed](const boost::system::error_code& error, size_t bytesReceived) -> void {
+			if(!*peerAlive) {
+				return;
+			} else if(error) {
 				if(!handleError(error)) {
 					logMessage(wxString() + getHostName() + ": " + error.message());
 				}
 			} else if(bytesReceived < readMessage.buffer.size() - 4) {
 				logMessage(wxString() + getHostName() + ": Could not receive packet[size: " + std::to_string(bytesReceived) + "], disconnecting client.");
+			} else if(compressed && !compressor.decompress(readMessage)) {
+				reject("Invalid compressed packet.");
 			} else {
-				wxTheApp->CallAfter([this]() {
-					if(connected) {
-						parseEditorPacket(std::move(readMessage));
-					} else {
-						parseLoginPacket(std::move(readMessage));
-					}
-					receiveHeader();
-				});
+				// Parsed on the UI thread, meanwhile the next packet is read
+				receivedMessages.push(std::move(readMessage));
+				receiveHeader();
 			}
 		}
-	);
+	));
+}
+
+void LivePeer::reject(const std::string& reason)
+{
+	logMessage(wxString() + getHostName() + ": " + reason + " Disconnecting client.");
+
+	// Kicked from the UI thread
+	callAfter([this, reason]() {
+		NetworkMessage outMessage;
+		outMessage.write<uint8_t>(PACKET_KICK);
+		outMessage.write<std::string>(reason);
+
+		send(outMessage);
+		close();
+	});
 }
 
 void LivePeer::send(NetworkMessage& message)
 {
-	memcpy(&message.buffer[0], &message.size, 4);
-	boost::asio::async_write(socket,
-		boost::asio::buffer(message.buffer, message.size + 4),
-		[this](const boost::system::error_code& error, size_t bytesTransferred) -> void {
-			if(error) {
-				logMessage(wxString() + getHostName() + ": " + error.message());
-			}
-		}
-	);
+	sendQueue.send(prepareMessage(message, compressionEnabled));
+}
+
+void LivePeer::send(const SharedNetworkMessage& message)
+{
+	// The queue holds a reference, so the buffer lives until every peer has written it
+	sendQueue.send(message);
+}
+
+void LivePeer::sendCursor(const SharedNetworkMessage& message, uint32_t cursorId)
+{
+	sendQueue.sendCursor(message, cursorId);
 }
 
-void LivePeer::parseLoginPacket(NetworkMessage message)
+
+void LivePeer::parseLoginPacket(NetworkMessage& message)
 {
 	uint8_t packetType;
 	while(message.position < message.buffer.size()) {
@@ -131,7 +213,7 @@ void LivePeer::parseLoginPacket(NetworkMessage message)
 				parseReady(message);
 				break;
 			default: {
-				log->Message("Invalid login packet receieved, connection severed.");
+				logMessage("Invalid login packet receieved, connection severed.");
 				close();
 				break;
 			}
@@ -139,7 +221,7 @@ void LivePeer::parseLoginPacket(NetworkMessage message)
 	}
 }
 
-void LivePeer::parseEditorPacket(NetworkMessage message)
+void LivePeer::parseEditorPacket(NetworkMessage& message)
 {
 	uint8_t packetType;
 	while(message.position < message.buffer.size()) {
@@ -166,8 +248,14 @@ void LivePeer::parseEditorPacket(NetworkMessage message)
 			case PACKET_CLIENT_TALK:
 				parseChatMessage(message);
 				break;
+			case PACKET_CLIENT_UPDATE_VIEWPORT:
+				parseViewportUpdate(message);
+				break;
+			case PACKET_REQUEST_SNAPSHOT:
+				parseSnapshotRequest(message);
+				break;
 			default: {
-				log->Message("Invalid editor packet receieved, connection severed.");
+				logMessage("Invalid editor packet receieved, connection severed.");
 				close();
 				break;
 			}
@@ -207,15 +295,16 @@ void LivePeer::parseHello(NetworkMessage& message)
 	uint32_t clientVersion = message.read<uint32_t>();
 	std::string nickname = message.read<std::string>();
 	std::string password = message.read<std::string>();
+	compression = message.read<uint8_t>() & LIVE_COMPRESSION_ZLIB;
 
 	if(server->getPassword() != wxString(password.c_str(), wxConvUTF8)) {
-		log->Message("Client tried to connect, but used the wrong password, connection refused.");
+		logMessage("Client tried to connect, but used the wrong password, connection refused.");
 		close();
 		return;
 	}
 
 	name = wxString(nickname.c_str(), wxConvUTF8);
-	log->Message(name + " (" + getHostName() + ") connected.");
+	logMessage(name + " (" + getHostName() + ") connected.");
 
 	NetworkMessage outMessage;
 	if(static_cast<ClientVersionID>(clientVersion) != g_gui.GetCurrentVersionID()) {
@@ -258,8 +347,11 @@ void LivePeer::parseReady(NetworkMessage& message)
 	outMessage.write<std::string>(map.getName());
 	outMessage.write<uint16_t>(map.getWidth());
 	outMessage.write<uint16_t>(map.getHeight());
+	outMessage.write<uint8_t>(compression);
 
+	// The hello itself goes out uncompressed, everything after it may not
 	send(outMessage);
+	compressionEnabled = compression != LIVE_COMPRESSION_NONE;
 }
 
 void LivePeer::parseNodeRequest(NetworkMessage& message)
@@ -268,15 +360,46 @@ void LivePeer::parseNodeRequest(NetworkMessage& message)
 	for(uint32_t nodes = message.read<uint32_t>(); nodes != 0; --nodes) {
 		uint32_t ind = message.read<uint32_t>();
 
-		int32_t ndx = ind >> 18;
-		int32_t ndy = (ind >> 4) & 0x3FFF;
-		bool underground = ind & 1;
+		sendInterestNode(map, ind);
+	}
+}
+
+void LivePeer::sendInterestNode(Map& map, uint32_t ind)
+{
+	int32_t ndx = ind >> 18;
+	int32_t ndy = (ind >> 4) & 0x3FFF;
+	bool underground = ind & 1;
+
+	if(ndx > (map.getWidth() >> 2) || ndy > (map.getHeight() >> 2)) {
+		return;
+	}
+
+	// Nodes nobody built yet go out empty instead of being created for the
+	// client, it still gets their changes once they are
+	QTreeNode* node = map.getLeaf(ndx * 4, ndy * 4);
+	sendNode(node, ndx, ndy, underground ? 0xFF00 : 0x00FF);
+	if(interestNodes.insert(ind).second) {
+		server->subscribe(this, ind);
+	}
+}
+
+void LivePeer::sendPendingNodes()
+{
+	if(!interestPending) {
+		return;
+	}
 
-		QTreeNode* node = map.createLeaf(ndx * 4, ndy * 4);
-		if(node) {
-			sendNode(clientId, node, ndx, ndy, underground ? 0xFF00 : 0x00FF);
+	Map& map = server->getEditor()->map;
+	size_t sent = 0;
+	while(!pendingNodes.empty() && sent < LIVE_INTEREST_BATCH_SIZE) {
+		const uint32_t ind = pendingNodes.front();
+		pendingNodes.pop_front();
+		if(interestNodes.find(ind) == interestNodes.end()) {
+			sendInterestNode(map, ind);
+			++sent;
 		}
 	}
+	interestPending = !pendingNodes.empty();
 }
 
 void LivePeer::parseReceiveChanges(NetworkMessage& message)
@@ -284,8 +407,8 @@ void LivePeer::parseReceiveChanges(NetworkMessage& message)
 	Editor& editor = *server->getEditor();
 
 	// -1 on address since we skip the first START_NODE when sending
-	const std::string& data = message.read<std::string>();
-	mapReader.assign(reinterpret_cast<const uint8_t*>(data.c_str() - 1), data.size());
+	const NetworkSpan data = message.readSpan();
+	mapReader.assign(data.data - 1, data.size);
 
 	BinaryNode* rootNode = mapReader.getRootNode();
 	BinaryNode* tileNode = rootNode->getChild();
@@ -329,8 +452,8 @@ void LivePeer::parseCursorUpdate(NetworkMessage& message)
 		server->updateClientList();
 	}
 
+	// The host view is refreshed when the batch goes out
 	server->broadcastCursor(cursor);
-	g_gui.RefreshView();
 }
 
 void LivePeer::parseChatMessage(NetworkMessage& message)
@@ -338,3 +461,229 @@ void LivePeer::parseChatMessage(NetworkMessage& message)
 	const std::string& chatMessage = message.read<std::string>();
 	server->broadcastChat(name, wxstr(chatMessage));
 }
+
+void LivePeer::parseViewportUpdate(NetworkMessage& message)
+{
+	LiveViewport newViewport = readViewport(message);
+	if(newViewport.endX - newViewport.startX >= LIVE_MAX_VIEWPORT_SIZE) {
+		newViewport.startX = (newViewport.startX + newViewport.endX - LIVE_MAX_VIEWPORT_SIZE) / 2;
+		newViewport.endX = newViewport.startX + LIVE_MAX_VIEWPORT_SIZE - 1;
+	}
+	if(newViewport.endY - newViewport.startY >= LIVE_MAX_VIEWPORT_SIZE) {
+		newViewport.startY = (newViewport.startY + newViewport.endY - LIVE_MAX_VIEWPORT_SIZE) / 2;
+		newViewport.endY = newViewport.startY + LIVE_MAX_VIEWPORT_SIZE - 1;
+	}
+
+	// Scroll direction in nodes since the last update
+	int32_t moveX = 0;
+	int32_t moveY = 0;
+	if(hasViewport && newViewport.floor == viewport.floor) {
+		moveX = ((newViewport.startX + newViewport.endX) - (viewport.startX + viewport.endX)) / 8;
+		moveY = ((newViewport.startY + newViewport.endY) - (viewport.startY + viewport.endY)) / 8;
+	}
+	viewport = newViewport;
+	hasViewport = true;
+
+	const int32_t aheadX = std::max(-LIVE_PREFETCH_MAX_NODES, std::min(moveX * LIVE_PREFETCH_STEPS, LIVE_PREFETCH_MAX_NODES));
+	const int32_t aheadY = std::max(-LIVE_PREFETCH_MAX_NODES, std::min(moveY * LIVE_PREFETCH_STEPS, LIVE_PREFETCH_MAX_NODES));
+
+	Map& map = server->getEditor()->map;
+	const int32_t maxX = map.getWidth() >> 2;
+	const int32_t maxY = map.getHeight() >> 2;
+
+	// Interest area in nodes, stretched towards where the view is heading
+	int32_t startX = (viewport.startX >> 2) - LIVE_INTEREST_MARGIN + std::min(aheadX, 0);
+	int32_t startY = (viewport.startY >> 2) - LIVE_INTEREST_MARGIN + std::min(aheadY, 0);
+	int32_t endX = (viewport.endX >> 2) + LIVE_INTEREST_MARGIN + std::max(aheadX, 0);
+	int32_t endY = (viewport.endY >> 2) + LIVE_INTEREST_MARGIN + std::max(aheadY, 0);
+
+	const int32_t centerX = ((viewport.startX + viewport.endX) >> 3) + aheadX;
+	const int32_t centerY = ((viewport.startY + viewport.endY) >> 3) + aheadY;
+	const uint32_t underground = viewport.floor > GROUND_LAYER ? 1 : 0;
+
+	// Missing nodes go out closest to where the view will be first
+	std::vector<std::pair<int32_t, uint32_t>> missing;
+	for(int32_t ndx = std::max(startX, 0); ndx <= std::min(endX, maxX); ++ndx) {
+		for(int32_t ndy = std::max(startY, 0); ndy <= std::min(endY, maxY); ++ndy) {
+			const uint32_t ind = (ndx << 18) | (ndy << 4) | underground;
+			if(interestNodes.find(ind) == interestNodes.end()) {
+				const int32_t dx = ndx - centerX;
+				const int32_t dy = ndy - centerY;
+				missing.emplace_back(dx * dx + dy * dy, ind);
+			}
+		}
+	}
+
+	// Replaces what was still pending for the previous viewport
+	std::sort(missing.begin(), missing.end());
+	pendingNodes.clear();
+	for(const auto& entry : missing) {
+		pendingNodes.push_back(entry.second);
+	}
+	interestPending = !pendingNodes.empty();
+	sendPendingNodes();
+
+	// Let go of everything well outside the area, the client frees its tiles
+	// and the server stops sending it changes there. What it synced stays.
+	startX -= LIVE_EVICT_MARGIN;
+	startY -= LIVE_EVICT_MARGIN;
+	endX += LIVE_EVICT_MARGIN;
+	endY += LIVE_EVICT_MARGIN;
+
+	std::vector<uint32_t> evicted;
+	for(auto it = interestNodes.begin(); it != interestNodes.end(); ) {
+		const uint32_t ind = *it;
+		const int32_t ndx = ind >> 18;
+		const int32_t ndy = (ind >> 4) & 0x3FFF;
+		if((ndx >= startX && ndx <= endX && ndy >= startY && ndy <= endY) || (keepSnapshotNodes && isSnapshotNode(ind))) {
+			++it;
+			continue;
+		}
+
+		server->unsubscribe(this, ind);
+		evicted.push_back(ind);
+		it = interestNodes.erase(it);
+	}
+
+	if(!evicted.empty()) {
+		NetworkMessage outMessage;
+		outMessage.write<uint8_t>(PACKET_EVICT_NODES);
+		outMessage.write<uint32_t>(evicted.size());
+		for(uint32_t ind : evicted) {
+			outMessage.write<uint32_t>(ind);
+		}
+		send(outMessage);
+	}
+}
+
+void LivePeer::parseSnapshotRequest(NetworkMessage& message)
+{
+	snapshotArea.startX = message.read<uint16_t>();
+	snapshotArea.startY = message.read<uint16_t>();
+	snapshotArea.endX = message.read<uint16_t>();
+	snapshotArea.endY = message.read<uint16_t>();
+	const uint8_t startZ = message.read<uint8_t>();
+	const uint8_t endZ = message.read<uint8_t>();
+
+	// Node halves are always sent whole
+	snapshotHalves = 0;
+	if(startZ <= GROUND_LAYER) {
+		snapshotHalves |= 1;
+	}
+	if(endZ > GROUND_LAYER) {
+		snapshotHalves |= 2;
+	}
+
+	// Walks the tree down to its leaves only, the tiles are read when sent
+	Map& map = server->getEditor()->map;
+	PositionVector leaves;
+	map.getNodeAreas(4, leaves);
+	for(const Position& leaf : leaves) {
+		if(leaf.x + 3 < snapshotArea.startX || leaf.x > snapshotArea.endX ||
+			leaf.y + 3 < snapshotArea.startY || leaf.y > snapshotArea.endY) {
+			continue;
+		}
+
+		QTreeNode* node = map.getLeaf(leaf.x, leaf.y);
+		if(!node) {
+			continue;
+		}
+
+		for(uint8_t half = 0; half < 2; ++half) {
+			const int32_t fromZ = std::max<int32_t>(startZ, half ? GROUND_LAYER + 1 : 0);
+			const int32_t toZ = std::min<int32_t>(endZ, half ? MAP_MAX_LAYER : GROUND_LAYER);
+			bool found = false;
+			for(int32_t z = fromZ; z <= toZ && !found; ++z) {
+				found = node->getFloor(z) != nullptr;
+			}
+
+			const uint32_t ind = ((leaf.x >> 2) << 18) | ((leaf.y >> 2) << 4) | half;
+			if(found && interestNodes.find(ind) == interestNodes.end()) {
+				snapshotNodes.insert(ind);
+			}
+		}
+	}
+
+	snapshotTotal = snapshotNodes.size();
+	snapshotActive = true;
+	keepSnapshotNodes = true;
+	server->setSyncing(this, true);
+
+	NetworkMessage outMessage;
+	outMessage.write<uint8_t>(PACKET_START_OPERATION);
+	outMessage.write<std::string>("Synchronizing map");
+	send(outMessage);
+
+	sendSnapshotChunk();
+}
+
+bool LivePeer::isSnapshotNode(uint32_t ind) const
+{
+	if(!testFlags(snapshotHalves, 1 << (ind & 1))) {
+		return false;
+	}
+
+	const int32_t x = (ind >> 18) * 4;
+	const int32_t y = ((ind >> 4) & 0x3FFF) * 4;
+	return x + 3 >= snapshotArea.startX && x <= snapshotArea.endX && y + 3 >= snapshotArea.startY && y <= snapshotArea.endY;
+}
+
+void LivePeer::queueSnapshotNode(uint32_t ind)
+{
+	if(!snapshotActive || !isSnapshotNode(ind)) {
+		return;
+	}
+
+	if(interestNodes.find(ind) != interestNodes.end()) {
+		return;
+	}
+
+	if(snapshotNodes.insert(ind).second) {
+		++snapshotTotal;
+	}
+}
+
+void LivePeer::sendSnapshotChunk()
+{
+	if(!snapshotActive) {
+		return;
+	}
+
+	// Everything goes through the same ordered queue as the broadcasts, so a
+	// node sent here is current and every later change to it follows it
+	Map& map = server->getEditor()->map;
+
+	NetworkMessage message;
+	while(!snapshotNodes.empty() && message.size < LIVE_SNAPSHOT_CHUNK_SIZE) {
+		const uint32_t ind = *snapshotNodes.begin();
+		snapshotNodes.erase(snapshotNodes.begin());
+		if(interestNodes.find(ind) != interestNodes.end()) {
+			continue;
+		}
+
+		int32_t ndx = ind >> 18;
+		int32_t ndy = (ind >> 4) & 0x3FFF;
+		bool underground = ind & 1;
+
+		QTreeNode* node = map.getLeaf(ndx * 4, ndy * 4);
+		if(!node) {
+			continue;
+		}
+
+		writeNode(message, node, ndx, ndy, underground ? 0xFF00 : 0x00FF);
+		interestNodes.insert(ind);
+		server->subscribe(this, ind);
+	}
+
+	uint32_t percent = 100;
+	if(!snapshotNodes.empty()) {
+		percent = std::min<size_t>((snapshotTotal - snapshotNodes.size()) * 100 / snapshotTotal, 99);
+	} else {
+		snapshotActive = false;
+		server->setSyncing(this, false);
+	}
+
+	message.write<uint8_t>(PACKET_UPDATE_OPERATION);
+	message.write<uint32_t>(percent);
+	send(message);
+}
@@ -21,7 +21,12 @@
 #include "live_socket.h"
 #include "net_connection.h"
 
+#include <unordered_set>
+#include <deque>
+#include <atomic>
+
 class LiveServer;
+class Map;
 class LivePeer : public LiveSocket
 {
 	public:
@@ -29,6 +34,9 @@ class LivePeer : public LiveSocket
 		~LivePeer();
 
 		void close();
+		// Closes the socket on its strand and waits for it, afterwards no
+		// handler touches the peer anymore and it can be deleted
+		void shutdown();
 		bool handleError(const boost::system::error_code& error);
 
 		//
@@ -44,13 +52,21 @@ class LivePeer : public LiveSocket
 		void receiveHeader();
 		void receive(uint32_t packetSize);
 		void send(NetworkMessage& message);
+		void send(const SharedNetworkMessage& message);
+		void sendCursor(const SharedNetworkMessage& message, uint32_t cursorId);
+		bool isCongested() const { return sendQueue.isCongested(); }
+
+		// Adds a node half that changed during a full sync, if it's in the requested area
+		void queueSnapshotNode(uint32_t ind);
+		// Whether the node half lies in the area and floors of the last full sync
+		bool isSnapshotNode(uint32_t ind) const;
 
 		//
 		void updateCursor(const Position& position) {}
 
 	protected:
-		void parseLoginPacket(NetworkMessage message);
-		void parseEditorPacket(NetworkMessage message);
+		void parseLoginPacket(NetworkMessage& message);
+		void parseEditorPacket(NetworkMessage& message);
 
 		// login packets
 		void parseHello(NetworkMessage& message);
@@ -64,12 +80,28 @@ class LivePeer : public LiveSocket
 		void parseRemoveHouse(NetworkMessage& message);
 		void parseCursorUpdate(NetworkMessage& message);
 		void parseChatMessage(NetworkMessage& message);
+		void parseViewportUpdate(NetworkMessage& message);
+		void parseSnapshotRequest(NetworkMessage& message);
+
+		// Logs why a packet was refused, kicks the client and closes the connection
+		void reject(const std::string& reason);
+
+		// Writes the next batch of a full sync, driven by the send queue running empty
+		void sendSnapshotChunk();
+
+		// Sends a whole node half and remembers that the client has it
+		void sendInterestNode(Map& map, uint32_t ind);
+		// Sends the next batch of missing viewport nodes
+		void sendPendingNodes();
 
 		//
 		NetworkMessage readMessage;
+		NetworkMessageQueue receivedMessages;
 
 		LiveServer* server;
 		boost::asio::ip::tcp::socket socket;
+		boost::asio::io_service::strand strand;
+		NetworkSendQueue sendQueue;
 
 		wxColor color;
 
@@ -77,6 +109,28 @@ class LivePeer : public LiveSocket
 		uint32_t clientId;
 
 		bool connected;
+		// Removed from the server, its packets are ignored until it's deleted
+		bool removed;
+
+		// LiveCompressionFlags agreed on during login
+		uint8_t compression;
+
+		// Node halves (same index as PACKET_NODE) the client currently has
+		std::unordered_set<uint32_t> interestNodes;
+		// Missing nodes of the viewport not sent yet, closest first
+		std::deque<uint32_t> pendingNodes;
+		std::atomic<bool> interestPending;
+		LiveViewport viewport;
+		bool hasViewport;
+
+		// Full sync state, set once the client asked for a snapshot
+		std::set<uint32_t> snapshotNodes;
+		LiveViewport snapshotArea;
+		uint8_t snapshotHalves;
+		size_t snapshotTotal;
+		std::atomic<bool> snapshotActive;
+		// Nodes of the synced area are never evicted, see isSnapshotNode
+		bool keepSnapshotNodes;
 
 		friend class LiveLogTab;
 		friend class LiveServer;
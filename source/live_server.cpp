@@ -25,8 +25,10 @@
 #include "editor.h"
 
 LiveServer::LiveServer(Editor& editor) : LiveSocket(),
-	clients(), acceptor(nullptr), socket(nullptr), editor(&editor),
-	clientIds(0), port(0), stopped(false)
+	clients(), closingClients(), acceptedClients(), acceptedMutex(), nextPeerId(0),
+	pendingCursors(), cursorTimer([this]() { flushCursors(); }),
+	acceptor(nullptr), socket(nullptr), strand(), editor(&editor),
+	clientIds(), port(0), stopped(false)
 {
 	//
 }
@@ -46,6 +48,7 @@ bool LiveServer::bind()
 
 	auto& service = connection.get_service();
 	acceptor = std::make_shared<boost::asio::ip::tcp::acceptor>(service);
+	strand.reset(new boost::asio::io_service::strand(service));
 
 	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), port);
 	acceptor->open(endpoint.protocol());
@@ -66,30 +69,62 @@ bool LiveServer::bind()
 
 void LiveServer::close()
 {
+	// Nothing is accepted once this has run, so the lists below are complete
+	std::function<void()> stopAccepting = [this]() {
+		*alive = false;
+		stopped = true;
+
+		boost::system::error_code error;
+		if(acceptor) {
+			acceptor->close(error);
+		}
+		if(socket) {
+			socket->close(error);
+		}
+	};
+	if(strand) {
+		NetworkConnection::getInstance().runOnStrand(*strand, stopAccepting);
+	} else {
+		stopAccepting();
+	}
+
+	// Peers are closed on their strands before they are deleted, so no read
+	// or write handler can still be running for them
 	for(auto& clientEntry : clients) {
+		clientEntry.second->shutdown();
+		delete clientEntry.second;
+	}
+	for(auto& clientEntry : closingClients) {
+		clientEntry.second->shutdown();
 		delete clientEntry.second;
 	}
+	{
+		std::lock_guard<std::mutex> lock(acceptedMutex);
+		for(LivePeer* peer : acceptedClients) {
+			delete peer;
+		}
+		acceptedClients.clear();
+	}
 	clients.clear();
+	closingClients.clear();
+	subscriptions.clear();
+	syncingPeers.clear();
+	clientIds.clear();
+
+	cursorTimer.Stop();
+	pendingCursors.clear();
 
 	if(log) {
 		log->Message("Server was shutdown.");
 		log->Disconnect();
 		log = nullptr;
-	}
-
-	stopped = true;
-	if(acceptor) {
-		acceptor->close();
-	}
-
-	if(socket) {
-		socket->close();
+	} else if(g_gui.IsHeadless()) {
+		g_gui.PrintMessage("Server was shutdown.");
 	}
 }
 
 void LiveServer::acceptClient()
 {
-	static uint32_t id = 0;
 	if(stopped) {
 		return;
 	}
@@ -100,19 +135,44 @@ void LiveServer::acceptClient()
 		);
 	}
 
-	acceptor->async_accept(*socket, [this](const boost::system::error_code& error) -> void
+	std::shared_ptr<std::atomic<bool>> serverAlive = alive;
+	acceptor->async_accept(*socket, strand->wrap([this, serverAlive](const boost::system::error_code& error) -> void
 	{
-		if(error) {
+		if(!*serverAlive || stopped) {
+			return;
+		} else if(error) {
 			//
 		} else {
-			LivePeer* peer = new LivePeer(this, std::move(*socket));
-			peer->log = log;
-			peer->receiveHeader();
+			{
+				std::lock_guard<std::mutex> lock(acceptedMutex);
+				acceptedClients.push_back(new LivePeer(this, std::move(*socket)));
+			}
 
-			clients.insert(std::make_pair(id++, peer));
+			// The client list is only touched from the UI thread
+			callAfter([this]() {
+				addAcceptedClients();
+			});
 		}
 		acceptClient();
-	});
+	}));
+}
+
+void LiveServer::addAcceptedClients()
+{
+	std::vector<LivePeer*> accepted;
+	{
+		std::lock_guard<std::mutex> lock(acceptedMutex);
+		accepted.swap(acceptedClients);
+	}
+
+	for(LivePeer* peer : accepted) {
+		peer->log = log;
+		peer->sendQueue.setHighWaterMark(g_settings.getInteger(Config::LIVE_SEND_HIGH_WATER_MARK) * 1024);
+		// The peer removes itself by this key when it disconnects
+		peer->id = nextPeerId++;
+		clients.insert(std::make_pair(peer->id, peer));
+		peer->receiveHeader();
+	}
 }
 
 void LiveServer::removeClient(uint32_t id)
@@ -122,14 +182,46 @@ void LiveServer::removeClient(uint32_t id)
 		return;
 	}
 
-	const uint32_t clientId = it->second->getClientId();
+	LivePeer* peer = it->second;
+	for(uint32_t ind : peer->interestNodes) {
+		unsubscribe(peer, ind);
+	}
+	peer->interestNodes.clear();
+	peer->pendingNodes.clear();
+	peer->interestPending = false;
+	peer->snapshotActive = false;
+	syncingPeers.erase(peer);
+
+	const uint32_t clientId = peer->getClientId();
 	if(clientId != 0) {
-		clientIds &= ~clientId;
-		editor->map.clearVisible(clientIds);
+		clientIds.erase(clientId);
 	}
 
 	clients.erase(it);
 	updateClientList();
+
+	// Whatever was queued last, a kick for example, is still written before
+	// the socket is closed and the peer deleted
+	peer->removed = true;
+	closingClients.insert(std::make_pair(id, peer));
+	peer->sendQueue.close([this, id]() {
+		callAfter([this, id]() {
+			deleteClosedClient(id);
+		});
+	});
+}
+
+void LiveServer::deleteClosedClient(uint32_t id)
+{
+	auto it = closingClients.find(id);
+	if(it == closingClients.end()) {
+		return;
+	}
+
+	LivePeer* peer = it->second;
+	closingClients.erase(it);
+	peer->shutdown();
+	delete peer;
 }
 
 void LiveServer::updateCursor(const Position& position)
@@ -148,7 +240,9 @@ void LiveServer::updateCursor(const Position& position)
 
 void LiveServer::updateClientList() const
 {
-	log->UpdateClientList(clients);
+	if(log) {
+		log->UpdateClientList(clients);
+	}
 }
 
 uint16_t LiveServer::getPort() const
@@ -168,13 +262,53 @@ bool LiveServer::setPort(int32_t newPort)
 
 uint32_t LiveServer::getFreeClientId()
 {
-	for(int32_t bit = 1; bit < (1 << 16); bit <<= 1) {
-		if(!testFlags(clientIds, bit)) {
-			clientIds |= bit;
-			return bit;
+	// Lowest unused id, 0 stands for the server itself
+	uint32_t clientId = 1;
+	for(uint32_t usedId : clientIds) {
+		if(usedId != clientId) {
+			break;
 		}
+		++clientId;
+	}
+
+	clientIds.insert(clientId);
+	return clientId;
+}
+
+void LiveServer::subscribe(LivePeer* peer, uint32_t ind)
+{
+	std::vector<LivePeer*>& subscribers = subscriptions[ind];
+	auto it = std::lower_bound(subscribers.begin(), subscribers.end(), peer);
+	if(it == subscribers.end() || *it != peer) {
+		subscribers.insert(it, peer);
+	}
+}
+
+void LiveServer::setSyncing(LivePeer* peer, bool syncing)
+{
+	if(syncing) {
+		syncingPeers.insert(peer);
+	} else {
+		syncingPeers.erase(peer);
+	}
+}
+
+void LiveServer::unsubscribe(LivePeer* peer, uint32_t ind)
+{
+	auto entry = subscriptions.find(ind);
+	if(entry == subscriptions.end()) {
+		return;
+	}
+
+	std::vector<LivePeer*>& subscribers = entry->second;
+	auto it = std::lower_bound(subscribers.begin(), subscribers.end(), peer);
+	if(it != subscribers.end() && *it == peer) {
+		subscribers.erase(it);
+	}
+
+	if(subscribers.empty()) {
+		subscriptions.erase(entry);
 	}
-	return 0;
 }
 
 std::string LiveServer::getHostName() const
@@ -202,25 +336,55 @@ void LiveServer::broadcastNodes(DirtyList& dirtyList)
 			continue;
 		}
 
-		for(auto& clientEntry : clients) {
-			LivePeer* peer = clientEntry.second;
+		for(LivePeer* peer : syncingPeers) {
+			if(floors & 0xFF00) {
+				peer->queueSnapshotNode(ind.pos | 1);
+			}
+			if(floors & 0x00FF) {
+				peer->queueSnapshotNode(ind.pos);
+			}
+		}
 
-			const uint32_t clientId = peer->getClientId();
-			if(dirtyList.owner != 0 && dirtyList.owner == clientId) {
+		// Subscribers already have all of the node, so only the changed
+		// tiles are sent. Each half of the node is serialized at most once,
+		// the same buffer is then queued on every subscriber of that half.
+		// Compressed and uncompressed variants are kept apart, since not
+		// every peer has to support compression
+		for(uint32_t underground = 0; underground < 2; ++underground) {
+			const uint32_t floorMask = floors & (underground ? 0xFF00 : 0x00FF);
+			if(floorMask == 0) {
 				continue;
 			}
 
-			if(node->isVisible(clientId, true)) {
-				peer->sendNode(clientId, node, ndx, ndy, floors & 0xFF00);
+			auto subscribers = subscriptions.find(ind.pos | underground);
+			if(subscribers == subscriptions.end()) {
+				continue;
 			}
 
-			if(node->isVisible(clientId, false)) {
-				peer->sendNode(clientId, node, ndx, ndy, floors & 0x00FF);
+			SharedNetworkMessage messages[2];
+			for(LivePeer* peer : subscribers->second) {
+				if(dirtyList.owner != 0 && dirtyList.owner == peer->getClientId()) {
+					continue;
+				}
+
+				const bool compress = peer->isCompressionEnabled();
+				SharedNetworkMessage& message = messages[compress];
+				if(!message) {
+					message = createTilesMessage(node, ndx, ndy, ind, floorMask, compress);
+				}
+				peer->send(message);
 			}
 		}
 	}
 }
 
+SharedNetworkMessage LiveServer::createTilesMessage(QTreeNode* node, int32_t ndx, int32_t ndy, const DirtyList::ValueType& dirty, uint32_t floorMask, bool compress)
+{
+	NetworkMessage message;
+	writeTiles(message, node, ndx, ndy, dirty, floorMask);
+	return prepareMessage(message, compress);
+}
+
 void LiveServer::broadcastCursor(const LiveCursor& cursor)
 {
 	if(clients.empty()) {
@@ -231,16 +395,79 @@ void LiveServer::broadcastCursor(const LiveCursor& cursor)
 		cursors[cursor.id] = cursor;
 	}
 
-	NetworkMessage message;
-	message.write<uint8_t>(PACKET_CURSOR_UPDATE);
-	writeCursor(message, cursor);
+	pendingCursors[cursor.id] = cursor;
+	if(!cursorTimer.IsRunning()) {
+		cursorTimer.StartOnce(g_settings.getInteger(Config::LIVE_CURSOR_INTERVAL));
+	}
+}
 
+void LiveServer::flushCursors()
+{
+	if(pendingCursors.empty()) {
+		return;
+	}
+
+	// Peers whose own cursor moved get the batch without it, everyone else
+	// shares one message
+	auto createMessage = [this](uint32_t excludedId) -> SharedNetworkMessage {
+		NetworkMessage message;
+		message.write<uint8_t>(PACKET_CURSOR_UPDATES);
+		message.write<uint16_t>(pendingCursors.size() - pendingCursors.count(excludedId));
+		for(const auto& cursorEntry : pendingCursors) {
+			if(cursorEntry.first != excludedId) {
+				writeCursor(message, cursorEntry.second);
+			}
+		}
+		return prepareMessage(message, false);
+	};
+
+	// A peer that is behind gets each cursor on its own instead, so a newer
+	// position replaces the one still waiting in its queue
+	std::map<uint32_t, SharedNetworkMessage> cursorMessages;
+	auto getCursorMessage = [this, &cursorMessages](const LiveCursor& cursor) -> const SharedNetworkMessage& {
+		SharedNetworkMessage& sharedCursor = cursorMessages[cursor.id];
+		if(!sharedCursor) {
+			NetworkMessage message;
+			message.write<uint8_t>(PACKET_CURSOR_UPDATES);
+			message.write<uint16_t>(1);
+			writeCursor(message, cursor);
+			sharedCursor = prepareMessage(message, false);
+		}
+		return sharedCursor;
+	};
+
+	SharedNetworkMessage sharedMessage;
 	for(auto& clientEntry : clients) {
 		LivePeer* peer = clientEntry.second;
-		if(peer->getClientId() != cursor.id) {
-			peer->send(message);
+		const uint32_t clientId = peer->getClientId();
+		if(clientId == 0) {
+			continue;
+		}
+
+		if(peer->isCongested()) {
+			for(const auto& cursorEntry : pendingCursors) {
+				if(cursorEntry.first != clientId) {
+					peer->sendCursor(getCursorMessage(cursorEntry.second), cursorEntry.first);
+				}
+			}
+		} else if(pendingCursors.count(clientId) != 0) {
+			if(pendingCursors.size() > 1) {
+				peer->send(createMessage(clientId));
+			}
+		} else {
+			if(!sharedMessage) {
+				sharedMessage = createMessage(0xFFFFFFFF);
+			}
+			peer->send(sharedMessage);
 		}
 	}
+
+	const bool remoteMoved = pendingCursors.size() > pendingCursors.count(0);
+	pendingCursors.clear();
+
+	if(remoteMoved) {
+		g_gui.RefreshViewOverlay();
+	}
 }
 
 void LiveServer::broadcastChat(const wxString& speaker, const wxString& chatMessage)
@@ -254,11 +481,23 @@ void LiveServer::broadcastChat(const wxString& speaker, const wxString& chatMess
 	message.write<std::string>(nstr(speaker));
 	message.write<std::string>(nstr(chatMessage));
 
-	for(auto& clientEntry : clients) {
-		clientEntry.second->send(message);
+	broadcast(message);
+
+	if(log) {
+		log->Chat(name, chatMessage);
+	} else {
+		logMessage(speaker + ": " + chatMessage);
 	}
+}
 
-	log->Chat(name, chatMessage);
+void LiveServer::broadcast(NetworkMessage& message)
+{
+	// Sending a NetworkMessage hands its buffer to the peer, so the same
+	// message can't go to several peers, they all share one prepared copy
+	SharedNetworkMessage sharedMessage = prepareMessage(message, false);
+	for(auto& clientEntry : clients) {
+		clientEntry.second->send(sharedMessage);
+	}
 }
 
 void LiveServer::startOperation(const wxString& operationMessage)
@@ -271,9 +510,7 @@ void LiveServer::startOperation(const wxString& operationMessage)
 	message.write<uint8_t>(PACKET_START_OPERATION);
 	message.write<std::string>(nstr(operationMessage));
 
-	for(auto& clientEntry : clients) {
-		clientEntry.second->send(message);
-	}
+	broadcast(message);
 }
 
 void LiveServer::updateOperation(int32_t percent)
@@ -286,9 +523,7 @@ void LiveServer::updateOperation(int32_t percent)
 	message.write<uint8_t>(PACKET_UPDATE_OPERATION);
 	message.write<uint32_t>(percent);
 
-	for(auto& clientEntry : clients) {
-		clientEntry.second->send(message);
-	}
+	broadcast(message);
 }
 
 LiveLogTab* LiveServer::createLogWindow(wxWindow* parent)
@@ -60,25 +60,57 @@ class LiveServer : public LiveSocket
 		}
 
 		uint32_t getFreeClientId();
+		size_t getClientCount() const { return clients.size(); }
+		size_t getSubscribedNodeCount() const { return subscriptions.size(); }
+
+		// Node halves (PACKET_NODE index) a peer has been sent, it gets their changes
+		void subscribe(LivePeer* peer, uint32_t ind);
+		void unsubscribe(LivePeer* peer, uint32_t ind);
+		// Peers in the middle of a full sync also get told about nodes changed meanwhile
+		void setSyncing(LivePeer* peer, bool syncing);
 		std::string getHostName() const;
 
 		//
+		// Sends the message to every client, uncompressed
+		void broadcast(NetworkMessage& message);
 		void broadcastNodes(DirtyList& dirtyList);
 		void broadcastChat(const wxString& speaker, const wxString& chatMessage);
+		// Cursors are collected and sent together once per tick
 		void broadcastCursor(const LiveCursor& cursor);
+		void flushCursors();
 
 		void startOperation(const wxString& operationMessage);
 		void updateOperation(int32_t percent);
 
 	protected:
+		// Moves the peers accepted on the network threads into the client list
+		void addAcceptedClients();
+		// Deletes a removed peer once everything queued for it has been written
+		void deleteClosedClient(uint32_t id);
+
+		SharedNetworkMessage createTilesMessage(QTreeNode* node, int32_t ndx, int32_t ndy, const DirtyList::ValueType& dirty, uint32_t floorMask, bool compress);
+
 		std::unordered_map<uint32_t, LivePeer*> clients;
+		// Removed peers still writing their last messages, a kick for example
+		std::unordered_map<uint32_t, LivePeer*> closingClients;
+		// Accepted on the network threads, not in the client list yet
+		std::vector<LivePeer*> acceptedClients;
+		std::mutex acceptedMutex;
+		uint32_t nextPeerId;
+		// Subscribers of every node half, sorted so lookups and removal stay cheap
+		std::unordered_map<uint32_t, std::vector<LivePeer*>> subscriptions;
+		std::set<LivePeer*> syncingPeers;
+
+		std::map<uint32_t, LiveCursor> pendingCursors;
+		LiveTimer cursorTimer;
 
 		std::shared_ptr<boost::asio::ip::tcp::acceptor> acceptor;
 		std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+		std::unique_ptr<boost::asio::io_service::strand> strand;
 
 		Editor* editor;
 
-		uint32_t clientIds;
+		std::set<uint32_t> clientIds;
 		uint16_t port;
 
 		bool stopped;
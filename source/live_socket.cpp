@@ -21,18 +21,19 @@
 #include "iomap_otbm.h"
 #include "live_tab.h"
 #include "editor.h"
+#include "gui.h"
 
 LiveSocket::LiveSocket() :
 	cursors(), mapReader(nullptr, 0), mapWriter(),
-	mapVersion(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE)), log(nullptr),
-	name("User"), password("")
+	mapVersion(MapVersion(MAP_OTBM_4, CLIENT_VERSION_NONE)), compressor(), compressionEnabled(false), log(nullptr),
+	name("User"), password(""), alive(std::make_shared<std::atomic<bool>>(true))
 {
 	//
 }
 
 LiveSocket::~LiveSocket()
 {
-	//
+	*alive = false;
 }
 
 wxString LiveSocket::getName() const
@@ -94,9 +95,21 @@ std::vector<LiveCursor> LiveSocket::getCursorList() const
 
 void LiveSocket::logMessage(const wxString& message)
 {
-	wxTheApp->CallAfter([this, message]() {
+	callAfter([this, message]() {
 		if(log) {
 			log->Message(message);
+		} else if(g_gui.IsHeadless()) {
+			g_gui.PrintMessage(message);
+		}
+	});
+}
+
+void LiveSocket::callAfter(const std::function<void()>& function)
+{
+	std::shared_ptr<std::atomic<bool>> socketAlive = alive;
+	wxTheApp->CallAfter([socketAlive, function]() {
+		if(*socketAlive) {
+			function();
 		}
 	});
 }
@@ -105,7 +118,7 @@ void LiveSocket::receiveNode(NetworkMessage& message, Editor& editor, Action* ac
 {
 	QTreeNode* node = editor.map.getLeaf(ndx * 4, ndy * 4);
 	if(!node) {
-		log->Message("Warning: Received update for unknown tile (" + std::to_string(ndx * 4) + "/" + std::to_string(ndy * 4) + "/" + (underground ? "true" : "false") + ")");
+		logMessage("Warning: Received update for unknown tile (" + std::to_string(ndx * 4) + "/" + std::to_string(ndy * 4) + "/" + (underground ? "true" : "false") + ")");
 		return;
 	}
 
@@ -124,23 +137,15 @@ void LiveSocket::receiveNode(NetworkMessage& message, Editor& editor, Action* ac
 	}
 }
 
-void LiveSocket::sendNode(uint32_t clientId, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask)
+void LiveSocket::sendNode(QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask)
 {
-	bool underground;
-	if(floorMask & 0xFF00) {
-		if(floorMask & 0x00FF) {
-			underground = false;
-		} else {
-			underground = true;
-		}
-	} else {
-		underground = false;
-	}
-
-	node->setVisible(clientId, underground, true);
-
-	// Send message
 	NetworkMessage message;
+	writeNode(message, node, ndx, ndy, floorMask);
+	send(message);
+}
+
+void LiveSocket::writeNode(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask)
+{
 	message.write<uint8_t>(PACKET_NODE);
 	message.write<uint32_t>((ndx << 18) | (ndy << 4) | ((floorMask & 0xFF00) ? 1 : 0));
 
@@ -164,8 +169,6 @@ void LiveSocket::sendNode(uint32_t clientId, QTreeNode* node, int32_t ndx, int32
 			}
 		}
 	}
-
-	send(message);
 }
 
 void LiveSocket::receiveFloor(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, int32_t z, QTreeNode* node, Floor* floor)
@@ -183,8 +186,8 @@ void LiveSocket::receiveFloor(NetworkMessage& message, Editor& editor, Action* a
 	}
 
 	// -1 on address since we skip the first START_NODE when sending
-	const std::string& data = message.read<std::string>();
-	mapReader.assign(reinterpret_cast<const uint8_t*>(data.c_str() - 1), data.size());
+	const NetworkSpan data = message.readSpan();
+	mapReader.assign(data.data - 1, data.size);
 
 	BinaryNode* rootNode = mapReader.getRootNode();
 	BinaryNode* tileNode = rootNode->getChild();
@@ -236,11 +239,100 @@ void LiveSocket::sendFloor(NetworkMessage& message, Floor* floor)
 	}
 	mapWriter.endNode();
 
-	std::string stream(
-		reinterpret_cast<char*>(mapWriter.getMemory()),
-		mapWriter.getSize()
-	);
-	message.write<std::string>(stream);
+	message.writeSpan(mapWriter.getMemory(), mapWriter.getSize());
+}
+
+void LiveSocket::receiveTiles(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy)
+{
+	Map& map = editor.map;
+
+	uint16_t floorBits = message.read<uint16_t>();
+	for(uint_fast8_t z = 0; z < 16; ++z) {
+		if(!testFlags(floorBits, static_cast<uint64_t>(1) << z)) {
+			continue;
+		}
+
+		uint16_t changedBits = message.read<uint16_t>();
+		uint16_t tileBits = message.read<uint16_t>();
+
+		BinaryNode* tileNode = nullptr;
+		if(tileBits != 0) {
+			// -1 on address since we skip the first START_NODE when sending
+			const NetworkSpan data = message.readSpan();
+			mapReader.assign(data.data - 1, data.size);
+			tileNode = mapReader.getRootNode()->getChild();
+		}
+
+		Position position(0, 0, z);
+		for(uint_fast8_t x = 0; x < 4; ++x) {
+			for(uint_fast8_t y = 0; y < 4; ++y) {
+				const uint64_t bit = static_cast<uint64_t>(1) << ((x * 4) + y);
+				if(!testFlags(changedBits, bit)) {
+					continue;
+				}
+
+				position.x = (ndx * 4) + x;
+				position.y = (ndy * 4) + y;
+				if(testFlags(tileBits, bit)) {
+					receiveTile(tileNode, editor, action, &position);
+					tileNode->advance();
+				} else {
+					action->addChange(newd Change(map.allocator(map.createTileL(position))));
+				}
+			}
+		}
+
+		if(tileBits != 0) {
+			mapReader.close();
+		}
+	}
+}
+
+void LiveSocket::writeTiles(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, const DirtyList::ValueType& dirty, uint32_t floorMask)
+{
+	message.write<uint8_t>(PACKET_TILES);
+	message.write<uint32_t>((ndx << 18) | (ndy << 4) | ((floorMask & 0xFF00) ? 1 : 0));
+
+	const uint16_t floorBits = dirty.floors & floorMask;
+	message.write<uint16_t>(floorBits);
+
+	Floor** floors = node->getFloors();
+	for(uint32_t z = 0; z < 16; ++z) {
+		if(!testFlags(floorBits, static_cast<uint64_t>(1) << z)) {
+			continue;
+		}
+
+		// Changed tiles that are empty now are only flagged in changedBits
+		Floor* floor = floors[z];
+		uint16_t changedBits = dirty.tiles[z];
+		uint16_t tileBits = 0;
+		for(uint_fast8_t index = 0; index < 16; ++index) {
+			if(!floor || !testFlags(changedBits, static_cast<uint64_t>(1) << index)) {
+				continue;
+			}
+
+			Tile* tile = floor->locs[index].get();
+			if(tile && tile->size() > 0) {
+				tileBits |= (1 << index);
+			}
+		}
+
+		message.write<uint16_t>(changedBits);
+		message.write<uint16_t>(tileBits);
+		if(tileBits == 0) {
+			continue;
+		}
+
+		mapWriter.reset();
+		for(uint_fast8_t index = 0; index < 16; ++index) {
+			if(testFlags(tileBits, static_cast<uint64_t>(1) << index)) {
+				sendTile(mapWriter, floor->locs[index].get(), nullptr);
+			}
+		}
+		mapWriter.endNode();
+
+		message.writeSpan(mapWriter.getMemory(), mapWriter.getSize());
+	}
 }
 
 void LiveSocket::receiveTile(BinaryNode* node, Editor& editor, Action* action, const Position* position)
@@ -384,6 +476,18 @@ Tile* LiveSocket::readTile(BinaryNode* node, Editor& editor, const Position* pos
 	return tile;
 }
 
+SharedNetworkMessage LiveSocket::prepareMessage(NetworkMessage& message, bool compress)
+{
+	memcpy(&message.buffer[0], &message.size, 4);
+	if(compress) {
+		std::shared_ptr<NetworkMessage> compressed = std::make_shared<NetworkMessage>();
+		if(compressor.compress(message, *compressed)) {
+			return compressed;
+		}
+	}
+	return std::make_shared<NetworkMessage>(std::move(message));
+}
+
 LiveCursor LiveSocket::readCursor(NetworkMessage& message)
 {
 	LiveCursor cursor;
@@ -408,3 +512,23 @@ void LiveSocket::writeCursor(NetworkMessage& message, const LiveCursor& cursor)
 	message.write<uint8_t>(cursor.color.Alpha());
 	message.write<Position>(cursor.pos);
 }
+
+LiveViewport LiveSocket::readViewport(NetworkMessage& message)
+{
+	LiveViewport viewport;
+	viewport.startX = message.read<uint16_t>();
+	viewport.startY = message.read<uint16_t>();
+	viewport.endX = message.read<uint16_t>();
+	viewport.endY = message.read<uint16_t>();
+	viewport.floor = message.read<uint8_t>();
+	return viewport;
+}
+
+void LiveSocket::writeViewport(NetworkMessage& message, const LiveViewport& viewport)
+{
+	message.write<uint16_t>(viewport.startX);
+	message.write<uint16_t>(viewport.startY);
+	message.write<uint16_t>(viewport.endX);
+	message.write<uint16_t>(viewport.endY);
+	message.write<uint8_t>(viewport.floor);
+}
@@ -23,7 +23,10 @@
 #include "live_packets.h"
 #include "filehandle.h"
 #include "iomap.h"
+#include "action.h"
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <unordered_map>
 
@@ -37,6 +40,28 @@ struct LiveCursor
 	Position pos;
 };
 
+// Tile area a client is looking at, the server streams nodes around it
+struct LiveViewport
+{
+	int32_t startX;
+	int32_t startY;
+	int32_t endX;
+	int32_t endY;
+	int32_t floor;
+};
+
+// One-shot timer calling back on the UI thread, cursors are sent on it
+class LiveTimer : public wxTimer
+{
+	public:
+		explicit LiveTimer(const std::function<void()>& callback) : wxTimer(), callback(callback) {}
+
+		void Notify() { callback(); }
+
+	private:
+		std::function<void()> callback;
+};
+
 class LiveSocket
 {
 	public:
@@ -58,6 +83,10 @@ class LiveSocket
 
 		//
 		void logMessage(const wxString& message);
+		// Runs function on the UI thread, unless the socket was closed by then
+		void callAfter(const std::function<void()>& function);
+
+		bool isCompressionEnabled() const { return compressionEnabled; }
 
 		//
 		virtual void receiveHeader() = 0;
@@ -70,20 +99,31 @@ class LiveSocket
 	protected:
 		// receive / send methods
 		void receiveNode(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, bool underground);
-		void sendNode(uint32_t clientId, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask);
+		void sendNode(QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask);
+		void writeNode(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, uint32_t floorMask);
 
 		void receiveFloor(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy, int32_t z, QTreeNode* node, Floor* floor);
 		void sendFloor(NetworkMessage& message, Floor* floor);
 
+		// Only the tiles that changed since the node was sent, see PACKET_TILES
+		void receiveTiles(NetworkMessage& message, Editor& editor, Action* action, int32_t ndx, int32_t ndy);
+		void writeTiles(NetworkMessage& message, QTreeNode* node, int32_t ndx, int32_t ndy, const DirtyList::ValueType& dirty, uint32_t floorMask);
+
 		void receiveTile(BinaryNode* node, Editor& editor, Action* action, const Position* position);
 		void sendTile(MemoryNodeFileWriteHandle& writer, Tile* tile, const Position* position);
 
+		// Writes the size header and compresses the payload when it's worth it
+		SharedNetworkMessage prepareMessage(NetworkMessage& message, bool compress);
+
 		// read / write types
 		Tile* readTile(BinaryNode* node, Editor& editor, const Position* position);
 
 		LiveCursor readCursor(NetworkMessage& message);
 		void writeCursor(NetworkMessage& message, const LiveCursor& cursor);
 
+		LiveViewport readViewport(NetworkMessage& message);
+		void writeViewport(NetworkMessage& message, const LiveViewport& viewport);
+
 		//
 		std::unordered_map<uint32_t, LiveCursor> cursors;
 
@@ -91,12 +131,19 @@ class LiveSocket
 		MemoryNodeFileWriteHandle mapWriter;
 		VirtualIOMap mapVersion;
 
+		NetworkCompressor compressor;
+		bool compressionEnabled;
+
 		LiveLogTab* log;
 
 		wxString name;
 		wxString password;
 		wxString lastError;
 
+		// Cleared once the socket was closed on its strand, every handler and
+		// call queued for the UI thread checks it before touching the socket
+		std::shared_ptr<std::atomic<bool>> alive;
+
 		friend class LiveLogTab;
 };
 
@@ -221,7 +221,7 @@ void LiveLogTab::UpdateClientList(const std::unordered_map<uint32_t, LivePeer*>&
 	for(auto& clientEntry : clients) {
 		LivePeer* peer = clientEntry.second;
 		user_list->SetCellBackgroundColour(i, 0, peer->getUsedColor());
-		user_list->SetCellValue(i, 1, i2ws((peer->getClientId() >> 1) + 1));
+		user_list->SetCellValue(i, 1, i2ws(peer->getClientId()));
 		user_list->SetCellValue(i, 2, peer->getName());
 		++i;
 	}
@@ -36,6 +36,7 @@
 #include "materials.h"
 #include "live_client.h"
 #include "live_server.h"
+#include "unreachable_tiles.h"
 
 BEGIN_EVENT_TABLE(MainMenuBar, wxEvtHandler)
 END_EVENT_TABLE()
@@ -1377,48 +1378,17 @@ namespace OnMapRemoveUnreachable
 {
 	struct condition
 	{
-		condition() {}
-
-		bool isReachable(Tile* tile)
-		{
-			if(tile == nullptr)
-				return false;
-			if(!tile->isBlocking())
-				return true;
-			return false;
-		}
+		condition(Map& map) : tiles(map) {}
 
 		bool operator()(Map& map, Tile* tile, long long removed, long long done, long long total)
 		{
 			if(done % 0x1000 == 0)
 				g_gui.SetLoadDone((unsigned int)(100 * done / total));
 
-			Position pos = tile->getPosition();
-			int sx = std::max(pos.x - 10, 0);
-			int ex = std::min(pos.x + 10, 65535);
-			int sy = std::max(pos.y - 8,  0);
-			int ey = std::min(pos.y + 8,  65535);
-			int sz, ez;
-
-			if(pos.z < 8) {
-				sz = 0;
-				ez = 9;
-			} else {
-				// underground
-				sz = std::max(pos.z - 2, GROUND_LAYER);
-				ez = std::min(pos.z + 2, MAP_MAX_LAYER);
-			}
-
-			for(int z = sz; z <= ez; ++z) {
-				for(int y = sy; y <= ey; ++y) {
-					for(int x = sx; x <= ex; ++x) {
-						if(isReachable(map.getTile(x, y, z)))
-							return false;
-					}
-				}
-			}
-			return true;
+			return tiles.isUnreachable(tile->getPosition());
 		}
+
+		UnreachableTiles tiles;
 	};
 }
 
@@ -1433,8 +1403,8 @@ void MainMenuBar::OnMapRemoveUnreachable(wxCommandEvent& WXUNUSED(event))
 		g_gui.GetCurrentEditor()->selection.clear();
 		g_gui.GetCurrentEditor()->actionQueue->clear();
 
-		OnMapRemoveUnreachable::condition func;
 		g_gui.CreateLoadBar("Searching map for tiles to remove...");
+		OnMapRemoveUnreachable::condition func(g_gui.GetCurrentMap());
 
 		long long removed = remove_if_TileOnMap(g_gui.GetCurrentMap(), func);
 
@@ -1533,214 +1503,11 @@ void MainMenuBar::OnMapStatistics(wxCommandEvent& WXUNUSED(event))
 	if(!g_gui.IsEditorOpen())
 		return;
 
-	g_gui.CreateLoadBar("Collecting data...");
-
-	Map* map = &g_gui.GetCurrentMap();
-
-	int load_counter = 0;
-
-	uint64_t tile_count = 0;
-	uint64_t detailed_tile_count = 0;
-	uint64_t blocking_tile_count = 0;
-	uint64_t walkable_tile_count = 0;
-	double percent_pathable = 0.0;
-	double percent_detailed = 0.0;
-	uint64_t spawn_monster_count = 0;
-	uint64_t spawn_npc_count = 0;
-	uint64_t monster_count = 0;
-	uint64_t npc_count = 0;
-	double monsters_per_spawn = 0.0;
-	double npcs_per_spawn = 0.0;
-
-	uint64_t item_count = 0;
-	uint64_t loose_item_count = 0;
-	uint64_t depot_count = 0;
-	uint64_t action_item_count = 0;
-	uint64_t unique_item_count = 0;
-	uint64_t container_count = 0; // Only includes containers containing more than 1 item
-
-	int town_count = map->towns.count();
-	int house_count = map->houses.count();
-	std::map<uint32_t, uint32_t> town_sqm_count;
-	const Town* largest_town = nullptr;
-	uint64_t largest_town_size = 0;
-	uint64_t total_house_sqm = 0;
-	const House* largest_house = nullptr;
-	uint64_t largest_house_size = 0;
-	double houses_per_town = 0.0;
-	double sqm_per_house = 0.0;
-	double sqm_per_town = 0.0;
-
-	for(MapIterator mit = map->begin(); mit != map->end(); ++mit) {
-		Tile* tile = (*mit)->get();
-		if(load_counter % 8192 == 0) {
-			g_gui.SetLoadDone((unsigned int)(int64_t(load_counter) * 95ll / int64_t(map->getTileCount())));
-		}
-
-		if(tile->empty())
-			continue;
-
-		tile_count += 1;
-
-		bool is_detailed = false;
-#define ANALYZE_ITEM(_item) {\
-	item_count += 1; \
-	if(!(_item)->isGroundTile() && !(_item)->isBorder()) { \
-		is_detailed = true; \
-		ItemType& it = g_items[(_item)->getID()]; \
-		if(it.moveable) { \
-			loose_item_count += 1; \
-		} \
-		if(it.isDepot()) { \
-			depot_count += 1; \
-		} \
-		if((_item)->getActionID() > 0) { \
-			action_item_count += 1; \
-		} \
-		if((_item)->getUniqueID() > 0) { \
-			unique_item_count += 1; \
-		} \
-		if(Container* c = dynamic_cast<Container*>((_item))) { \
-			if(c->getVector().size()) { \
-				container_count += 1; \
-			} \
-		} \
-	} \
-}
-
-		if(tile->ground) {
-			ANALYZE_ITEM(tile->ground);
-		}
-
-		for(ItemVector::const_iterator item_iter = tile->items.begin(); item_iter != tile->items.end(); ++item_iter) {
-			Item* item = *item_iter;
-			ANALYZE_ITEM(item);
-		}
-#undef ANALYZE_ITEM
-
-		if(tile->spawnMonster)
-			spawn_monster_count += 1;
-		
-		if(tile->spawnNpc)
-			spawn_npc_count += 1;
-
-		if(tile->monster)
-			monster_count += 1;
-
-		if(tile->npc)
-			npc_count += 1;
-
-		if(tile->isBlocking())
-			blocking_tile_count += 1;
-		else
-			walkable_tile_count += 1;
-
-		if(is_detailed)
-			detailed_tile_count += 1;
-
-		load_counter += 1;
-	}
-
-	monsters_per_spawn = (spawn_monster_count != 0? double(monster_count) / double(spawn_monster_count) : -1.0);
-	npcs_per_spawn = (spawn_npc_count != 0? double(npc_count) / double(spawn_npc_count) : -1.0);
-	percent_pathable = 100.0*(tile_count != 0? double(walkable_tile_count) / double(tile_count) : -1.0);
-	percent_detailed = 100.0*(tile_count != 0? double(detailed_tile_count) / double(tile_count) : -1.0);
-
-	load_counter = 0;
-	Houses& houses = map->houses;
-	for(HouseMap::const_iterator hit = houses.begin(); hit != houses.end(); ++hit) {
-		const House* house = hit->second;
-
-		if(load_counter % 64)
-			g_gui.SetLoadDone((unsigned int)(95ll + int64_t(load_counter) * 5ll / int64_t(house_count)));
-
-		if(house->size() > largest_house_size) {
-			largest_house = house;
-			largest_house_size = house->size();
-		}
-		total_house_sqm += house->size();
-		town_sqm_count[house->townid] += house->size();
-	}
-
-	houses_per_town = (town_count != 0?  double(house_count) /     double(town_count)  : -1.0);
-	sqm_per_house   = (house_count != 0? double(total_house_sqm) / double(house_count) : -1.0);
-	sqm_per_town    = (town_count != 0?  double(total_house_sqm) / double(town_count)  : -1.0);
-
-	Towns& towns = map->towns;
-	for(std::map<uint32_t, uint32_t>::iterator town_iter = town_sqm_count.begin();
-			town_iter != town_sqm_count.end();
-			++town_iter)
-	{
-		// No load bar for this, load is non-existant
-		uint32_t town_id = town_iter->first;
-		uint32_t town_sqm = town_iter->second;
-		Town* town = towns.getTown(town_id);
-		if(town && town_sqm > largest_town_size) {
-			largest_town = town;
-			largest_town_size = town_sqm;
-		} else {
-			// Non-existant town!
-		}
-	}
-
-	g_gui.DestroyLoadBar();
-
-	std::ostringstream os;
-	os.setf(std::ios::fixed, std::ios::floatfield);
-	os.precision(2);
-	os << "Map statistics for the map \"" << map->getMapDescription() << "\"\n";
-	os << "\tTile data:\n";
-	os << "\t\tTotal number of tiles: " << tile_count << "\n";
-	os << "\t\tNumber of pathable tiles: " << walkable_tile_count << "\n";
-	os << "\t\tNumber of unpathable tiles: " << blocking_tile_count << "\n";
-	if(percent_pathable >= 0.0)
-		os << "\t\tPercent walkable tiles: " << percent_pathable << "%\n";
-	os << "\t\tDetailed tiles: " << detailed_tile_count << "\n";
-	if(percent_detailed >= 0.0)
-		os << "\t\tPercent detailed tiles: " << percent_detailed << "%\n";
-
-	os << "\tItem data:\n";
-	os << "\t\tTotal number of items: " << item_count << "\n";
-	os << "\t\tNumber of moveable tiles: " << loose_item_count << "\n";
-	os << "\t\tNumber of depots: " << depot_count << "\n";
-	os << "\t\tNumber of containers: " << container_count << "\n";
-	os << "\t\tNumber of items with Action ID: " << action_item_count << "\n";
-	os << "\t\tNumber of items with Unique ID: " << unique_item_count << "\n";
-
-	os << "\tMonster data:\n";
-	os << "\t\tTotal monster count: " << monster_count << "\n";
-	os << "\t\tTotal monster spawn count: " << spawn_monster_count << "\n";
-	os << "\t\tTotal npc count: " << npc_count << "\n";
-	os << "\t\tTotal npc spawn count: " << spawn_npc_count << "\n";
-	if(monsters_per_spawn >= 0)
-		os << "\t\tMean monsters per spawn: " << monsters_per_spawn << "\n";
-	
-	if(npcs_per_spawn >= 0)
-		os << "\t\tMean npcs per spawn: " << npcs_per_spawn << "\n";
-
-	os << "\tTown/House data:\n";
-	os << "\t\tTotal number of towns: " << town_count << "\n";
-	os << "\t\tTotal number of houses: " << house_count << "\n";
-	if(houses_per_town >= 0)
-		os << "\t\tMean houses per town: " << houses_per_town << "\n";
-	os << "\t\tTotal amount of housetiles: " << total_house_sqm << "\n";
-	if(sqm_per_house >= 0)
-		os << "\t\tMean tiles per house: " << sqm_per_house << "\n";
-	if(sqm_per_town >= 0)
-		os << "\t\tMean tiles per town: " << sqm_per_town << "\n";
-
-	if(largest_town)
-		os << "\t\tLargest Town: \"" << largest_town->getName() << "\" (" << largest_town_size << " sqm)\n";
-	if(largest_house)
-		os << "\t\tLargest House: \"" << largest_house->name << "\" (" << largest_house_size << " sqm)\n";
-
-	os << "\n";
-	os << "Generated by Remere's Map Editor version " + __RME_VERSION__ + "\n";
-
+	const std::string report = g_gui.GetCurrentMap().getStatisticsReport();
 
     wxDialog* dg = newd wxDialog(frame, wxID_ANY, "Map Statistics", wxDefaultPosition, wxDefaultSize, wxRESIZE_BORDER | wxCAPTION | wxCLOSE_BOX);
 	wxSizer* topsizer = newd wxBoxSizer(wxVERTICAL);
-	wxTextCtrl* text_field = newd wxTextCtrl(dg, wxID_ANY, wxstr(os.str()), wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE | wxTE_READONLY);
+	wxTextCtrl* text_field = newd wxTextCtrl(dg, wxID_ANY, wxstr(report), wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE | wxTE_READONLY);
 	text_field->SetMinSize(wxSize(400, 300));
 	topsizer->Add(text_field, wxSizerFlags(5).Expand());
 
@@ -2057,6 +1824,10 @@ void MainMenuBar::OnJoinLive(wxCommandEvent& event)
 
 	top_sizer->Add(gsizer, 0, wxALL, 20);
 
+	wxCheckBox* full_sync;
+	top_sizer->Add(full_sync = newd wxCheckBox(live_join_dlg, wxID_ANY, "Download the whole map when joining."), 0, wxRIGHT | wxLEFT, 20);
+	full_sync->SetToolTip("Streams the complete map right away instead of loading areas as you scroll to them.");
+
 	wxSizer* ok_sizer = newd wxBoxSizer(wxHORIZONTAL);
 	ok_sizer->Add(newd wxButton(live_join_dlg, wxID_OK, "OK"), 1, wxRIGHT);
 	ok_sizer->Add(newd wxButton(live_join_dlg, wxID_CANCEL, "Cancel"), 1, wxRIGHT);
@@ -2075,6 +1846,7 @@ void MainMenuBar::OnJoinLive(wxCommandEvent& event)
 				tmp = "User";
 			}
 			liveClient->setName(tmp);
+			liveClient->setFullSync(full_sync->GetValue());
 
 			const wxString& error = liveClient->getLastError();
 			if(!error.empty()) {
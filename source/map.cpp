@@ -20,6 +20,7 @@
 #include "gui.h" // loadbar
 
 #include "map.h"
+#include "minimap_export.h"
 
 #include <sstream>
 
@@ -27,6 +28,7 @@ Map::Map() : BaseMap(),
 	width(512),
 	height(512),
 	houses(*this),
+	minimap_cache(*this),
 	has_changed(false),
 	unnamed(false),
 	waypoints(*this)
@@ -48,6 +50,7 @@ bool Map::open(const std::string file)
 		return true; // Do not reopen ourselves!
 
 	tilecount = 0;
+	statistics.clear();
 
 	IOMapOTBM maploader(getVersion());
 
@@ -264,6 +267,10 @@ bool Map::convert(const ConversionMap& rm, bool showdialog)
 		}
 	}
 
+	// Items were swapped in place, the counters can't be patched with deltas
+	statistics.recount(*this);
+	minimap_cache.clear();
+
 	if(showdialog)
 		g_gui.DestroyLoadBar();
 
@@ -299,10 +306,138 @@ void Map::cleanInvalidTiles(bool showdialog)
 		}
 	}
 
+	// Items were swapped in place, the counters can't be patched with deltas
+	statistics.recount(*this);
+	minimap_cache.clear();
+
 	if(showdialog)
 		g_gui.DestroyLoadBar();
 }
 
+std::string Map::getStatisticsReport()
+{
+	// Tile, item and creature counters are kept up to date by the map itself
+	uint64_t tile_count = statistics.tile_count;
+	uint64_t detailed_tile_count = statistics.detailed_tile_count;
+	uint64_t blocking_tile_count = statistics.blocking_tile_count;
+	uint64_t walkable_tile_count = statistics.walkable_tile_count;
+	double percent_pathable = 0.0;
+	double percent_detailed = 0.0;
+	uint64_t spawn_monster_count = statistics.spawn_monster_count;
+	uint64_t spawn_npc_count = statistics.spawn_npc_count;
+	uint64_t monster_count = statistics.monster_count;
+	uint64_t npc_count = statistics.npc_count;
+	double monsters_per_spawn = 0.0;
+	double npcs_per_spawn = 0.0;
+
+	uint64_t item_count = statistics.item_count;
+	uint64_t loose_item_count = statistics.loose_item_count;
+	uint64_t depot_count = statistics.depot_count;
+	uint64_t action_item_count = statistics.action_item_count;
+	uint64_t unique_item_count = statistics.unique_item_count;
+	uint64_t container_count = statistics.container_count; // Only includes containers containing more than 1 item
+
+	int town_count = towns.count();
+	int house_count = houses.count();
+	std::map<uint32_t, uint32_t> town_sqm_count;
+	const Town* largest_town = nullptr;
+	uint64_t largest_town_size = 0;
+	uint64_t total_house_sqm = 0;
+	const House* largest_house = nullptr;
+	uint64_t largest_house_size = 0;
+	double houses_per_town = 0.0;
+	double sqm_per_house = 0.0;
+	double sqm_per_town = 0.0;
+
+	monsters_per_spawn = (spawn_monster_count != 0? double(monster_count) / double(spawn_monster_count) : -1.0);
+	npcs_per_spawn = (spawn_npc_count != 0? double(npc_count) / double(spawn_npc_count) : -1.0);
+	percent_pathable = 100.0*(tile_count != 0? double(walkable_tile_count) / double(tile_count) : -1.0);
+	percent_detailed = 100.0*(tile_count != 0? double(detailed_tile_count) / double(tile_count) : -1.0);
+
+	for(HouseMap::const_iterator hit = houses.begin(); hit != houses.end(); ++hit) {
+		const House* house = hit->second;
+
+		if(house->size() > largest_house_size) {
+			largest_house = house;
+			largest_house_size = house->size();
+		}
+		total_house_sqm += house->size();
+		town_sqm_count[house->townid] += house->size();
+	}
+
+	houses_per_town = (town_count != 0?  double(house_count) /     double(town_count)  : -1.0);
+	sqm_per_house   = (house_count != 0? double(total_house_sqm) / double(house_count) : -1.0);
+	sqm_per_town    = (town_count != 0?  double(total_house_sqm) / double(town_count)  : -1.0);
+
+	for(std::map<uint32_t, uint32_t>::iterator town_iter = town_sqm_count.begin();
+			town_iter != town_sqm_count.end();
+			++town_iter)
+	{
+		uint32_t town_id = town_iter->first;
+		uint32_t town_sqm = town_iter->second;
+		Town* town = towns.getTown(town_id);
+		if(town && town_sqm > largest_town_size) {
+			largest_town = town;
+			largest_town_size = town_sqm;
+		} else {
+			// Non-existant town!
+		}
+	}
+
+	std::ostringstream os;
+	os.setf(std::ios::fixed, std::ios::floatfield);
+	os.precision(2);
+	os << "Map statistics for the map \"" << getMapDescription() << "\"\n";
+	os << "\tTile data:\n";
+	os << "\t\tTotal number of tiles: " << tile_count << "\n";
+	os << "\t\tNumber of pathable tiles: " << walkable_tile_count << "\n";
+	os << "\t\tNumber of unpathable tiles: " << blocking_tile_count << "\n";
+	if(percent_pathable >= 0.0)
+		os << "\t\tPercent walkable tiles: " << percent_pathable << "%\n";
+	os << "\t\tDetailed tiles: " << detailed_tile_count << "\n";
+	if(percent_detailed >= 0.0)
+		os << "\t\tPercent detailed tiles: " << percent_detailed << "%\n";
+
+	os << "\tItem data:\n";
+	os << "\t\tTotal number of items: " << item_count << "\n";
+	os << "\t\tNumber of moveable tiles: " << loose_item_count << "\n";
+	os << "\t\tNumber of depots: " << depot_count << "\n";
+	os << "\t\tNumber of containers: " << container_count << "\n";
+	os << "\t\tNumber of items with Action ID: " << action_item_count << "\n";
+	os << "\t\tNumber of items with Unique ID: " << unique_item_count << "\n";
+
+	os << "\tMonster data:\n";
+	os << "\t\tTotal monster count: " << monster_count << "\n";
+	os << "\t\tTotal monster spawn count: " << spawn_monster_count << "\n";
+	os << "\t\tTotal npc count: " << npc_count << "\n";
+	os << "\t\tTotal npc spawn count: " << spawn_npc_count << "\n";
+	if(monsters_per_spawn >= 0)
+		os << "\t\tMean monsters per spawn: " << monsters_per_spawn << "\n";
+	
+	if(npcs_per_spawn >= 0)
+		os << "\t\tMean npcs per spawn: " << npcs_per_spawn << "\n";
+
+	os << "\tTown/House data:\n";
+	os << "\t\tTotal number of towns: " << town_count << "\n";
+	os << "\t\tTotal number of houses: " << house_count << "\n";
+	if(houses_per_town >= 0)
+		os << "\t\tMean houses per town: " << houses_per_town << "\n";
+	os << "\t\tTotal amount of housetiles: " << total_house_sqm << "\n";
+	if(sqm_per_house >= 0)
+		os << "\t\tMean tiles per house: " << sqm_per_house << "\n";
+	if(sqm_per_town >= 0)
+		os << "\t\tMean tiles per town: " << sqm_per_town << "\n";
+
+	if(largest_town)
+		os << "\t\tLargest Town: \"" << largest_town->getName() << "\" (" << largest_town_size << " sqm)\n";
+	if(largest_house)
+		os << "\t\tLargest House: \"" << largest_house->name << "\" (" << largest_house_size << " sqm)\n";
+
+	os << "\n";
+	os << "Generated by Remere's Map Editor version " + __RME_VERSION__ + "\n";
+	return os.str();
+}
+
 MapVersion Map::getVersion() const
 {
 	return mapVersion;
@@ -576,148 +711,8 @@ SpawnNpcList Map::getSpawnNpcList(Tile* where)
 
 bool Map::exportMinimap(FileName filename, int floor /*= GROUND_LAYER*/, bool displaydialog)
 {
-	uint8_t* pic = nullptr;
-
-	try
-	{
-		int min_x = 0x10000, min_y = 0x10000;
-		int max_x = 0x00000, max_y = 0x00000;
-
-		if(size() == 0)
-			return true;
-
-		for(MapIterator mit = begin(); mit != end(); ++mit) {
-			if((*mit)->get() == nullptr || (*mit)->empty())
-				continue;
-
-			Position pos = (*mit)->getPosition();
-
-			if(pos.x < min_x)
-				min_x = pos.x;
-
-			if(pos.y < min_y)
-				min_y = pos.y;
-
-			if(pos.x > max_x)
-				max_x = pos.x;
-
-			if(pos.y > max_y)
-				max_y = pos.y;
-
-		}
-
-		int minimap_width = max_x - min_x+1;
-		int minimap_height = max_y - min_y+1;
-
-		pic = newd uint8_t[minimap_width*minimap_height]; // 1 byte per pixel
-
-		memset(pic, 0, minimap_width*minimap_height);
-
-		int tiles_iterated = 0;
-		for(MapIterator mit = begin(); mit != end(); ++mit) {
-			Tile* tile = (*mit)->get();
-			++tiles_iterated;
-			if(tiles_iterated % 8192 == 0 && displaydialog)
-				g_gui.SetLoadDone(int(tiles_iterated / double(tilecount) * 90.0));
-
-			if(tile->empty() || tile->getZ() != floor)
-				continue;
-
-			//std::cout << "Pixel : " << (tile->getY() - min_y) * width + (tile->getX() - min_x) << std::endl;
-			uint32_t pixelpos = (tile->getY() - min_y) * minimap_width + (tile->getX() - min_x);
-			uint8_t& pixel = pic[pixelpos];
-
-			for(ItemVector::const_reverse_iterator item_iter = tile->items.rbegin(); item_iter != tile->items.rend(); ++item_iter) {
-				if((*item_iter)->getMiniMapColor()) {
-					pixel = (*item_iter)->getMiniMapColor();
-					break;
-				}
-			}
-			if(pixel == 0)
-				// check ground too
-				if(tile->hasGround())
-					pixel = tile->ground->getMiniMapColor();
-		}
-
-		// Create a file for writing
-		FileWriteHandle fh(nstr(filename.GetFullPath()));
-
-		if(!fh.isOpen()) {
-			delete[] pic;
-			return false;
-		}
-		// Store the magic number
-		fh.addRAW("BM");
-
-		// Store the file size
-		// We need to predict how large it will be
-		uint32_t file_size =
-					14 // header
-					+40 // image data header
-					+256*4 // color palette
-					+((minimap_width + 3) / 4 * 4) * height; // pixels
-		fh.addU32(file_size);
-
-		// Two values reserved, must always be 0.
-		fh.addU16(0);
-		fh.addU16(0);
-
-		// Bitmapdata offset
-		fh.addU32(14 + 40 + 256*4);
-
-		// Header size
-		fh.addU32(40);
-
-		// Header width/height
-		fh.addU32(minimap_width);
-		fh.addU32(minimap_height);
-
-		// Color planes
-		fh.addU16(1);
-
-		// bits per pixel, OT map format is 8
-		fh.addU16(8);
-
-		// compression type, 0 is no compression
-		fh.addU32(0);
-
-		// image size, 0 is valid if we use no compression
-		fh.addU32(0);
-
-		// horizontal/vertical resolution in pixels / meter
-		fh.addU32(4000);
-		fh.addU32(4000);
-
-		// Number of colors
-		fh.addU32(256);
-		// Important colors, 0 is all
-		fh.addU32(0);
-
-		// Write the color palette
-		for(int i = 0; i < 256; ++i)
-			fh.addU32(uint32_t(minimap_color[i]));
-
-		// Bitmap width must be divisible by four, calculate how much padding we need
-		int padding = ((minimap_width & 3) != 0? 4-(minimap_width & 3) : 0);
-		// Bitmap rows are saved in reverse order
-		for(int y = minimap_height-1; y >= 0; --y) {
-			fh.addRAW(pic + y*minimap_width, minimap_width);
-			for(int i = 0; i < padding; ++i) {
-				fh.addU8(0);
-			}
-			if(y % 100 == 0 && displaydialog) {
-				g_gui.SetLoadDone(90 + int((minimap_height-y) / double(minimap_height) * 10.0));
-			}
-		}
-
-		delete[] pic;
-		//fclose(file);
-		fh.close();
-	}
-	catch(...)
-	{
-		delete[] pic;
-	}
-
-	return true;
+	MinimapExporter exporter(*this);
+	if(!exporter.computeBounds())
+		return true;
+	return exporter.exportFloor(filename, floor, displaydialog);
 }
@@ -27,6 +27,8 @@
 #include "waypoints.h"
 #include "templates.h"
 #include "spawn_npc.h"
+#include "map_statistics.h"
+#include "minimap_cache.h"
 
 class Map : public BaseMap
 {
@@ -47,6 +49,8 @@ public:
 	// Query information about the map
 
 	MapVersion getVersion() const;
+	// Counters, towns and houses as the statistics dialog lists them
+	std::string getStatisticsReport();
 	// Returns true if any change has been done since last save
 	bool hasChanged() const;
 	// Makes a change, doesn't matter what. Just so that it asks when saving (Also adds a * to the window title)
@@ -134,6 +138,8 @@ public:
 	Houses houses;
 	SpawnsMonster spawnsMonster;
 	SpawnsNpc spawnsNpc;
+	MapStatistics statistics;
+	MinimapCache minimap_cache;
 
 protected:
 	bool has_changed; // If the map has changed
@@ -216,6 +222,8 @@ inline long long remove_if_TileOnMap(Map& map, RemoveIfType& remove_if)
 	while(tileiter != end) {
 		Tile* tile = (*tileiter)->get();
 		if(remove_if(map, tile, removed, done, total)) {
+			map.statistics.removeTile(tile);
+			map.minimap_cache.invalidate(tile->getPosition());
 			map.setTile(tile->getPosition(), nullptr, true);
 			++removed;
 		}
@@ -242,6 +250,8 @@ inline int64_t RemoveItemOnMap(Map& map, RemoveIfType& condition, bool selectedO
 			continue;
 		}
 
+		map.statistics.removeTile(tile);
+
 		if(tile->ground) {
 			if(condition(map, tile->ground, removed, done)) {
 				delete tile->ground;
@@ -260,6 +270,9 @@ inline int64_t RemoveItemOnMap(Map& map, RemoveIfType& condition, bool selectedO
 			else
 				++iit;
 		}
+		tile->update();
+		map.statistics.addTile(tile);
+		map.minimap_cache.invalidate(tile->getPosition());
 		++it;
 	}
 	return removed;
@@ -141,6 +141,7 @@ MapCanvas::MapCanvas(MapWindow* parent, Editor& editor, int* attriblist) :
 	last_mmb_click_x(-1),
 	last_mmb_click_y(-1)
 {
+	map_refresh = true;
 	popup_menu = newd MapPopupMenu(editor);
 	animation_timer = newd AnimationTimer(this);
 	drawer = new MapDrawer(this);
@@ -157,6 +158,7 @@ MapCanvas::~MapCanvas()
 
 void MapCanvas::Refresh()
 {
+	map_refresh = true;
 	if(refresh_watch.Time() > g_settings.getInteger(Config::HARD_REFRESH_RATE)) {
 		refresh_watch.Start();
 		wxGLCanvas::Update();
@@ -164,6 +166,17 @@ void MapCanvas::Refresh()
 	wxGLCanvas::Refresh();
 }
 
+void MapCanvas::Refresh(bool eraseBackground, const wxRect* rect)
+{
+	map_refresh = true;
+	wxGLCanvas::Refresh(eraseBackground, rect);
+}
+
+void MapCanvas::RefreshOverlay()
+{
+	wxGLCanvas::Refresh();
+}
+
 void MapCanvas::SetZoom(double value)
 {
 	if(value < 0.125)
@@ -223,6 +236,7 @@ void MapCanvas::OnPaint(wxPaintEvent& event)
 			options.show_preview = g_settings.getBoolean(Config::SHOW_PREVIEW);
 			options.show_hooks = g_settings.getBoolean(Config::SHOW_WALL_HOOKS);
 			options.hide_items_when_zoomed = g_settings.getBoolean(Config::HIDE_ITEMS_WHEN_ZOOMED);
+			options.minimap_zoom = g_settings.getFloat(Config::MINIMAP_PYRAMID_ZOOM);
 		}
 
 		options.dragging = boundbox_selection;
@@ -232,9 +246,16 @@ void MapCanvas::OnPaint(wxPaintEvent& event)
 		else
 			animation_timer->Stop();
 
+		// Sprites decoded in the background since the last frame
+		g_gui.gfx.uploadDecodedSprites();
+
 		drawer->SetupVars();
 		drawer->SetupGL();
-		drawer->Draw();
+		if(!map_refresh && !screenshot_buffer && drawer->HasMapCache())
+			drawer->DrawOverlay();
+		else
+			drawer->Draw();
+		map_refresh = false;
 
 		if(screenshot_buffer)
 			drawer->TakeScreenshot(screenshot_buffer);
@@ -242,6 +263,8 @@ void MapCanvas::OnPaint(wxPaintEvent& event)
 		drawer->Release();
 	}
 
+	UpdateStatisticsStatus();
+
 	// Clean unused textures
 	g_gui.gfx.garbageCollection();
 
@@ -425,6 +448,20 @@ void MapCanvas::UpdateZoomStatus()
 	g_gui.root->SetStatusText(ss, 3);
 }
 
+void MapCanvas::UpdateStatisticsStatus()
+{
+	const MapStatistics& statistics = editor.map.statistics;
+	wxString ss;
+	ss << "tiles: " << statistics.tile_count << " items: " << statistics.item_count;
+	ss << " monsters: " << statistics.monster_count << " npcs: " << statistics.npc_count;
+
+	// Only touch the status bar when the numbers actually changed
+	wxStatusBar* statusbar = g_gui.root->GetStatusBar();
+	if(statusbar && statusbar->GetStatusText(4) != ss) {
+		g_gui.root->SetStatusText(ss, 4);
+	}
+}
+
 void MapCanvas::OnMouseMove(wxMouseEvent& event)
 {
 	if(screendragging) {
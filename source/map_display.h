@@ -95,6 +95,9 @@ public:
 	void OnProperties(wxCommandEvent& event);
 
 	void Refresh();
+	void Refresh(bool eraseBackground, const wxRect* rect = nullptr);
+	// Only what is drawn on top of the map changed, e.g. live cursors
+	void RefreshOverlay();
 
 	void ScreenToMap(int screen_x, int screen_y, int* map_x, int* map_y);
 	void MouseToMap(int* map_x, int* map_y) {ScreenToMap(cursor_x, cursor_y, map_x, map_y);}
@@ -107,6 +110,7 @@ public:
 
 	void UpdatePositionStatus(int x = -1, int y = -1);
 	void UpdateZoomStatus();
+	void UpdateStatisticsStatus();
 
 	void ChangeFloor(int new_floor);
 	int GetFloor() const {return floor;}
@@ -176,6 +180,9 @@ private:
 
 	uint32_t current_house_id;
 
+	// Set by any refresh except RefreshOverlay, cleared when painted
+	bool map_refresh;
+
 	wxStopWatch refresh_watch;
 	MapPopupMenu* popup_menu;
 	AnimationTimer* animation_timer;
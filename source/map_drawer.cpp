@@ -30,6 +30,7 @@
 #include "map_display.h"
 #include "copybuffer.h"
 #include "live_socket.h"
+#include "sprite_loader.h"
 
 #include "doodad_brush.h"
 #include "monster_brush.h"
@@ -44,6 +45,11 @@
 #include "table_brush.h"
 #include "waypoint_brush.h"
 
+// Tiles beyond the edge of the view whose sprites are decoded ahead of scrolling
+static const int SPRITE_PREFETCH_MARGIN = 6;
+// Minimap block textures kept around once they scroll out of view
+static const size_t MINIMAP_TEXTURE_LIMIT = 1024;
+
 DrawingOptions::DrawingOptions()
 {
 	SetDefault();
@@ -77,6 +83,7 @@ void DrawingOptions::SetDefault()
 	show_preview = false;
 	show_hooks = false;
 	hide_items_when_zoomed = true;
+	minimap_zoom = 0.0f;
 }
 
 void DrawingOptions::SetIngame()
@@ -109,7 +116,12 @@ void DrawingOptions::SetIngame()
 	hide_items_when_zoomed = false;
 }
 
-MapDrawer::MapDrawer(MapCanvas* canvas) : canvas(canvas), editor(canvas->editor)
+MapDrawer::MapDrawer(MapCanvas* canvas) : canvas(canvas), editor(canvas->editor),
+	map_cache_id(0), map_cache_width(0), map_cache_height(0), map_cache_valid(false),
+	map_cache_scroll_x(0), map_cache_scroll_y(0), map_cache_screensize_x(0), map_cache_screensize_y(0),
+	map_cache_zoom(0.0f), map_cache_floor(0),
+	prefetch_start_x(0), prefetch_start_y(0), prefetch_end_x(0), prefetch_end_y(0), prefetch_floor(-1),
+	minimap_frame(0), draw_minimap(false)
 {
 	////
 }
@@ -117,6 +129,11 @@ MapDrawer::MapDrawer(MapCanvas* canvas) : canvas(canvas), editor(canvas->editor)
 MapDrawer::~MapDrawer()
 {
 	Release();
+	ClearTooltips();
+	if(map_cache_id != 0) {
+		glDeleteTextures(1, &map_cache_id);
+	}
+	ReleaseMinimapTextures(true);
 }
 
 void MapDrawer::SetupVars()
@@ -153,6 +170,12 @@ void MapDrawer::SetupVars()
 
 	end_x = start_x + screensize_x / tile_size + 2;
 	end_y = start_y + screensize_y / tile_size + 2;
+
+	// Live clients only hold the nodes they asked for, those keep drawing tile by tile
+	// Even fully zoomed out a tile covers more than a screen pixel, so the
+	// cache is drawn at one texel per tile
+	draw_minimap = options.minimap_zoom > 0.0f && zoom >= options.minimap_zoom && !editor.IsLiveClient() &&
+		!options.show_only_colors && !options.show_only_modified;
 }
 
 void MapDrawer::SetupGL()
@@ -177,10 +200,7 @@ void MapDrawer::SetupGL()
 
 void MapDrawer::Release()
 {
-	for(std::vector<MapTooltip*>::const_iterator it = tooltips.begin(); it != tooltips.end(); ++it) {
-		delete *it;
-	}
-	tooltips.clear();
+	// Tooltips are kept until the next full draw, overlay draws reuse them
 
 	// Disable 2D mode
 	glMatrixMode(GL_PROJECTION);
@@ -191,10 +211,97 @@ void MapDrawer::Release()
 
 void MapDrawer::Draw()
 {
+	ClearTooltips();
+
 	DrawBackground();
 	DrawMap();
 	DrawDraggingShadow();
 	DrawHigherFloors();
+
+	// Only live sessions get frequent overlay-only refreshes from remote cursors
+	if(editor.IsLive())
+		CacheMapLayer();
+	else
+		map_cache_valid = false;
+
+	DrawOverlayLayers();
+}
+
+void MapDrawer::DrawOverlay()
+{
+	DrawBackground();
+	DrawMapCache();
+	DrawOverlayLayers();
+}
+
+bool MapDrawer::HasMapCache() const
+{
+	return map_cache_valid &&
+		map_cache_scroll_x == view_scroll_x && map_cache_scroll_y == view_scroll_y &&
+		map_cache_screensize_x == screensize_x && map_cache_screensize_y == screensize_y &&
+		map_cache_zoom == zoom && map_cache_floor == floor;
+}
+
+void MapDrawer::CacheMapLayer()
+{
+	map_cache_valid = false;
+	if(screensize_x <= 0 || screensize_y <= 0)
+		return;
+
+	int width = 1;
+	while(width < screensize_x)
+		width <<= 1;
+	int height = 1;
+	while(height < screensize_y)
+		height <<= 1;
+
+	if(map_cache_id == 0)
+		map_cache_id = g_gui.gfx.getFreeTextureID();
+
+	glBindTexture(GL_TEXTURE_2D, map_cache_id);
+	if(width != map_cache_width || height != map_cache_height) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+		map_cache_width = width;
+		map_cache_height = height;
+	}
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, screensize_x, screensize_y);
+
+	map_cache_valid = true;
+	map_cache_scroll_x = view_scroll_x;
+	map_cache_scroll_y = view_scroll_y;
+	map_cache_screensize_x = screensize_x;
+	map_cache_screensize_y = screensize_y;
+	map_cache_zoom = zoom;
+	map_cache_floor = floor;
+}
+
+void MapDrawer::DrawMapCache()
+{
+	const float width = screensize_x * zoom;
+	const float height = screensize_y * zoom;
+	const float s = float(screensize_x) / map_cache_width;
+	const float t = float(screensize_y) / map_cache_height;
+
+	// The framebuffer is bottom-up
+	glDisable(GL_BLEND);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, map_cache_id);
+	glColor4ub(255, 255, 255, 255);
+	glBegin(GL_QUADS);
+		glTexCoord2f(0.f, t); glVertex2f(0.f, 0.f);
+		glTexCoord2f(s, t); glVertex2f(width, 0.f);
+		glTexCoord2f(s, 0.f); glVertex2f(width, height);
+		glTexCoord2f(0.f, 0.f); glVertex2f(0.f, height);
+	glEnd();
+	glEnable(GL_BLEND);
+}
+
+void MapDrawer::DrawOverlayLayers()
+{
 	if(options.dragging)
 		DrawSelectionBox();
 	DrawLiveCursors();
@@ -207,6 +314,46 @@ void MapDrawer::Draw()
 		DrawTooltips();
 }
 
+void MapDrawer::PrefetchSprites()
+{
+	const SpritePrefetchArea previous = { prefetch_start_x, prefetch_start_y, prefetch_end_x, prefetch_end_y };
+	const SpritePrefetchArea current = { start_x, start_y, end_x, end_y };
+	const bool same_floor = prefetch_floor == floor;
+
+	prefetch_start_x = start_x;
+	prefetch_start_y = start_y;
+	prefetch_end_x = end_x;
+	prefetch_end_y = end_y;
+	prefetch_floor = floor;
+
+	if(!same_floor || options.show_as_minimap || options.show_only_colors || draw_minimap)
+		return;
+
+	for(const SpritePrefetchArea& area : getSpritePrefetchAreas(previous, current, SPRITE_PREFETCH_MARGIN)) {
+		for(int map_y = area.startY; map_y < area.endY; ++map_y) {
+			for(int map_x = area.startX; map_x < area.endX; ++map_x) {
+				const Tile* tile = editor.map.getTile(map_x, map_y, floor);
+				if(!tile)
+					continue;
+
+				if(tile->ground) {
+					GameSprite* spr = g_items[tile->ground->getID()].sprite;
+					if(spr)
+						spr->prefetchTextures();
+				}
+
+				if(options.show_items) {
+					for(const Item* item : tile->items) {
+						GameSprite* spr = g_items[item->getID()].sprite;
+						if(spr)
+							spr->prefetchTextures();
+					}
+				}
+			}
+		}
+	}
+}
+
 void MapDrawer::DrawBackground()
 {
 	// Black Background
@@ -233,6 +380,12 @@ inline int getFloorAdjustment(int floor)
 void MapDrawer::DrawMap()
 {
 	bool live_client = editor.IsLiveClient();
+	if(live_client) {
+		// Lets the server stream nodes ahead of the view
+		editor.UpdateViewport(start_x, start_y, end_x, end_y, floor);
+	}
+
+	PrefetchSprites();
 
 	Brush* brush = g_gui.GetCurrentBrush();
 
@@ -251,6 +404,9 @@ void MapDrawer::DrawMap()
 	if(!only_colors)
 		glEnable(GL_TEXTURE_2D);
 
+	if(draw_minimap)
+		++minimap_frame;
+
 	for(int map_z = start_z; map_z >= superend_z; map_z--) {
 		if(map_z == end_z && start_z != end_z && options.show_shade) {
 			// Draw shade
@@ -269,7 +425,9 @@ void MapDrawer::DrawMap()
 				glEnable(GL_TEXTURE_2D);
 		}
 
-		if(map_z >= end_z) {
+		if(map_z >= end_z && draw_minimap) {
+			DrawMinimapFloor(map_z);
+		} else if(map_z >= end_z) {
 			int nd_start_x = start_x & ~3;
 			int nd_start_y = start_y & ~3;
 			int nd_end_x = (end_x & ~3) + 4;
@@ -410,6 +568,96 @@ void MapDrawer::DrawMap()
 
 	if(!only_colors)
 		glEnable(GL_TEXTURE_2D);
+
+	if(minimap_textures.size() > MINIMAP_TEXTURE_LIMIT)
+		ReleaseMinimapTextures(false);
+}
+
+void MapDrawer::DrawMinimapFloor(int map_z)
+{
+	MinimapCache& cache = editor.map.minimap_cache;
+
+	const int block_tiles = MINIMAP_BLOCK_SIZE;
+	const int block_size = block_tiles * TILE_SIZE;
+
+	int offset;
+	if(map_z <= GROUND_LAYER)
+		offset = (GROUND_LAYER - map_z) * TILE_SIZE;
+	else
+		offset = TILE_SIZE * (floor - map_z);
+
+	glEnable(GL_TEXTURE_2D);
+	glColor4ub(255, 255, 255, 255);
+
+	const int block_end_x = std::min(end_x, 0xFFFF) / block_tiles;
+	const int block_end_y = std::min(end_y, 0xFFFF) / block_tiles;
+	for(int by = std::max(start_y, 0) / block_tiles; by <= block_end_y; ++by) {
+		for(int bx = std::max(start_x, 0) / block_tiles; bx <= block_end_x; ++bx) {
+			const uint32_t key = MinimapCache::getKey(bx, by, map_z, 0);
+
+			uint32_t version;
+			const uint8_t* colors = cache.getBlock(bx, by, map_z, &version);
+			if(!colors) {
+				auto it = minimap_textures.find(key);
+				if(it != minimap_textures.end()) {
+					glDeleteTextures(1, &it->second.id);
+					minimap_textures.erase(it);
+				}
+				continue;
+			}
+
+			MinimapTexture& texture = minimap_textures[key];
+			if(texture.id == 0 || texture.version != version) {
+				// Colour 0 is left transparent so lower floors show through
+				uint8_t rgba[MINIMAP_BLOCK_SIZE * MINIMAP_BLOCK_SIZE * 4];
+				for(int i = 0; i < MINIMAP_BLOCK_SIZE * MINIMAP_BLOCK_SIZE; ++i) {
+					const RGBQuad& rgb = minimap_color[colors[i]];
+					rgba[i * 4] = rgb.red;
+					rgba[i * 4 + 1] = rgb.green;
+					rgba[i * 4 + 2] = rgb.blue;
+					rgba[i * 4 + 3] = colors[i] ? 255 : 0;
+				}
+
+				if(texture.id == 0)
+					texture.id = g_gui.gfx.getFreeTextureID();
+
+				glBindTexture(GL_TEXTURE_2D, texture.id);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, 0x812F); // GL_CLAMP_TO_EDGE
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, 0x812F); // GL_CLAMP_TO_EDGE
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, MINIMAP_BLOCK_SIZE, MINIMAP_BLOCK_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+				texture.version = version;
+			} else {
+				glBindTexture(GL_TEXTURE_2D, texture.id);
+			}
+			texture.frame = minimap_frame;
+
+			const int draw_x = bx * block_size - view_scroll_x - offset;
+			const int draw_y = by * block_size - view_scroll_y - offset;
+			glBegin(GL_QUADS);
+				glTexCoord2f(0.f, 0.f); glVertex2f(draw_x, draw_y);
+				glTexCoord2f(1.f, 0.f); glVertex2f(draw_x + block_size, draw_y);
+				glTexCoord2f(1.f, 1.f); glVertex2f(draw_x + block_size, draw_y + block_size);
+				glTexCoord2f(0.f, 1.f); glVertex2f(draw_x, draw_y + block_size);
+			glEnd();
+		}
+	}
+
+	if(options.show_as_minimap)
+		glDisable(GL_TEXTURE_2D);
+}
+
+void MapDrawer::ReleaseMinimapTextures(bool all)
+{
+	for(auto it = minimap_textures.begin(); it != minimap_textures.end();) {
+		if(all || it->second.frame != minimap_frame) {
+			glDeleteTextures(1, &it->second.id);
+			it = minimap_textures.erase(it);
+		} else {
+			++it;
+		}
+	}
 }
 
 void MapDrawer::DrawIngameBox()
@@ -594,7 +842,7 @@ void MapDrawer::DrawHigherFloors()
 	glEnable(GL_TEXTURE_2D);
 
 	// Draw "transparent higher floor"
-	if(floor != 8 && floor != 0 && options.transparent_floors) {
+	if(floor != 8 && floor != 0 && options.transparent_floors && !draw_minimap) {
 		int map_z = floor - 1;
 		for(int map_x = start_x; map_x <= end_x; map_x++) {
 			for(int map_y = start_y; map_y <= end_y; map_y++) {
@@ -1753,6 +2001,14 @@ void MapDrawer::DrawTooltips()
 	}
 }
 
+void MapDrawer::ClearTooltips()
+{
+	for(std::vector<MapTooltip*>::const_iterator it = tooltips.begin(); it != tooltips.end(); ++it) {
+		delete *it;
+	}
+	tooltips.clear();
+}
+
 void MapDrawer::MakeTooltip(int screenx, int screeny, const std::string& text, uint8_t r, uint8_t g, uint8_t b)
 {
 	if(text.empty())
@@ -18,6 +18,8 @@
 #ifndef RME_MAP_DRAWER_H_
 #define RME_MAP_DRAWER_H_
 
+#include <unordered_map>
+
 class GameSprite;
 
 struct MapTooltip
@@ -76,6 +78,7 @@ struct DrawingOptions {
 	bool show_preview;
 	bool show_hooks;
 	bool hide_items_when_zoomed;
+	float minimap_zoom; // From this zoom on the map is drawn from the minimap pyramid, 0 never
 };
 
 class MapCanvas;
@@ -98,6 +101,31 @@ class MapDrawer
 	int tile_size;
 	int floor;
 
+	// Copy of the map layers of the last full draw, lets live cursor
+	// updates repaint only what is drawn on top of the map
+	GLuint map_cache_id;
+	int map_cache_width, map_cache_height;
+	bool map_cache_valid;
+	int map_cache_scroll_x, map_cache_scroll_y;
+	int map_cache_screensize_x, map_cache_screensize_y;
+	float map_cache_zoom;
+	int map_cache_floor;
+
+	// View of the last frame, to prefetch sprites in the direction it moves
+	int prefetch_start_x, prefetch_start_y;
+	int prefetch_end_x, prefetch_end_y;
+	int prefetch_floor;
+
+	// Textures of minimap pyramid blocks, drawn instead of the tiles when zoomed far out
+	struct MinimapTexture {
+		GLuint id;
+		uint32_t version;
+		uint32_t frame;
+	};
+	std::unordered_map<uint32_t, MinimapTexture> minimap_textures;
+	uint32_t minimap_frame;
+	bool draw_minimap; // Drawn from the minimap cache this frame instead of tile by tile
+
 protected:
 	std::vector<MapTooltip*> tooltips;
 	std::ostringstream tooltip;
@@ -114,6 +142,9 @@ public:
 	void Release();
 
 	void Draw();
+	// Redraws the overlays on top of the cached map, see HasMapCache
+	void DrawOverlay();
+	bool HasMapCache() const;
 	void DrawBackground();
 	void DrawMap();
 	void DrawDraggingShadow();
@@ -124,6 +155,7 @@ public:
 	void DrawIngameBox();
 	void DrawGrid();
 	void DrawTooltips();
+	void DrawOverlayLayers();
 
 	void TakeScreenshot(uint8_t* screenshot_buffer);
 
@@ -143,6 +175,12 @@ protected:
 	void WriteTooltip(Item* item, std::ostringstream& stream);
 	void WriteTooltip(Waypoint* item, std::ostringstream& stream);
 	void MakeTooltip(int screenx, int screeny, const std::string& text, uint8_t r = 255, uint8_t g = 255, uint8_t b = 255);
+	void ClearTooltips();
+	void CacheMapLayer();
+	void DrawMapCache();
+	void PrefetchSprites();
+	void DrawMinimapFloor(int map_z);
+	void ReleaseMinimapTextures(bool all);
 
 	enum BrushColor {
 		COLOR_BRUSH,
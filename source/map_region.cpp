@@ -165,25 +165,6 @@ bool QTreeNode::isRequested(bool underground)
 	}
 }
 
-void QTreeNode::clearVisible(uint32_t u)
-{
-	if(isLeaf)
-		visible &= u;
-	else
-		for(int i = 0; i < MAP_LAYERS; ++i)
-			if(child[i])
-				child[i]->clearVisible(u);
-}
-
-bool QTreeNode::isVisible(uint32_t client, bool underground)
-{
-	if(underground) {
-		return testFlags(visible >> MAP_LAYERS, static_cast<uint64_t>(1) << client);
-	} else {
-		return testFlags(visible, static_cast<uint64_t>(1) << client);
-	}
-}
-
 void QTreeNode::setVisible(bool underground, bool value)
 {
 	if(underground) {
@@ -195,7 +176,7 @@ void QTreeNode::setVisible(bool underground, bool value)
 		if(value)
 			visible |= 1;
 		else
-			visible &= 1;
+			visible &= ~1;
 	}
 }
 
@@ -207,14 +188,6 @@ void QTreeNode::setRequested(bool underground, bool r)
 		visible &= ~(underground? 4 : 8);
 }
 
-void QTreeNode::setVisible(uint32_t client, bool underground, bool value)
-{
-	if(value)
-		visible |= (1 << client << (underground ? MAP_LAYERS : 0));
-	else
-		visible &= ~(1 << client << (underground ? MAP_LAYERS : 0));
-}
-
 TileLocation* QTreeNode::getTile(int x, int y, int z)
 {
 	ASSERT(isLeaf);
@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "map_statistics.h"
+#include "basemap.h"
+#include "complexitem.h"
+#include "items.h"
+
+MapStatistics::MapStatistics()
+{
+	clear();
+}
+
+void MapStatistics::clear()
+{
+	tile_count = 0;
+	detailed_tile_count = 0;
+	blocking_tile_count = 0;
+	walkable_tile_count = 0;
+
+	item_count = 0;
+	loose_item_count = 0;
+	depot_count = 0;
+	action_item_count = 0;
+	unique_item_count = 0;
+	container_count = 0;
+
+	spawn_monster_count = 0;
+	spawn_npc_count = 0;
+	monster_count = 0;
+	npc_count = 0;
+}
+
+void MapStatistics::recount(BaseMap& map)
+{
+	clear();
+	for(MapIterator mit = map.begin(); mit != map.end(); ++mit) {
+		addTile((*mit)->get());
+	}
+}
+
+bool MapStatistics::updateItem(const Item* item, int64_t sign)
+{
+	item_count += sign;
+	if(item->isGroundTile() || item->isBorder()) {
+		return false;
+	}
+
+	const ItemType& type = g_items[item->getID()];
+	if(type.moveable) {
+		loose_item_count += sign;
+	}
+	if(type.isDepot()) {
+		depot_count += sign;
+	}
+	if(item->getActionID() > 0) {
+		action_item_count += sign;
+	}
+	if(item->getUniqueID() > 0) {
+		unique_item_count += sign;
+	}
+	if(const Container* container = dynamic_cast<const Container*>(item)) {
+		if(container->getItemCount() > 0) {
+			container_count += sign;
+		}
+	}
+	return true;
+}
+
+void MapStatistics::update(const Tile* tile, int64_t sign)
+{
+	if(!tile) {
+		return;
+	}
+
+	if(!tile->ground && tile->items.empty() && !tile->monster && !tile->npc && !tile->spawnMonster && !tile->spawnNpc) {
+		return;
+	}
+
+	tile_count += sign;
+
+	bool is_detailed = false;
+	if(tile->ground) {
+		is_detailed = updateItem(tile->ground, sign);
+	}
+
+	for(const Item* item : tile->items) {
+		if(updateItem(item, sign)) {
+			is_detailed = true;
+		}
+	}
+
+	if(tile->spawnMonster) {
+		spawn_monster_count += sign;
+	}
+	if(tile->spawnNpc) {
+		spawn_npc_count += sign;
+	}
+	if(tile->monster) {
+		monster_count += sign;
+	}
+	if(tile->npc) {
+		npc_count += sign;
+	}
+
+	if(tile->isBlocking()) {
+		blocking_tile_count += sign;
+	} else {
+		walkable_tile_count += sign;
+	}
+
+	if(is_detailed) {
+		detailed_tile_count += sign;
+	}
+}
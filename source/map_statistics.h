@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MAP_STATISTICS_H_
+#define RME_MAP_STATISTICS_H_
+
+class Tile;
+class Item;
+class BaseMap;
+
+// Live counters for the "Map Statistics" dialog and the status bar.
+// Every place that puts a tile on the map or takes one off it applies
+// the tile's contribution with removeTile / addTile, so the numbers are
+// always current without walking the map.
+// A tile only contributes what it owns (items, creatures, spawns), never
+// what is stored on its TileLocation, so removing a tile always subtracts
+// exactly what was added for it.
+class MapStatistics
+{
+public:
+	MapStatistics();
+
+	void clear();
+	// Full walk of the map, only used after bulk operations that
+	// modify tiles in place (conversion, cleaning invalid tiles)
+	void recount(BaseMap& map);
+
+	void addTile(const Tile* tile) { update(tile, 1); }
+	void removeTile(const Tile* tile) { update(tile, -1); }
+
+	int64_t tile_count;
+	int64_t detailed_tile_count;
+	int64_t blocking_tile_count;
+	int64_t walkable_tile_count;
+
+	int64_t item_count;
+	int64_t loose_item_count;
+	int64_t depot_count;
+	int64_t action_item_count;
+	int64_t unique_item_count;
+	int64_t container_count; // Only includes containers containing at least 1 item
+
+	int64_t spawn_monster_count;
+	int64_t spawn_npc_count;
+	int64_t monster_count;
+	int64_t npc_count;
+
+protected:
+	void update(const Tile* tile, int64_t sign);
+	// Returns true if the item counts as detail (not ground nor border)
+	bool updateItem(const Item* item, int64_t sign);
+};
+
+#endif
@@ -143,14 +143,14 @@ void MapWindow::Scroll(int x, int y, bool center)
 
 	hScroll->SetThumbPosition(x);
 	vScroll->SetThumbPosition(y);
-	g_gui.UpdateMinimap();
+	g_gui.UpdateMinimap(true);
 }
 
 void MapWindow::ScrollRelative(int x, int y)
 {
 	hScroll->SetThumbPosition(hScroll->GetThumbPosition()+x);
 	vScroll->SetThumbPosition(vScroll->GetThumbPosition()+y);
-	g_gui.UpdateMinimap();
+	g_gui.UpdateMinimap(true);
 }
 
 void MapWindow::OnGem(wxCommandEvent& WXUNUSED(event))
@@ -0,0 +1,269 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#include "main.h"
+
+#include "minimap_cache.h"
+#include "basemap.h"
+#include "tile.h"
+#include "graphics.h"
+
+MinimapCache::MinimapCache(BaseMap& map) :
+	map(map),
+	version_counter(0),
+	pending_collected(false)
+{
+	////
+}
+
+MinimapCache::~MinimapCache()
+{
+	clear();
+}
+
+const uint8_t* MinimapCache::getBlock(int bx, int by, int z, uint32_t* version)
+{
+	const uint32_t key = getKey(bx, by, z, 0);
+	auto it = blocks.find(key);
+	if(it == blocks.end()) {
+		// Empty areas aren't kept, finding them empty again is cheap
+		Block filled;
+		fillBlock(&filled, bx, by, z);
+		if(!filled.colors)
+			return nullptr;
+
+		it = blocks.emplace(key, newd Block).first;
+		std::swap(it->second->colors, filled.colors);
+		it->second->dirty = false;
+		it->second->version = ++version_counter;
+	} else if(it->second->dirty) {
+		fillBlock(it->second, bx, by, z);
+		if(!it->second->colors) {
+			delete it->second;
+			blocks.erase(it);
+			return nullptr;
+		}
+		it->second->dirty = false;
+		it->second->version = ++version_counter;
+	}
+
+	if(version)
+		*version = it->second->version;
+	return it->second->colors;
+}
+
+const uint8_t* MinimapCache::getLevelBlock(int bx, int by, int z, int level)
+{
+	if(level == 0)
+		return getBlock(bx, by, z);
+
+	Block*& block = level_blocks[getKey(bx, by, z, level)];
+	if(!block)
+		block = newd Block;
+
+	if(block->dirty) {
+		reduceBlock(block, bx, by, z, level);
+		block->dirty = false;
+		block->version = ++version_counter;
+	}
+	return block->colors;
+}
+
+void MinimapCache::fillBlock(Block* block, int bx, int by, int z)
+{
+	// Allocated once the first colour is found, most empty blocks never are
+	if(block->colors)
+		memset(block->colors, 0, MINIMAP_BLOCK_SIZE * MINIMAP_BLOCK_SIZE);
+	bool empty = true;
+
+	const int start_x = bx * MINIMAP_BLOCK_SIZE;
+	const int start_y = by * MINIMAP_BLOCK_SIZE;
+	for(int leaf_y = 0; leaf_y < MINIMAP_BLOCK_SIZE; leaf_y += 4) {
+		for(int leaf_x = 0; leaf_x < MINIMAP_BLOCK_SIZE; leaf_x += 4) {
+			QTreeNode* node = map.getLeaf(start_x + leaf_x, start_y + leaf_y);
+			if(!node)
+				continue;
+
+			Floor* floor = node->getFloor(z);
+			if(!floor)
+				continue;
+
+			// Locations in a floor are stored column by column
+			for(int i = 0; i < 16; ++i) {
+				Tile* tile = floor->locs[i].get();
+				if(!tile)
+					continue;
+
+				uint8_t color = tile->getMiniMapColor();
+				if(color) {
+					if(!block->colors) {
+						block->colors = newd uint8_t[MINIMAP_BLOCK_SIZE * MINIMAP_BLOCK_SIZE];
+						memset(block->colors, 0, MINIMAP_BLOCK_SIZE * MINIMAP_BLOCK_SIZE);
+					}
+					block->colors[(leaf_y + (i & 3)) * MINIMAP_BLOCK_SIZE + leaf_x + (i >> 2)] = color;
+					empty = false;
+				}
+			}
+		}
+	}
+
+	if(empty) {
+		delete[] block->colors;
+		block->colors = nullptr;
+	}
+}
+
+void MinimapCache::reduceBlock(Block* block, int bx, int by, int z, int level)
+{
+	const uint8_t* sources[4];
+	bool empty = true;
+	for(int quarter = 0; quarter < 4; ++quarter) {
+		sources[quarter] = getLevelBlock(bx * 2 + (quarter & 1), by * 2 + (quarter >> 1), z, level - 1);
+		if(sources[quarter])
+			empty = false;
+	}
+
+	if(empty) {
+		delete[] block->colors;
+		block->colors = nullptr;
+		return;
+	}
+
+	if(!block->colors)
+		block->colors = newd uint8_t[MINIMAP_BLOCK_SIZE * MINIMAP_BLOCK_SIZE];
+
+	const int half = MINIMAP_BLOCK_SIZE / 2;
+	for(int quarter = 0; quarter < 4; ++quarter) {
+		const uint8_t* source = sources[quarter];
+		uint8_t* out = block->colors + (quarter >> 1) * half * MINIMAP_BLOCK_SIZE + (quarter & 1) * half;
+		for(int y = 0; y < half; ++y, out += MINIMAP_BLOCK_SIZE) {
+			if(!source) {
+				memset(out, 0, half);
+				continue;
+			}
+
+			// Palette colours can't be averaged, keep the first one of every 2x2 that is set
+			const uint8_t* top = source + y * 2 * MINIMAP_BLOCK_SIZE;
+			const uint8_t* bottom = top + MINIMAP_BLOCK_SIZE;
+			for(int x = 0; x < half; ++x) {
+				uint8_t color = top[x * 2];
+				if(!color) color = top[x * 2 + 1];
+				if(!color) color = bottom[x * 2];
+				if(!color) color = bottom[x * 2 + 1];
+				out[x] = color;
+			}
+		}
+	}
+}
+
+void MinimapCache::getColors(int x, int y, int z, int width, int height, uint8_t* out, int level)
+{
+	memset(out, 0, size_t(width) * height);
+
+	const int end_x = x + width;
+	const int end_y = y + height;
+	for(int by = std::max(y, 0) / MINIMAP_BLOCK_SIZE; by * MINIMAP_BLOCK_SIZE < end_y; ++by) {
+		for(int bx = std::max(x, 0) / MINIMAP_BLOCK_SIZE; bx * MINIMAP_BLOCK_SIZE < end_x; ++bx) {
+			const uint8_t* colors = getLevelBlock(bx, by, z, level);
+			if(!colors)
+				continue;
+
+			// Part of the block inside the requested area
+			const int from_x = std::max(x, bx * MINIMAP_BLOCK_SIZE);
+			const int to_x = std::min(end_x, (bx + 1) * MINIMAP_BLOCK_SIZE);
+			const int from_y = std::max(y, by * MINIMAP_BLOCK_SIZE);
+			const int to_y = std::min(end_y, (by + 1) * MINIMAP_BLOCK_SIZE);
+			for(int row = from_y; row < to_y; ++row) {
+				memcpy(out + size_t(row - y) * width + (from_x - x),
+					colors + (row - by * MINIMAP_BLOCK_SIZE) * MINIMAP_BLOCK_SIZE + (from_x - bx * MINIMAP_BLOCK_SIZE),
+					to_x - from_x);
+			}
+		}
+	}
+}
+
+void MinimapCache::getRGB(int x, int y, int z, int width, int height, uint8_t* out)
+{
+	const size_t count = size_t(width) * height;
+	std::vector<uint8_t> colors(count);
+	getColors(x, y, z, width, height, colors.data());
+
+	for(size_t i = 0; i < count; ++i) {
+		const RGBQuad& rgb = minimap_color[colors[i]];
+		out[i * 3] = rgb.red;
+		out[i * 3 + 1] = rgb.green;
+		out[i * 3 + 2] = rgb.blue;
+	}
+}
+
+void MinimapCache::invalidate(int x, int y, int z)
+{
+	if(x < 0 || y < 0)
+		return;
+
+	auto it = blocks.find(getKey(x / MINIMAP_BLOCK_SIZE, y / MINIMAP_BLOCK_SIZE, z, 0));
+	if(it != blocks.end())
+		it->second->dirty = true;
+
+	// The block holding the tile on every coarser level, only built during exports
+	if(level_blocks.empty())
+		return;
+	for(int level = 1; level < 16; ++level) {
+		const int size = MINIMAP_BLOCK_SIZE << level;
+		auto it = level_blocks.find(getKey(x / size, y / size, z, level));
+		if(it != level_blocks.end())
+			it->second->dirty = true;
+	}
+}
+
+void MinimapCache::clear()
+{
+	for(auto& it : blocks) {
+		delete it.second;
+	}
+	blocks.clear();
+	releaseLevels();
+
+	pending.clear();
+	pending_collected = false;
+}
+
+void MinimapCache::releaseLevels()
+{
+	for(auto& it : level_blocks) {
+		delete it.second;
+	}
+	level_blocks.clear();
+}
+
+bool MinimapCache::buildStep(size_t count)
+{
+	if(!pending_collected) {
+		map.getNodeAreas(MINIMAP_BLOCK_SIZE, pending);
+		pending_collected = true;
+	}
+
+	for(; count > 0 && !pending.empty(); --count) {
+		const Position& area = pending.back();
+		for(int z = 0; z < MAP_LAYERS; ++z) {
+			getBlock(area.x / MINIMAP_BLOCK_SIZE, area.y / MINIMAP_BLOCK_SIZE, z);
+		}
+		pending.pop_back();
+	}
+	return !pending.empty();
+}
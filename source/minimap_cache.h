@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+
+#ifndef RME_MINIMAP_CACHE_H_
+#define RME_MINIMAP_CACHE_H_
+
+#include "position.h"
+
+#include <unordered_map>
+
+class BaseMap;
+
+// Side of a cached block in texels, a whole number of 4x4 tree leaves
+#define MINIMAP_BLOCK_SIZE 64
+
+// Minimap colours of a map as 8-bit palette indices, one texel per tile, in
+// blocks per floor. Blocks are filled leaf by leaf the first time they are
+// asked for (or by buildStep) and rebuilt once a tile inside changes. Blocks
+// without tiles aren't kept.
+// Exports also read coarser levels, level n has one texel per 2^n x 2^n
+// tiles. Those are reduced from the level below and only kept until
+// releaseLevels, the editor itself never draws them.
+class MinimapCache
+{
+public:
+	MinimapCache(BaseMap& map);
+	~MinimapCache();
+
+	MinimapCache(const MinimapCache&) = delete;
+	MinimapCache& operator=(const MinimapCache&) = delete;
+
+	// Colours of a block, row by row. Returns nullptr if there are no tiles
+	// in it. version changes whenever the colours do.
+	const uint8_t* getBlock(int bx, int by, int z, uint32_t* version = nullptr);
+
+	// Copies the colours of a width x height area, 0 where there is no tile.
+	// x, y, width and height are in texels of the level.
+	void getColors(int x, int y, int z, int width, int height, uint8_t* out, int level = 0);
+	// Same area as packed 24-bit RGB, the layout wxImage uses
+	void getRGB(int x, int y, int z, int width, int height, uint8_t* out);
+
+	void invalidate(int x, int y, int z);
+	void invalidate(const Position& position) { invalidate(position.x, position.y, position.z); }
+	void clear();
+	// Frees the coarser levels getColors built for an export
+	void releaseLevels();
+
+	// Builds up to count level 0 areas (all floors) that haven't been drawn yet.
+	// Returns true while there is work left.
+	bool buildStep(size_t count);
+
+	static uint32_t getKey(int bx, int by, int z, int level) {
+		return uint32_t(bx) | (uint32_t(by) << 10) | (uint32_t(z) << 20) | (uint32_t(level) << 24);
+	}
+
+protected:
+	struct Block {
+		Block() : colors(nullptr), version(0), dirty(true) {}
+		~Block() { delete[] colors; }
+
+		uint8_t* colors; // nullptr while there are no tiles in the block
+		uint32_t version;
+		bool dirty;
+	};
+
+	// Block (bx, by) of a level covers (MINIMAP_BLOCK_SIZE << level) tiles each way
+	const uint8_t* getLevelBlock(int bx, int by, int z, int level);
+	void fillBlock(Block* block, int bx, int by, int z);
+	void reduceBlock(Block* block, int bx, int by, int z, int level);
+
+	BaseMap& map;
+	// Level 0
+	std::unordered_map<uint32_t, Block*> blocks;
+	// Coarser levels, empty ones included, until releaseLevels
+	std::unordered_map<uint32_t, Block*> level_blocks;
+	uint32_t version_counter;
+
+	// Areas left for buildStep, collected from the tree on its first call
+	PositionVector pending;
+	bool pending_collected;
+};
+
+#endif
@@ -0,0 +1,336 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "minimap_export.h"
+#include "image_writer.h"
+#include "basemap.h"
+#include "tile.h"
+#include "editor.h"
+#include "gui.h"
+#include "client_version.h"
+
+#include <thread>
+#include <chrono>
+
+namespace
+{
+	// Rows rendered at once by a worker, a band is all that is held in memory per floor
+	const int MINIMAP_EXPORT_BAND = 64;
+}
+
+MinimapExporter::MinimapExporter(BaseMap& map) :
+	map(map),
+	min_x(0), min_y(0),
+	max_x(-1), max_y(-1),
+	rows_done(0)
+{
+	////
+}
+
+bool MinimapExporter::computeBounds()
+{
+	min_x = min_y = 0x10000;
+	max_x = max_y = -1;
+
+	PositionVector leaves;
+	map.getNodeAreas(4, leaves);
+	for(PositionVector::const_iterator it = leaves.begin(); it != leaves.end(); ++it) {
+		QTreeNode* node = map.getLeaf(it->x, it->y);
+		if(!node)
+			continue;
+
+		for(int z = 0; z < MAP_LAYERS; ++z) {
+			Floor* floor = node->getFloor(z);
+			if(!floor)
+				continue;
+
+			// Locations in a floor are stored column by column
+			for(int i = 0; i < 16; ++i) {
+				Tile* tile = floor->locs[i].get();
+				if(!tile || tile->empty())
+					continue;
+
+				const int x = it->x + (i >> 2);
+				const int y = it->y + (i & 3);
+				min_x = std::min(min_x, x);
+				min_y = std::min(min_y, y);
+				max_x = std::max(max_x, x);
+				max_y = std::max(max_y, y);
+			}
+		}
+	}
+	return max_x >= 0;
+}
+
+void MinimapExporter::renderRows(int floor, int y, int rows, uint8_t* out)
+{
+	const int width = getWidth();
+	memset(out, 0, size_t(width) * rows);
+
+	const int start_y = min_y + y;
+	const int end_y = start_y + rows;
+	for(int leaf_y = start_y & ~3; leaf_y < end_y; leaf_y += 4) {
+		for(int leaf_x = min_x & ~3; leaf_x <= max_x; leaf_x += 4) {
+			QTreeNode* node = map.getLeaf(leaf_x, leaf_y);
+			if(!node)
+				continue;
+
+			Floor* leaf_floor = node->getFloor(floor);
+			if(!leaf_floor)
+				continue;
+
+			for(int i = 0; i < 16; ++i) {
+				const int tile_x = leaf_x + (i >> 2);
+				const int tile_y = leaf_y + (i & 3);
+				if(tile_x < min_x || tile_x > max_x || tile_y < start_y || tile_y >= end_y)
+					continue;
+
+				Tile* tile = leaf_floor->locs[i].get();
+				if(tile)
+					out[size_t(tile_y - start_y) * width + tile_x - min_x] = tile->getMiniMapColor();
+			}
+		}
+	}
+}
+
+bool MinimapExporter::writeFloor(const Job& job, const std::string& extension)
+{
+	std::unique_ptr<ImageWriter> writer(ImageWriter::create(extension));
+	if(!writer) {
+		setError("Unsupported image format \"" + wxstr(extension) + "\".");
+		return false;
+	}
+
+	const int width = getWidth();
+	const int height = getHeight();
+	if(!writer->open(job.path, width, height, ImageWriter::PIXEL_MINIMAP)) {
+		setError("Could not open \"" + wxstr(job.path) + "\" for writing.");
+		return false;
+	}
+
+	const bool bottom_up = writer->isBottomUp();
+	std::vector<uint8_t> band(size_t(width) * MINIMAP_EXPORT_BAND);
+	for(int written = 0; written < height; written += MINIMAP_EXPORT_BAND) {
+		const int rows = std::min(MINIMAP_EXPORT_BAND, height - written);
+		const int y = bottom_up? height - written - rows : written;
+		renderRows(job.floor, y, rows, band.data());
+
+		for(int row = 0; row < rows; ++row) {
+			const int index = bottom_up? rows - 1 - row : row;
+			if(!writer->writeRow(&band[size_t(index) * width])) {
+				setError("Could not write to \"" + wxstr(job.path) + "\".");
+				return false;
+			}
+		}
+		rows_done += rows;
+	}
+
+	if(!writer->close()) {
+		setError("Could not write to \"" + wxstr(job.path) + "\".");
+		return false;
+	}
+	return true;
+}
+
+bool MinimapExporter::run(const std::vector<Job>& jobs, const std::string& extension, int threads, bool showdialog)
+{
+	if(jobs.empty())
+		return true;
+
+	if(threads <= 0)
+		threads = std::max<int>(1, std::thread::hardware_concurrency());
+	threads = std::min<int>(threads, jobs.size());
+
+	rows_done = 0;
+	error.clear();
+	const uint64_t total = uint64_t(getHeight()) * jobs.size();
+
+	// Workers only read the map, the calling thread just reports progress meanwhile
+	std::atomic<size_t> next_job(0);
+	std::atomic<int> running(threads);
+	std::atomic<bool> ok(true);
+	std::vector<std::thread> workers;
+	for(int i = 0; i < threads; ++i) {
+		workers.push_back(std::thread([&]() {
+			for(size_t index = next_job++; index < jobs.size() && ok; index = next_job++) {
+				if(!writeFloor(jobs[index], extension))
+					ok = false;
+			}
+			--running;
+		}));
+	}
+
+	while(running > 0) {
+		if(showdialog)
+			g_gui.SetLoadDone(int(std::min<uint64_t>(99, rows_done * 100 / total)));
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	for(std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+		it->join();
+	return ok;
+}
+
+bool MinimapExporter::exportFloors(const FileName& directory, const wxString& name, const std::vector<int>& floors,
+	const wxString& extension, int threads, bool showdialog)
+{
+	std::vector<Job> jobs;
+	for(std::vector<int>::const_iterator it = floors.begin(); it != floors.end(); ++it) {
+		FileName file(name + "_" + i2ws(*it) + "." + extension);
+		file.Normalize(wxPATH_NORM_ALL, directory.GetFullPath());
+
+		Job job;
+		job.path = nstr(file.GetFullPath());
+		job.floor = *it;
+		jobs.push_back(job);
+	}
+	return run(jobs, nstr(extension), threads, showdialog);
+}
+
+bool MinimapExporter::exportFloor(const FileName& file, int floor, bool showdialog)
+{
+	wxString extension = file.GetExt();
+	if(extension.empty())
+		extension = "bmp";
+
+	std::vector<Job> jobs(1);
+	jobs[0].path = nstr(file.GetFullPath());
+	jobs[0].floor = floor;
+	return run(jobs, nstr(extension), 1, showdialog);
+}
+
+void MinimapExporter::setError(const wxString& message)
+{
+	std::lock_guard<std::mutex> lock(error_mutex);
+	if(error.empty())
+		error = message;
+}
+
+bool MinimapExportCommand::IsRequested(const wxArrayString& arguments)
+{
+	return arguments.Index("--export-minimap") != wxNOT_FOUND;
+}
+
+bool MinimapExportCommand::Run(const wxArrayString& arguments)
+{
+	g_gui.SetHeadless(true);
+
+	wxString mapPath;
+	wxString output = ".";
+	wxString name;
+	wxString format = "png";
+	long floor = -1;
+	long threads = 0;
+
+	bool valid = true;
+	for(size_t index = 1; index < arguments.size() && valid; ++index) {
+		const wxString& argument = arguments[index];
+		if(index + 1 == arguments.size()) {
+			g_gui.PrintMessage("Missing value for \"" + argument + "\".");
+			valid = false;
+			break;
+		}
+
+		const wxString& value = arguments[++index];
+		if(argument == "--export-minimap")
+			mapPath = value;
+		else if(argument == "--output")
+			output = value;
+		else if(argument == "--name")
+			name = value;
+		else if(argument == "--format")
+			format = value.Lower();
+		else if(argument == "--floor")
+			valid = value.ToLong(&floor) && floor >= 0 && floor <= MAP_MAX_LAYER;
+		else if(argument == "--threads")
+			valid = value.ToLong(&threads) && threads >= 0;
+		else {
+			g_gui.PrintMessage("Unknown argument \"" + argument + "\".");
+			valid = false;
+			break;
+		}
+
+		if(!valid)
+			g_gui.PrintMessage("Invalid value \"" + value + "\" for \"" + argument + "\".");
+	}
+
+	if(!valid || mapPath.empty() || (format != "png" && format != "bmp")) {
+		g_gui.PrintMessage("Usage: rme --export-minimap <map.otbm> [--output dir] [--name N] [--format png|bmp] [--floor N] [--threads N]");
+		return false;
+	}
+
+	if(ClientVersion::getLatestVersion() == nullptr) {
+		g_gui.PrintMessage("No client versions are configured, run the editor once to set them up.");
+		return false;
+	}
+
+	std::unique_ptr<Editor> editor;
+	try
+	{
+		editor.reset(newd Editor(g_gui.copybuffer, FileName(mapPath)));
+	}
+	catch(std::runtime_error& e)
+	{
+		g_gui.PrintMessage(wxString(e.what(), wxConvUTF8));
+		return false;
+	}
+
+	if(!editor->map.hasFile()) {
+		g_gui.PrintMessage("Could not load \"" + mapPath + "\": " + editor->map.getError());
+		return false;
+	}
+
+	MinimapExporter exporter(editor->map);
+	if(!exporter.computeBounds()) {
+		g_gui.PrintMessage("The map has no tiles, nothing to export.");
+		return true;
+	}
+
+	std::vector<int> floors;
+	if(floor >= 0)
+		floors.push_back(floor);
+	else {
+		for(int z = 0; z <= MAP_MAX_LAYER; ++z)
+			floors.push_back(z);
+	}
+
+	if(name.empty())
+		name = FileName(mapPath).GetName();
+
+	FileName directory;
+	directory.AssignDir(output);
+	directory.MakeAbsolute();
+
+	g_gui.PrintMessage(wxString::Format("Exporting %d floors of %dx%d tiles.",
+		int(floors.size()), exporter.getWidth(), exporter.getHeight()));
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	g_gui.CreateLoadBar("Exporting minimap");
+	const bool ok = exporter.exportFloors(directory, name, floors, format, threads, true);
+	g_gui.DestroyLoadBar();
+
+	if(!ok) {
+		g_gui.PrintMessage(exporter.getError());
+		return false;
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	g_gui.PrintMessage(wxString::Format("Exported to %s in %.2f seconds.", directory.GetFullPath(), seconds));
+	return true;
+}
@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_MINIMAP_EXPORT_H_
+#define RME_MINIMAP_EXPORT_H_
+
+#include <atomic>
+#include <mutex>
+
+class BaseMap;
+class Editor;
+
+// Writes minimap images of whole floors. The bounds come from the tree
+// leaves, floors are rendered on worker threads and every image is
+// streamed out a band of rows at a time, so memory doesn't grow with the map.
+class MinimapExporter
+{
+public:
+	MinimapExporter(BaseMap& map);
+
+	// Finds the area covering the tiles of every floor, so all images line up.
+	// Returns false if the map has no tiles.
+	bool computeBounds();
+	int getWidth() const { return max_x - min_x + 1; }
+	int getHeight() const { return max_y - min_y + 1; }
+
+	// Writes "<name>_<floor>.<extension>" into directory for each floor, with up to
+	// threads floors in flight (0 picks one per core). Waits until all are written.
+	bool exportFloors(const FileName& directory, const wxString& name, const std::vector<int>& floors,
+		const wxString& extension, int threads, bool showdialog);
+	bool exportFloor(const FileName& file, int floor, bool showdialog);
+
+	const wxString& getError() const { return error; }
+
+protected:
+	struct Job {
+		std::string path;
+		int floor;
+	};
+
+	bool run(const std::vector<Job>& jobs, const std::string& extension, int threads, bool showdialog);
+	bool writeFloor(const Job& job, const std::string& extension);
+	// Colours of rows [y, y + rows) across the bounds, one byte per tile
+	void renderRows(int floor, int y, int rows, uint8_t* out);
+	void setError(const wxString& message);
+
+	BaseMap& map;
+	int min_x, min_y;
+	int max_x, max_y;
+
+	std::atomic<uint64_t> rows_done;
+	std::mutex error_mutex;
+	wxString error;
+};
+
+// Exports every floor of a map without opening a window, started with
+//   rme --export-minimap map.otbm [--output dir] [--name N] [--format png|bmp]
+//       [--floor N] [--threads N]
+class MinimapExportCommand
+{
+public:
+	static bool IsRequested(const wxArrayString& arguments);
+	static bool Run(const wxArrayString& arguments);
+};
+
+#endif
@@ -39,16 +39,12 @@ MinimapWindow::MinimapWindow(wxWindow* parent) :
 	wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(205, 130)),
 	update_timer(this)
 {
-	for(int i = 0; i < 256; ++i) {
-		pens[i] = newd wxPen(wxColor(minimap_color[i].red, minimap_color[i].green, minimap_color[i].blue));
-	}
+	////
 }
 
 MinimapWindow::~MinimapWindow()
 {
-	for(int i = 0; i < 256; ++i) {
-		delete pens[i];
-	}
+	////
 }
 
 void MinimapWindow::OnSize(wxSizeEvent& event)
@@ -125,22 +121,13 @@ void MinimapWindow::OnPaint(wxPaintEvent& event)
 	int floor = g_gui.GetCurrentFloor();
 
 	//printf("Draw from %d:%d to %d:%d\n", start_x, start_y, end_x, end_y);
-	uint8_t last = 0;
 	if(g_gui.IsRenderingEnabled()) {
-		for(int y = start_y, window_y = 0; y <= end_y; ++y, ++window_y) {
-			for(int x = start_x, window_x = 0; x <= end_x; ++x, ++window_x) {
-				Tile* tile = editor.map.getTile(x, y, floor);
-				if(tile) {
-					uint8_t color = tile->getMiniMapColor();
-					if(color) {
-						if(last != color) {
-							pdc.SetPen(*pens[color]);
-							last = color;
-						}
-						pdc.DrawPoint(window_x, window_y);
-					}
-				}
+		if(window_width > 0 && window_height > 0) {
+			if(!buffer.IsOk() || buffer.GetWidth() != window_width || buffer.GetHeight() != window_height) {
+				buffer.Create(window_width, window_height, false);
 			}
+			editor.map.minimap_cache.getRGB(start_x, start_y, floor, window_width, window_height, buffer.GetData());
+			pdc.DrawBitmap(wxBitmap(buffer), 0, 0);
 		}
 
 		if(g_settings.getInteger(Config::MINIMAP_VIEW_BOX)) {
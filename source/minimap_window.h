@@ -33,7 +33,8 @@ public:
 	void OnDelayedUpdate(wxTimerEvent& event);
 	void OnKey(wxKeyEvent& event);
 protected:
-	wxPen* pens[256];
+	// Colours of the visible area, drawn in one go
+	wxImage buffer;
 	wxTimer	update_timer;
 	int last_start_x;
 	int last_start_y;
@@ -19,13 +19,13 @@
 
 #include "monster.h"
 
-Monster::Monster(MonsterType* ctype) : direction(NORTH), spawntime(0), saved(false), selected(false)
+Monster::Monster(MonsterType* ctype) : type(nullptr), type_generation(0), direction(NORTH), spawntime(0), saved(false), selected(false)
 {
 	if(ctype)
 		type_name = ctype->name;
 }
 
-Monster::Monster(std::string ctype_name) : type_name(ctype_name), direction(NORTH), spawntime(0), saved(false), selected(false)
+Monster::Monster(std::string ctype_name) : type_name(ctype_name), type(nullptr), type_generation(0), direction(NORTH), spawntime(0), saved(false), selected(false)
 {
 	////
 }
@@ -58,6 +58,8 @@ uint16_t Monster::DirName2ID(std::string dir)
 Monster* Monster::deepCopy() const
 {
 	Monster* copy = newd Monster(type_name);
+	copy->type = type;
+	copy->type_generation = type_generation;
 	copy->spawntime = spawntime;
 	copy->direction = direction;
 	copy->selected = selected;
@@ -65,9 +67,14 @@ Monster* Monster::deepCopy() const
 	return copy;
 }
 
+bool Monster::hasCurrentType() const
+{
+	return getType() == g_monsters[type_name];
+}
+
 const Outfit& Monster::getLookType() const
 {
-	MonsterType* type = g_monsters[type_name];
+	MonsterType* type = getType();
 	if(type)
 		return type->outfit;
 	static const Outfit otfi; // Empty outfit
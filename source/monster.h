@@ -45,6 +45,8 @@ public:
 
 	std::string getName() const;
 	MonsterBrush* getBrush() const;
+	// Whether the cached type is still the one the database holds under the name
+	bool hasCurrentType() const;
 
 	int getSpawnMonsterTime() const {return spawntime;}
 	void setSpawnMonsterTime(int spawntime) {this->spawntime = spawntime;}
@@ -53,7 +55,12 @@ public:
 	void setDirection(Direction direction) { this->direction = direction; }
 
 protected:
+	// Resolved from the name, again once the database changed
+	MonsterType* getType() const;
+
 	std::string type_name;
+	mutable MonsterType* type;
+	mutable uint32_t type_generation;
 	Direction direction;
 	int spawntime;
 	bool saved;
@@ -72,15 +79,23 @@ inline bool Monster::isSaved() {
 	return saved;
 }
 
+inline MonsterType* Monster::getType() const {
+	if(type_generation != g_monsters.getGeneration()) {
+		type = g_monsters[type_name];
+		type_generation = g_monsters.getGeneration();
+	}
+	return type;
+}
+
 inline std::string Monster::getName() const {
-	MonsterType* type = g_monsters[type_name];
+	MonsterType* type = getType();
 	if(type) {
 		return type->name;
 	}
 	return "";
 }
 inline MonsterBrush* Monster::getBrush() const {
-	MonsterType* type = g_monsters[type_name];
+	MonsterType* type = getType();
 	if(type) {
 		return type->brush;
 	}
@@ -161,7 +161,7 @@ MonsterType* MonsterType::loadFromOTXML(const FileName& filename, pugi::xml_docu
 	return ct;
 }
 
-MonsterDatabase::MonsterDatabase()
+MonsterDatabase::MonsterDatabase() : generation(1)
 {
 	////
 }
@@ -177,6 +177,7 @@ void MonsterDatabase::clear()
 		delete iter->second;
 	}
 	monster_map.clear();
+	++generation;
 }
 
 MonsterType* MonsterDatabase::operator[](const std::string& name)
@@ -198,6 +199,7 @@ MonsterType* MonsterDatabase::addMissingMonsterType(const std::string& name)
 	ct->outfit.lookType = 130;
 
 	monster_map.insert(std::make_pair(as_lower_str(name), ct));
+	++generation;
 	return ct;
 }
 
@@ -211,6 +213,7 @@ MonsterType* MonsterDatabase::addMonsterType(const std::string& name, const Outf
 	ct->outfit = outfit;
 
 	monster_map.insert(std::make_pair(as_lower_str(name), ct));
+	++generation;
 	return ct;
 }
 
@@ -252,6 +255,7 @@ bool MonsterDatabase::loadFromXML(const FileName& filename, bool standard, wxStr
 				delete monsterType;
 			} else {
 				monster_map[as_lower_str(monsterType->name)] = monsterType;
+				++generation;
 			}
 		}
 	}
@@ -296,6 +300,7 @@ bool MonsterDatabase::importXMLFromOT(const FileName& filename, wxString& error,
 					delete monsterType;
 				} else {
 					monster_map[as_lower_str(monsterType->name)] = monsterType;
+					++generation;
 
 					Tileset* tileSet = nullptr;
 					tileSet = g_materials.tilesets["Monsters"];
@@ -319,6 +324,7 @@ bool MonsterDatabase::importXMLFromOT(const FileName& filename, wxString& error,
 				delete monsterType;
 			} else {
 				monster_map[as_lower_str(monsterType->name)] = monsterType;
+				++generation;
 
 				Tileset* tileSet = nullptr;
 				tileSet = g_materials.tilesets["Monsters"];
@@ -32,6 +32,8 @@ class MonsterDatabase
 {
 protected:
 	MonsterMap monster_map;
+	// Changes whenever types are added or deleted, creatures re-resolve their type then
+	uint32_t generation;
 
 public:
 	typedef MonsterMap::iterator iterator;
@@ -43,6 +45,7 @@ public:
 	void clear();
 
 	MonsterType* operator[](const std::string& name);
+	uint32_t getGeneration() const { return generation; }
 	MonsterType* addMissingMonsterType(const std::string& name);
 	MonsterType* addMonsterType(const std::string& name, const Outfit& outfit);
 
@@ -17,14 +17,85 @@
 
 #include "main.h"
 #include "net_connection.h"
+#include "settings.h"
 
+// NetworkBufferPool
+NetworkBufferPool::NetworkBufferPool() :
+	mutex(), buffers()
+{
+	buffers.reserve(NETWORK_POOL_MAX_BUFFERS);
+}
+
+NetworkBufferPool& NetworkBufferPool::getInstance()
+{
+	// Never destroyed, messages may still be released during static destruction
+	static NetworkBufferPool* instance = newd NetworkBufferPool();
+	return *instance;
+}
+
+std::vector<uint8_t> NetworkBufferPool::acquire()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!buffers.empty()) {
+			std::vector<uint8_t> buffer = std::move(buffers.back());
+			buffers.pop_back();
+			return buffer;
+		}
+	}
+
+	std::vector<uint8_t> buffer;
+	buffer.reserve(NETWORK_BUFFER_INITIAL_CAPACITY);
+	return buffer;
+}
+
+void NetworkBufferPool::release(std::vector<uint8_t>& buffer)
+{
+	if(buffer.capacity() == 0 || buffer.capacity() > NETWORK_POOL_MAX_CAPACITY) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if(buffers.size() < NETWORK_POOL_MAX_BUFFERS) {
+		buffer.clear();
+		buffers.push_back(std::move(buffer));
+	}
+}
+
+// NetworkMessage
 NetworkMessage::NetworkMessage()
 {
 	clear();
 }
 
+NetworkMessage::NetworkMessage(NetworkMessage&& other) :
+	buffer(std::move(other.buffer)), position(other.position), size(other.size)
+{
+	//
+}
+
+NetworkMessage::~NetworkMessage()
+{
+	NetworkBufferPool::getInstance().release(buffer);
+}
+
+NetworkMessage& NetworkMessage::operator=(NetworkMessage&& other)
+{
+	if(this != &other) {
+		NetworkBufferPool::getInstance().release(buffer);
+		buffer = std::move(other.buffer);
+		position = other.position;
+		size = other.size;
+	}
+	return *this;
+}
+
 void NetworkMessage::clear()
 {
+	// Moved from, take a recycled buffer instead of growing an empty one
+	if(buffer.capacity() == 0) {
+		buffer = NetworkBufferPool::getInstance().acquire();
+	}
 	buffer.resize(4);
 	position = 4;
 	size = 0;
@@ -46,6 +117,24 @@ template<> std::string NetworkMessage::read<std::string>()
 	return std::string(strBuffer, length);
 }
 
+NetworkSpan NetworkMessage::readSpan()
+{
+	NetworkSpan span;
+	span.size = read<uint16_t>();
+	span.data = buffer.data() + position;
+	position += span.size;
+	return span;
+}
+
+void NetworkMessage::writeSpan(const uint8_t* data, size_t length)
+{
+	write<uint16_t>(length);
+
+	expand(length);
+	memcpy(&buffer[position], data, length);
+	position += length;
+}
+
 template<> Position NetworkMessage::read<Position>()
 {
 	Position position;
@@ -72,9 +161,355 @@ template<> void NetworkMessage::write<Position>(const Position& value)
 	write<uint8_t>(value.z);
 }
 
+// NetworkCompressor
+NetworkCompressor::NetworkCompressor() :
+	deflateReady(false), inflateReady(false)
+{
+	memset(&deflateStream, 0, sizeof(deflateStream));
+	memset(&inflateStream, 0, sizeof(inflateStream));
+}
+
+NetworkCompressor::~NetworkCompressor()
+{
+	if(deflateReady) {
+		deflateEnd(&deflateStream);
+	}
+	if(inflateReady) {
+		inflateEnd(&inflateStream);
+	}
+}
+
+bool NetworkCompressor::compress(const NetworkMessage& message, NetworkMessage& compressed)
+{
+	if(message.size < NETWORK_COMPRESSION_THRESHOLD) {
+		return false;
+	}
+
+	if(!deflateReady) {
+		if(deflateInit(&deflateStream, Z_BEST_SPEED) != Z_OK) {
+			return false;
+		}
+		deflateReady = true;
+	} else {
+		deflateReset(&deflateStream);
+	}
+
+	const uLong bound = deflateBound(&deflateStream, message.size);
+	compressed.buffer.resize(8 + bound);
+
+	deflateStream.next_in = const_cast<Bytef*>(&message.buffer[4]);
+	deflateStream.avail_in = message.size;
+	deflateStream.next_out = &compressed.buffer[8];
+	deflateStream.avail_out = bound;
+	if(deflate(&deflateStream, Z_FINISH) != Z_STREAM_END) {
+		return false;
+	}
+
+	const size_t deflatedSize = bound - deflateStream.avail_out;
+	if(deflatedSize + 4 >= message.size) {
+		return false;
+	}
+
+	const uint32_t rawSize = message.size;
+	memcpy(&compressed.buffer[4], &rawSize, 4);
+
+	compressed.size = deflatedSize + 4;
+	compressed.position = compressed.size + 4;
+	compressed.buffer.resize(compressed.position);
+
+	const uint32_t header = compressed.size | NETWORK_MESSAGE_COMPRESSED;
+	memcpy(&compressed.buffer[0], &header, 4);
+	return true;
+}
+
+bool NetworkCompressor::decompress(NetworkMessage& message)
+{
+	if(message.buffer.size() < 8) {
+		return false;
+	}
+
+	uint32_t rawSize;
+	memcpy(&rawSize, &message.buffer[4], 4);
+	if(rawSize > NETWORK_MAX_MESSAGE_SIZE) {
+		return false;
+	}
+
+	if(!inflateReady) {
+		if(inflateInit(&inflateStream) != Z_OK) {
+			return false;
+		}
+		inflateReady = true;
+	} else {
+		inflateReset(&inflateStream);
+	}
+
+	std::vector<uint8_t> buffer = NetworkBufferPool::getInstance().acquire();
+	buffer.resize(rawSize + 4);
+	inflateStream.next_in = &message.buffer[8];
+	inflateStream.avail_in = message.buffer.size() - 8;
+	inflateStream.next_out = &buffer[4];
+	inflateStream.avail_out = rawSize;
+	if(inflate(&inflateStream, Z_FINISH) != Z_STREAM_END || inflateStream.avail_out != 0) {
+		NetworkBufferPool::getInstance().release(buffer);
+		return false;
+	}
+
+	message.buffer.swap(buffer);
+	NetworkBufferPool::getInstance().release(buffer);
+	message.position = 4;
+	message.size = rawSize;
+	return true;
+}
+
+// NetworkMessageQueue
+NetworkMessageQueue::NetworkMessageQueue() :
+	handler(), alive(std::make_shared<std::atomic<bool>>(true)), head(&stub), tail(&stub), stub(), scheduled(false)
+{
+	stub.next.store(nullptr);
+}
+
+NetworkMessageQueue::~NetworkMessageQueue()
+{
+	*alive = false;
+	while(Node* node = pop()) {
+		delete node;
+	}
+}
+
+void NetworkMessageQueue::push(NetworkMessage&& message)
+{
+	Node* node = newd Node(std::move(message));
+	link(node);
+
+	if(!scheduled.exchange(true)) {
+		std::shared_ptr<std::atomic<bool>> queueAlive = alive;
+		wxTheApp->CallAfter([this, queueAlive]() {
+			if(*queueAlive) {
+				drain();
+			}
+		});
+	}
+}
+
+void NetworkMessageQueue::link(Node* node)
+{
+	node->next.store(nullptr, std::memory_order_relaxed);
+	Node* previous = head.exchange(node, std::memory_order_acq_rel);
+	previous->next.store(node, std::memory_order_release);
+}
+
+NetworkMessageQueue::Node* NetworkMessageQueue::pop()
+{
+	Node* node = tail;
+	Node* next = node->next.load(std::memory_order_acquire);
+	if(node == &stub) {
+		if(!next) {
+			return nullptr;
+		}
+		tail = next;
+		node = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+
+	if(next) {
+		tail = next;
+		return node;
+	}
+
+	// A push is halfway done, the drain it schedules will pick it up
+	if(node != head.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+
+	link(&stub);
+	next = node->next.load(std::memory_order_acquire);
+	if(next) {
+		tail = next;
+		return node;
+	}
+	return nullptr;
+}
+
+void NetworkMessageQueue::drain()
+{
+	// Cleared first, so anything pushed from now on schedules another drain
+	scheduled.store(false);
+	while(Node* node = pop()) {
+		if(handler) {
+			handler(node->message);
+		}
+		delete node;
+	}
+}
+
+// NetworkSendQueue
+NetworkSendQueue::NetworkSendQueue(boost::asio::ip::tcp::socket& socket, boost::asio::io_service::strand& strand) :
+	socket(socket), strand(strand), errorHandler(), idleHandler(), closedHandler(),
+	alive(std::make_shared<std::atomic<bool>>(true)), mutex(), pending(),
+	pendingBytes(0), highWaterMark(256 * 1024), active(false), closing(false)
+{
+	//
+}
+
+size_t NetworkSendQueue::getPendingBytes() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pendingBytes;
+}
+
+bool NetworkSendQueue::isCongested() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pendingBytes > highWaterMark;
+}
+
+void NetworkSendQueue::send(const SharedNetworkMessage& message)
+{
+	push(Entry{message, 0, false});
+}
+
+void NetworkSendQueue::sendCursor(const SharedNetworkMessage& message, uint32_t cursorId)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(pendingBytes > highWaterMark) {
+			for(Entry& entry : pending) {
+				if(entry.cursor && entry.cursorId == cursorId) {
+					pendingBytes -= entry.message->size;
+					pendingBytes += message->size;
+					entry.message = message;
+					return;
+				}
+			}
+		}
+	}
+	push(Entry{message, cursorId, true});
+}
+
+void NetworkSendQueue::push(const Entry& entry)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if(closing) {
+		return;
+	}
+
+	pending.push_back(entry);
+	pendingBytes += entry.message->size + 4;
+
+	if(!active) {
+		// Writes are always started on the socket's strand
+		active = true;
+		std::shared_ptr<std::atomic<bool>> queueAlive = alive;
+		strand.post([this, queueAlive]() {
+			if(*queueAlive) {
+				write();
+			}
+		});
+	}
+}
+
+void NetworkSendQueue::close(const ClosedHandler& closed)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if(closing) {
+		return;
+	}
+
+	closing = true;
+	closedHandler = closed;
+	if(!active) {
+		// Nothing in flight, the write finds the queue empty and closes it
+		active = true;
+		std::shared_ptr<std::atomic<bool>> queueAlive = alive;
+		strand.post([this, queueAlive]() {
+			if(*queueAlive) {
+				write();
+			}
+		});
+	}
+}
+
+void NetworkSendQueue::stop()
+{
+	*alive = false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.clear();
+	pendingBytes = 0;
+	closing = true;
+}
+
+void NetworkSendQueue::finishClose()
+{
+	boost::system::error_code error;
+	socket.close(error);
+	if(closedHandler) {
+		closedHandler();
+	}
+}
+
+void NetworkSendQueue::write()
+{
+	std::vector<boost::asio::const_buffer> buffers;
+	// Owned by the handler, so the buffers stay valid as long as the write does
+	std::shared_ptr<std::vector<SharedNetworkMessage>> writing = std::make_shared<std::vector<SharedNetworkMessage>>();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if(pending.empty()) {
+			active = false;
+			const bool closeNow = closing;
+			lock.unlock();
+
+			if(closeNow) {
+				finishClose();
+			} else if(idleHandler) {
+				idleHandler();
+			}
+			return;
+		}
+
+		buffers.reserve(pending.size());
+		writing->reserve(pending.size());
+		for(Entry& entry : pending) {
+			buffers.push_back(boost::asio::buffer(entry.message->buffer.data(), entry.message->size + 4));
+			writing->push_back(std::move(entry.message));
+		}
+		pending.clear();
+		pendingBytes = 0;
+	}
+
+	std::shared_ptr<std::atomic<bool>> queueAlive = alive;
+	boost::asio::async_write(socket, buffers, strand.wrap(
+		[this, queueAlive, writing](const boost::system::error_code& error, size_t bytesTransferred) -> void {
+			if(!*queueAlive) {
+				return;
+			}
+
+			bool closeNow = false;
+			if(error) {
+				std::lock_guard<std::mutex> lock(mutex);
+				pending.clear();
+				pendingBytes = 0;
+				active = false;
+				closeNow = closing;
+			}
+
+			if(error) {
+				if(closeNow) {
+					finishClose();
+				} else if(errorHandler) {
+					errorHandler(error);
+				}
+				return;
+			}
+			write();
+		}
+	));
+}
+
 // NetworkConnection
 NetworkConnection::NetworkConnection() :
-	service(nullptr), thread(), stopped(false)
+	service(nullptr), work(), threads(), stopped(false)
 {
 	//
 }
@@ -92,7 +527,7 @@ NetworkConnection& NetworkConnection::getInstance()
 
 bool NetworkConnection::start()
 {
-	if(thread.joinable()) {
+	if(!threads.empty()) {
 		if(stopped) {
 			return false;
 		}
@@ -103,18 +538,22 @@ bool NetworkConnection::start()
 	if(!service) {
 		service = new boost::asio::io_service;
 	}
+	work.reset(new boost::asio::io_service::work(*service));
 
-	thread = std::thread([this]() -> void {
-		boost::asio::io_service& serviceRef = *service;
-		try {
+	const int32_t threadCount = std::max<int32_t>(g_settings.getInteger(Config::NETWORK_THREADS), 1);
+	for(int32_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back([this]() -> void {
+			boost::asio::io_service& serviceRef = *service;
 			while(!stopped) {
-				serviceRef.run_one();
-				serviceRef.reset();
+				try {
+					serviceRef.run();
+					break;
+				} catch (std::exception& e) {
+					std::cout << e.what() << std::endl;
+				}
 			}
-		} catch (std::exception& e) {
-			std::cout << e.what() << std::endl;
-		}
-	});
+		});
+	}
 	return true;
 }
 
@@ -124,9 +563,13 @@ void NetworkConnection::stop()
 		return;
 	}
 
-	service->stop();
 	stopped = true;
-	thread.join();
+	work.reset();
+	service->stop();
+	for(std::thread& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
 
 	delete service;
 	service = nullptr;
@@ -136,3 +579,20 @@ boost::asio::io_service& NetworkConnection::get_service()
 {
 	return *service;
 }
+
+void NetworkConnection::runOnStrand(boost::asio::io_service::strand& strand, const std::function<void()>& function)
+{
+	// Nothing would run it without the threads
+	if(threads.empty() || stopped) {
+		function();
+		return;
+	}
+
+	std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+	std::future<void> finished = done->get_future();
+	strand.post([function, done]() {
+		function();
+		done->set_value();
+	});
+	finished.wait();
+}
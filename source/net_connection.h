@@ -23,12 +23,50 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+
+#include <zlib.h>
+
+// Bytes inside a message buffer, valid until the message is changed or destroyed
+struct NetworkSpan
+{
+	const uint8_t* data;
+	size_t size;
+};
+
+// Buffers of destroyed messages are kept for the next ones, so steady traffic
+// doesn't allocate. They keep their capacity, unusually large ones are freed.
+class NetworkBufferPool
+{
+	public:
+		static NetworkBufferPool& getInstance();
+
+		std::vector<uint8_t> acquire();
+		void release(std::vector<uint8_t>& buffer);
+
+	private:
+		NetworkBufferPool();
+		NetworkBufferPool(const NetworkBufferPool& copy) = delete;
+
+		std::mutex mutex;
+		std::vector<std::vector<uint8_t>> buffers;
+};
 
 struct NetworkMessage
 {
 	NetworkMessage();
+	NetworkMessage(const NetworkMessage& other) = default;
+	NetworkMessage(NetworkMessage&& other);
+	~NetworkMessage();
+
+	NetworkMessage& operator=(const NetworkMessage& other) = default;
+	NetworkMessage& operator=(NetworkMessage&& other);
 
 	void clear();
 	void expand(const size_t length);
@@ -41,6 +79,10 @@ struct NetworkMessage
 		return value;
 	}
 
+	// Same layout as a string, but points into the buffer instead of copying
+	NetworkSpan readSpan();
+	void writeSpan(const uint8_t* data, size_t length);
+
 	template<typename T> void write(const T& value)
 	{
 		expand(sizeof(T));
@@ -54,11 +96,153 @@ struct NetworkMessage
 	size_t size;
 };
 
+// Immutable message shared between several peers, its size header must already be written
+typedef std::shared_ptr<const NetworkMessage> SharedNetworkMessage;
+
+enum : uint32_t {
+	// Set in the size header when the payload is deflated
+	NETWORK_MESSAGE_COMPRESSED = 0x80000000,
+	// Smaller messages are never worth compressing
+	NETWORK_COMPRESSION_THRESHOLD = 512,
+	// Refuse to inflate anything larger than this
+	NETWORK_MAX_MESSAGE_SIZE = 64 * 1024 * 1024,
+	// Fresh buffers start this large, most messages never grow past it
+	NETWORK_BUFFER_INITIAL_CAPACITY = 1024,
+	// NetworkBufferPool limits
+	NETWORK_POOL_MAX_BUFFERS = 128,
+	NETWORK_POOL_MAX_CAPACITY = 256 * 1024,
+};
+
+// zlib streams of one socket, created once and reset for every message.
+// A compressed payload is the uncompressed size followed by the deflate data.
+class NetworkCompressor
+{
+	public:
+		NetworkCompressor();
+		~NetworkCompressor();
+
+		// Returns false if the message is too small or doesn't shrink
+		bool compress(const NetworkMessage& message, NetworkMessage& compressed);
+		// Replaces a received compressed payload with the original one
+		bool decompress(NetworkMessage& message);
+
+	private:
+		NetworkCompressor(const NetworkCompressor& copy) = delete;
+
+		z_stream deflateStream;
+		z_stream inflateStream;
+		bool deflateReady;
+		bool inflateReady;
+};
+
 template<> std::string NetworkMessage::read<std::string>();
 template<> Position NetworkMessage::read<Position>();
 template<> void NetworkMessage::write<std::string>(const std::string& value);
 template<> void NetworkMessage::write<Position>(const Position& value);
 
+// Received messages handed from the network threads to the UI thread.
+// Pushing never blocks: it links the message into a lock-free list and
+// schedules a drain on the UI thread unless one is already pending.
+class NetworkMessageQueue
+{
+	public:
+		typedef std::function<void(NetworkMessage&)> Handler;
+
+		NetworkMessageQueue();
+		~NetworkMessageQueue();
+
+		void setHandler(const Handler& newHandler) { handler = newHandler; }
+
+		// Any thread
+		void push(NetworkMessage&& message);
+
+	private:
+		NetworkMessageQueue(const NetworkMessageQueue& copy) = delete;
+
+		struct Node {
+			Node() : message(), next(nullptr) {}
+			explicit Node(NetworkMessage&& message) : message(std::move(message)), next(nullptr) {}
+
+			NetworkMessage message;
+			std::atomic<Node*> next;
+		};
+
+		void link(Node* node);
+		// UI thread only, returns nullptr when empty
+		Node* pop();
+		void drain();
+
+		Handler handler;
+		// Cleared on destruction, checked by the drain queued for the UI thread
+		std::shared_ptr<std::atomic<bool>> alive;
+
+		std::atomic<Node*> head;
+		Node* tail;
+		Node stub;
+		std::atomic<bool> scheduled;
+};
+
+// Outgoing messages of one socket. Messages are written in the order they
+// were queued, and everything queued while a write is in flight goes out
+// together in a single gathered write once it completes.
+// All socket operations run on the socket's strand.
+class NetworkSendQueue
+{
+	public:
+		typedef std::function<void(const boost::system::error_code&)> ErrorHandler;
+		typedef std::function<void()> IdleHandler;
+		typedef std::function<void()> ClosedHandler;
+
+		NetworkSendQueue(boost::asio::ip::tcp::socket& socket, boost::asio::io_service::strand& strand);
+
+		void setErrorHandler(const ErrorHandler& handler) { errorHandler = handler; }
+		// Called on the network thread whenever everything queued has been written
+		void setIdleHandler(const IdleHandler& handler) { idleHandler = handler; }
+		void setHighWaterMark(size_t bytes) { highWaterMark = bytes; }
+
+		void send(const SharedNetworkMessage& message);
+		// Once more than highWaterMark bytes are waiting, a cursor update
+		// replaces the pending one with the same id instead of queueing
+		void sendCursor(const SharedNetworkMessage& message, uint32_t cursorId);
+
+		size_t getPendingBytes() const;
+		// More than highWaterMark bytes are waiting to be written
+		bool isCongested() const;
+
+		// Closes the socket once everything queued so far has been written and
+		// calls closed on the network thread. Messages sent after this are dropped.
+		void close(const ClosedHandler& closed);
+		// Strand only. Drops whatever is queued, no handler of the queue touches
+		// it afterwards, so it can be destroyed once the socket is closed.
+		void stop();
+
+	private:
+		struct Entry {
+			SharedNetworkMessage message;
+			uint32_t cursorId;
+			bool cursor;
+		};
+
+		void push(const Entry& entry);
+		void write();
+		void finishClose();
+
+		boost::asio::ip::tcp::socket& socket;
+		boost::asio::io_service::strand& strand;
+		ErrorHandler errorHandler;
+		IdleHandler idleHandler;
+		ClosedHandler closedHandler;
+		// Cleared by stop(), checked by every handler of the queue
+		std::shared_ptr<std::atomic<bool>> alive;
+
+		mutable std::mutex mutex;
+		std::deque<Entry> pending;
+		size_t pendingBytes;
+		size_t highWaterMark;
+		bool active;
+		bool closing;
+};
+
 class NetworkConnection
 {
 	private:
@@ -75,10 +259,16 @@ class NetworkConnection
 
 		boost::asio::io_service& get_service();
 
+		// Runs function on the strand and waits for it, so no other handler of
+		// the strand is running once this returns. Never call it from a strand.
+		void runOnStrand(boost::asio::io_service::strand& strand, const std::function<void()>& function);
+
 	private:
 		boost::asio::io_service* service;
-		std::thread thread;
-		bool stopped;
+		// Keeps run() from returning while there is nothing to do
+		std::unique_ptr<boost::asio::io_service::work> work;
+		std::vector<std::thread> threads;
+		std::atomic<bool> stopped;
 };
 
 #endif
@@ -19,13 +19,13 @@
 
 #include "npc.h"
 
-Npc::Npc(NpcType* type) : direction(NORTH), spawnNpcTime(0), saved(false), selected(false)
+Npc::Npc(NpcType* npcType) : type(nullptr), type_generation(0), direction(NORTH), spawnNpcTime(0), saved(false), selected(false)
 {
-	if(type)
-		type_name = type->name;
+	if(npcType)
+		type_name = npcType->name;
 }
 
-Npc::Npc(std::string type_name) : type_name(type_name), direction(NORTH), spawnNpcTime(0), saved(false), selected(false)
+Npc::Npc(std::string type_name) : type_name(type_name), type(nullptr), type_generation(0), direction(NORTH), spawnNpcTime(0), saved(false), selected(false)
 {
 	////
 }
@@ -58,6 +58,8 @@ uint16_t Npc::DirName2ID(std::string dir)
 Npc* Npc::deepCopy() const
 {
 	Npc* copy = newd Npc(type_name);
+	copy->type = type;
+	copy->type_generation = type_generation;
 	copy->spawnNpcTime = spawnNpcTime;
 	copy->direction = direction;
 	copy->selected = selected;
@@ -65,9 +67,14 @@ Npc* Npc::deepCopy() const
 	return copy;
 }
 
+bool Npc::hasCurrentType() const
+{
+	return getType() == g_npcs[type_name];
+}
+
 const Outfit& Npc::getLookType() const
 {
-	NpcType* type = g_npcs[type_name];
+	NpcType* type = getType();
 	if(type)
 		return type->outfit;
 	static const Outfit otfi; // Empty outfit
@@ -45,6 +45,8 @@ public:
 
 	std::string getName() const;
 	NpcBrush* getBrush() const;
+	// Whether the cached type is still the one the database holds under the name
+	bool hasCurrentType() const;
 
 	int getSpawnNpcTime() const {return spawnNpcTime;}
 	void setSpawnNpcTime(int spawnNpcTime) {this->spawnNpcTime = spawnNpcTime;}
@@ -53,7 +55,12 @@ public:
 	void setDirection(Direction direction) { this->direction = direction; }
 
 protected:
+	// Resolved from the name, again once the database changed
+	NpcType* getType() const;
+
 	std::string type_name;
+	mutable NpcType* type;
+	mutable uint32_t type_generation;
 	Direction direction;
 	int spawnNpcTime;
 	bool saved;
@@ -72,15 +79,23 @@ inline bool Npc::isSaved() {
 	return saved;
 }
 
+inline NpcType* Npc::getType() const {
+	if(type_generation != g_npcs.getGeneration()) {
+		type = g_npcs[type_name];
+		type_generation = g_npcs.getGeneration();
+	}
+	return type;
+}
+
 inline std::string Npc::getName() const {
-	NpcType* npcType = g_npcs[type_name];
+	NpcType* npcType = getType();
 	if(npcType) {
 		return npcType->name;
 	}
 	return "";
 }
 inline NpcBrush* Npc::getBrush() const {
-	NpcType* npcType = g_npcs[type_name];
+	NpcType* npcType = getType();
 	if(npcType) {
 		return npcType->brush;
 	}
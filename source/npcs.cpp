@@ -163,7 +163,7 @@ NpcType* NpcType::loadFromOTXML(const FileName& filename, pugi::xml_document& do
 	return npcType;
 }
 
-NpcDatabase::NpcDatabase()
+NpcDatabase::NpcDatabase() : generation(1)
 {
 	////
 }
@@ -179,6 +179,7 @@ void NpcDatabase::clear()
 		delete iter->second;
 	}
 	npcMap.clear();
+	++generation;
 }
 
 NpcType* NpcDatabase::operator[](const std::string& name)
@@ -200,6 +201,7 @@ NpcType* NpcDatabase::addMissingNpcType(const std::string& name)
 	npcType->outfit.lookType = 130;
 
 	npcMap.insert(std::make_pair(as_lower_str(name), npcType));
+	++generation;
 	return npcType;
 }
 
@@ -213,6 +215,7 @@ NpcType* NpcDatabase::addNpcType(const std::string& name, const Outfit& outfit)
 	npcType->outfit = outfit;
 
 	npcMap.insert(std::make_pair(as_lower_str(name), npcType));
+	++generation;
 	return npcType;
 }
 
@@ -254,6 +257,7 @@ bool NpcDatabase::loadFromXML(const FileName& filename, bool standard, wxString&
 				delete npcType;
 			} else {
 				npcMap[as_lower_str(npcType->name)] = npcType;
+				++generation;
 			}
 		}
 	}
@@ -280,6 +284,7 @@ bool NpcDatabase::importXMLFromOT(const FileName& filename, wxString& error, wxA
 				delete npcType;
 			} else {
 				npcMap[as_lower_str(npcType->name)] = npcType;
+				++generation;
 
 				Tileset* tileSet = nullptr;
 				tileSet = g_materials.tilesets["NPCs"];
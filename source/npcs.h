@@ -32,6 +32,8 @@ class NpcDatabase
 {
 protected:
 	NpcMap npcMap;
+	// Changes whenever types are added or deleted, creatures re-resolve their type then
+	uint32_t generation;
 
 public:
 	typedef NpcMap::iterator iterator;
@@ -43,6 +45,7 @@ public:
 	void clear();
 
 	NpcType* operator[](const std::string& name);
+	uint32_t getGeneration() const { return generation; }
 	NpcType* addMissingNpcType(const std::string& name);
 	NpcType* addNpcType(const std::string& name, const Outfit& outfit);
 
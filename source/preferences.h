@@ -80,9 +80,7 @@ protected:
 	wxColourPickerCtrl* cursor_alt_color_pick;
 	/*
 	wxCheckBox* texture_managment_chkbox;
-	wxSpinCtrl* clean_interval_spin;
-	wxSpinCtrl* texture_longevity_spin;
-	wxSpinCtrl* texture_threshold_spin;
+	wxSpinCtrl* texture_budget_spin;
 	wxSpinCtrl* software_threshold_spin;
 	wxSpinCtrl* software_clean_amount_spin;
 	*/
@@ -225,6 +225,7 @@ void Settings::IO(IOMode mode)
 	section("Editor");
 	String(RECENT_FILES, "");
 	Int(WORKER_THREADS, 1);
+	Int(NETWORK_THREADS, 2);
 	Int(MERGE_MOVE, 0);
 	Int(MERGE_PASTE, 0);
 	Int(UNDO_SIZE, 400);
@@ -268,9 +269,9 @@ void Settings::IO(IOMode mode)
 
 	section("Graphics");
 	Int(TEXTURE_MANAGEMENT, 1);
-	Int(TEXTURE_CLEAN_PULSE, 15);
-	Int(TEXTURE_LONGEVITY, 20);
-	Int(TEXTURE_CLEAN_THRESHOLD, 2500);
+	Int(TEXTURE_CACHE_BUDGET, 64);
+	Int(SPRITE_DECODE_THREADS, 2);
+	Float(MINIMAP_PYRAMID_ZOOM, 10.0f);
 	Int(SOFTWARE_CLEAN_THRESHOLD, 1800);
 	Int(SOFTWARE_CLEAN_SIZE, 500);
 	Int(ICON_BACKGROUND, 0);
@@ -287,6 +288,8 @@ void Settings::IO(IOMode mode)
 	Int(CURSOR_GREEN, 166);
 	Int(CURSOR_BLUE, 0);
 	Int(CURSOR_ALPHA, 128);
+	Int(LIVE_CURSOR_INTERVAL, 50);
+	Int(LIVE_SEND_HIGH_WATER_MARK, 256);
 	Int(CURSOR_ALT_RED, 0);
 	Int(CURSOR_ALT_GREEN, 166);
 	Int(CURSOR_ALT_BLUE, 0);
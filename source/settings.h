@@ -31,9 +31,9 @@ namespace Config {
 
 		MERGE_MOVE,
 		TEXTURE_MANAGEMENT,
-		TEXTURE_CLEAN_PULSE,
-		TEXTURE_CLEAN_THRESHOLD,
-		TEXTURE_LONGEVITY,
+		TEXTURE_CACHE_BUDGET,
+		SPRITE_DECODE_THREADS,
+		MINIMAP_PYRAMID_ZOOM,
 		HARD_REFRESH_RATE,
 		USE_MEMCACHED_SPRITES,
 		USE_MEMCACHED_SPRITES_TO_SAVE,
@@ -111,6 +111,8 @@ namespace Config {
 		CURSOR_GREEN,
 		CURSOR_BLUE,
 		CURSOR_ALPHA,
+		LIVE_CURSOR_INTERVAL,
+		LIVE_SEND_HIGH_WATER_MARK,
 
 		CURSOR_ALT_RED,
 		CURSOR_ALT_GREEN,
@@ -135,6 +137,7 @@ namespace Config {
 		LISTBOX_EATS_ALL_EVENTS,
 		RAW_LIKE_SIMONE,
 		WORKER_THREADS,
+		NETWORK_THREADS,
 		COPY_POSITION_FORMAT,
 
 		GOTO_WEBSITE_ON_BOOT,
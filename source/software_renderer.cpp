@@ -0,0 +1,631 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "software_renderer.h"
+#include "image_writer.h"
+#include "basemap.h"
+#include "tile.h"
+#include "item.h"
+#include "monster.h"
+#include "npc.h"
+#include "graphics.h"
+#include "editor.h"
+#include "filehandle.h"
+#include "gui.h"
+#include "client_version.h"
+
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+namespace
+{
+	// Upper bound for the pixels of a band, workers keep two bands each in flight
+	const size_t RENDER_BAND_BYTES = 8 * 1024 * 1024;
+	const int RENDER_BAND_MAX_TILES = 8;
+	// Bands are at least a row of tiles, this keeps one of them within reason
+	const int RENDER_MAX_WIDTH = 8192;
+
+	// Outfit images are kept next to the plain ones, keyed by image and colors
+	const uint64_t OUTFIT_IMAGE_KEY = uint64_t(1) << 63;
+}
+
+SoftwareRenderer::SoftwareRenderer(BaseMap& map, const DrawingOptions& options) :
+	map(map),
+	options(options),
+	width(0), height(0),
+	seconds(0.0),
+	rows_done(0)
+{
+	////
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+	////
+}
+
+double SoftwareRenderer::getMegapixelsPerSecond() const
+{
+	if(seconds <= 0.0)
+		return 0.0;
+	return double(width) * height / 1000000.0 / seconds;
+}
+
+size_t SoftwareRenderer::getCachedImageCount() const
+{
+	size_t count = 0;
+	for(int i = 0; i < CACHE_SHARDS; ++i) {
+		CacheShard& shard = const_cast<CacheShard&>(cache[i]);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		count += shard.images.size();
+	}
+	return count;
+}
+
+bool SoftwareRenderer::findImage(uint64_t key, const uint8_t*& pixels)
+{
+	CacheShard& shard = cache[key % CACHE_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto it = shard.images.find(key);
+	if(it == shard.images.end())
+		return false;
+	// Images that can't be decoded are remembered as nullptr
+	pixels = it->second.get();
+	return true;
+}
+
+const uint8_t* SoftwareRenderer::storeImage(uint64_t key, uint8_t* pixels)
+{
+	CacheShard& shard = cache[key % CACHE_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	// Another worker may have decoded the same image meanwhile, then ours is dropped
+	auto result = shard.images.emplace(key, std::unique_ptr<uint8_t[]>(pixels));
+	return result.first->second.get();
+}
+
+const uint8_t* SoftwareRenderer::getImage(Band& band, uint32_t id)
+{
+	if(id == 0)
+		return nullptr;
+
+	const uint8_t* pixels = nullptr;
+	if(findImage(id, pixels))
+		return pixels;
+	return storeImage(id, g_gui.gfx.decodeSpriteRGBA(id, band.sprite_file));
+}
+
+const uint8_t* SoftwareRenderer::getOutfitImage(Band& band, uint32_t id, uint32_t template_id, const Outfit& outfit)
+{
+	if(id == 0)
+		return nullptr;
+
+	const uint64_t key = OUTFIT_IMAGE_KEY | uint64_t(id) << 32 | outfit.getColorHash();
+	const uint8_t* pixels = nullptr;
+	if(findImage(key, pixels))
+		return pixels;
+
+	uint8_t* rgba = g_gui.gfx.decodeSpriteRGBA(id, band.sprite_file);
+	uint8_t* mask = g_gui.gfx.decodeSpriteRGBA(template_id, band.sprite_file);
+	if(rgba && mask) {
+		// The template is read as RGB
+		for(int i = 0; i < SPRITE_PIXELS_SIZE; ++i) {
+			mask[i * 3 + 0] = mask[i * 4 + 0];
+			mask[i * 3 + 1] = mask[i * 4 + 1];
+			mask[i * 3 + 2] = mask[i * 4 + 2];
+		}
+		GameSprite::colorizeOutfit(rgba, 4, mask, outfit);
+	}
+	delete[] mask;
+	return storeImage(key, rgba);
+}
+
+void SoftwareRenderer::blit(Band& band, int x, int y, const uint8_t* pixels, int alpha)
+{
+	if(!pixels)
+		return;
+
+	const int from_x = std::max(x, 0);
+	const int to_x = std::min(x + SPRITE_PIXELS, band.width);
+	const int from_y = std::max(y, band.y);
+	const int to_y = std::min(y + SPRITE_PIXELS, band.y + band.rows);
+	if(from_x >= to_x || from_y >= to_y)
+		return;
+
+	// The same blending as GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA over an opaque background
+	for(int py = from_y; py < to_y; ++py) {
+		const uint8_t* src = pixels + ((py - y) * SPRITE_PIXELS + from_x - x) * 4;
+		uint8_t* dst = band.pixels + (size_t(py - band.y) * band.width + from_x) * 4;
+		for(int px = from_x; px < to_x; ++px, src += 4, dst += 4) {
+			const int a = alpha == 255 ? src[3] : src[3] * alpha / 255;
+			if(a == 0)
+				continue;
+
+			if(a == 255) {
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+			} else {
+				dst[0] = uint8_t((src[0] * a + dst[0] * (255 - a)) / 255);
+				dst[1] = uint8_t((src[1] * a + dst[1] * (255 - a)) / 255);
+				dst[2] = uint8_t((src[2] * a + dst[2] * (255 - a)) / 255);
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::shade(Band& band, int alpha)
+{
+	uint8_t* pixel = band.pixels;
+	uint8_t* end = band.pixels + size_t(band.rows) * band.width * 4;
+	for(; pixel != end; pixel += 4) {
+		pixel[0] = uint8_t(pixel[0] * (255 - alpha) / 255);
+		pixel[1] = uint8_t(pixel[1] * (255 - alpha) / 255);
+		pixel[2] = uint8_t(pixel[2] * (255 - alpha) / 255);
+	}
+}
+
+void SoftwareRenderer::drawSprite(Band& band, int draw_x, int draw_y, GameSprite* spr)
+{
+	if(!spr)
+		return;
+
+	draw_x -= spr->getDrawOffset().first;
+	draw_y -= spr->getDrawOffset().second;
+	for(int cx = 0; cx != spr->width; ++cx) {
+		for(int cy = 0; cy != spr->height; ++cy) {
+			for(int cf = 0; cf != spr->layers; ++cf) {
+				const uint32_t index = spr->getSpriteIndex(cx, cy, cf, -1, 0, 0, 0, 0);
+				blit(band, draw_x - cx * TILE_SIZE, draw_y - cy * TILE_SIZE, getImage(band, spr->getSpriteID(index)), 255);
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::drawItem(Band& band, int& draw_x, int& draw_y, const Tile* tile, const Item* item)
+{
+	ItemType& it = g_items[item->getID()];
+	GameSprite* spr = it.sprite;
+
+	if(it.id == 0 || it.isMetaItem())
+		return;
+	if(spr == nullptr)
+		return;
+	if(it.pickupable && !options.show_items)
+		return;
+
+	int screenx = draw_x - spr->getDrawOffset().first;
+	int screeny = draw_y - spr->getDrawOffset().second;
+
+	const Position& pos = tile->getPosition();
+
+	// Items further up the stack are drawn higher
+	draw_x -= spr->getDrawHeight();
+	draw_y -= spr->getDrawHeight();
+
+	int subtype = -1;
+
+	int pattern_x = pos.x % spr->pattern_x;
+	int pattern_y = pos.y % spr->pattern_y;
+	int pattern_z = pos.z % spr->pattern_z;
+
+	if(it.isSplash() || it.isFluidContainer()) {
+		subtype = item->getSubtype();
+	} else if(it.isHangable) {
+		if(tile->hasProperty(HOOK_SOUTH)) {
+			pattern_x = 1;
+		} else if(tile->hasProperty(HOOK_EAST)) {
+			pattern_x = 2;
+		} else {
+			pattern_x = 0;
+		}
+	} else if(it.stackable) {
+		if(item->getSubtype() <= 1)
+			subtype = 0;
+		else if(item->getSubtype() <= 2)
+			subtype = 1;
+		else if(item->getSubtype() <= 3)
+			subtype = 2;
+		else if(item->getSubtype() <= 4)
+			subtype = 3;
+		else if(item->getSubtype() < 10)
+			subtype = 4;
+		else if(item->getSubtype() < 25)
+			subtype = 5;
+		else if(item->getSubtype() < 50)
+			subtype = 6;
+		else
+			subtype = 7;
+	}
+
+	int alpha = 255;
+	if(options.transparent_items &&
+			(!it.isGroundTile() || spr->width > 1 || spr->height > 1) &&
+			!it.isSplash() &&
+			(!it.isBorder || spr->width > 1 || spr->height > 1)
+	  )
+	{
+		alpha /= 2;
+	}
+
+	int frame = item->getFrame();
+	for(int cx = 0; cx != spr->width; cx++) {
+		for(int cy = 0; cy != spr->height; cy++) {
+			for(int cf = 0; cf != spr->layers; cf++) {
+				const uint32_t index = spr->getSpriteIndex(cx, cy, cf, subtype, pattern_x, pattern_y, pattern_z, frame);
+				blit(band, screenx - cx * TILE_SIZE, screeny - cy * TILE_SIZE, getImage(band, spr->getSpriteID(index)), alpha);
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::drawCreature(Band& band, int draw_x, int draw_y, const Outfit& outfit, Direction dir)
+{
+	if(outfit.lookItem != 0) {
+		drawSprite(band, draw_x, draw_y, g_items[outfit.lookItem].sprite);
+		return;
+	}
+
+	GameSprite* spr = g_gui.gfx.getCreatureSprite(outfit.lookType);
+	if(!spr || outfit.lookType == 0)
+		return;
+
+	for(int cx = 0; cx != spr->width; ++cx) {
+		for(int cy = 0; cy != spr->height; ++cy) {
+			const uint32_t index = spr->getSpriteIndex(cx, cy, (int)dir);
+			const uint8_t* pixels;
+			if(spr->layers > 1) // Template
+				pixels = getOutfitImage(band, spr->getSpriteID(index), spr->getSpriteID(index + spr->height * spr->width), outfit);
+			else
+				pixels = getImage(band, spr->getSpriteID(index));
+			blit(band, draw_x - cx * TILE_SIZE, draw_y - cy * TILE_SIZE, pixels, 255);
+		}
+	}
+}
+
+void SoftwareRenderer::drawTile(Band& band, const Tile* tile, int draw_x, int draw_y)
+{
+	if(tile->ground)
+		drawItem(band, draw_x, draw_y, tile, tile->ground);
+
+	for(ItemVector::const_iterator it = tile->items.begin(); it != tile->items.end(); ++it)
+		drawItem(band, draw_x, draw_y, tile, *it);
+
+	if(tile->monster && options.show_monsters)
+		drawCreature(band, draw_x, draw_y, tile->monster->getLookType(), tile->monster->getDirection());
+	if(tile->npc && options.show_npcs)
+		drawCreature(band, draw_x, draw_y, tile->npc->getLookType(), tile->npc->getDirection());
+}
+
+void SoftwareRenderer::renderBand(Band& band)
+{
+	// Opaque black, like the background of the map window
+	const size_t size = size_t(band.rows) * band.width * 4;
+	memset(band.pixels, 0, size);
+	for(size_t i = 3; i < size; i += 4)
+		band.pixels[i] = 0xFF;
+
+	const int columns = band.width / TILE_SIZE;
+	const int first_row = band.y / TILE_SIZE;
+	const int last_row = (band.y + band.rows - 1) / TILE_SIZE;
+
+	for(int map_z = band.start_z; map_z >= band.floor; --map_z) {
+		if(map_z == band.floor && band.start_z != band.floor && options.show_shade)
+			shade(band, 128);
+
+		// Lower floors are drawn a tile further right and down per floor, in the
+		// same order as MapDrawer::DrawMap visits the leaves and their tiles
+		const int shift = map_z - band.floor;
+		const int min_x = std::max(0, band.start_x - shift);
+		const int max_x = band.start_x - shift + columns - 1 + RENDER_MARGIN;
+		const int min_y = std::max(0, band.start_y - shift + first_row);
+		const int max_y = band.start_y - shift + last_row + RENDER_MARGIN;
+
+		for(int nd_x = min_x & ~3; nd_x <= max_x; nd_x += 4) {
+			for(int nd_y = min_y & ~3; nd_y <= max_y; nd_y += 4) {
+				QTreeNode* node = map.getLeaf(nd_x, nd_y);
+				if(!node || !node->getFloor(map_z))
+					continue;
+
+				for(int x = nd_x; x < nd_x + 4; ++x) {
+					if(x < min_x || x > max_x)
+						continue;
+
+					for(int y = nd_y; y < nd_y + 4; ++y) {
+						if(y < min_y || y > max_y)
+							continue;
+
+						const Tile* tile = node->getTile(x, y, map_z)->get();
+						if(tile)
+							drawTile(band, tile, (x - band.start_x + shift) * TILE_SIZE, (y - band.start_y + shift) * TILE_SIZE);
+					}
+				}
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::setView(Band& band, int x, int y, int columns, int floor) const
+{
+	band.width = columns * TILE_SIZE;
+	band.start_x = x;
+	band.start_y = y;
+	band.floor = floor;
+	band.start_z = getStartFloor(floor);
+}
+
+int SoftwareRenderer::getStartFloor(int floor) const
+{
+	if(!options.show_all_floors)
+		return floor;
+	return floor <= GROUND_LAYER ? GROUND_LAYER : std::min(MAP_MAX_LAYER, floor + 2);
+}
+
+void SoftwareRenderer::draw(uint8_t* pixels, int x, int y, int columns, int rows, int floor, FileReadHandle* sprite_file)
+{
+	Band band;
+	setView(band, x, y, columns, floor);
+	band.sprite_file = sprite_file;
+	band.pixels = pixels;
+	band.y = 0;
+	band.rows = rows * TILE_SIZE;
+	renderBand(band);
+}
+
+bool SoftwareRenderer::render(const std::string& path, int x1, int y1, int x2, int y2, int floor, int threads, bool showdialog)
+{
+	error.clear();
+	if(x1 > x2 || y1 > y2 || x1 < 0 || y1 < 0 || x2 > MAP_MAX_WIDTH || y2 > MAP_MAX_HEIGHT || floor < 0 || floor > MAP_MAX_LAYER) {
+		error = "The area to render is not on the map.";
+		return false;
+	}
+	if(x2 - x1 >= RENDER_MAX_WIDTH) {
+		error = wxString::Format("The area to render can be at most %d tiles wide.", RENDER_MAX_WIDTH);
+		return false;
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	width = (x2 - x1 + 1) * TILE_SIZE;
+	height = (y2 - y1 + 1) * TILE_SIZE;
+	rows_done = 0;
+
+	std::unique_ptr<PNGWriter> writer;
+	if(!path.empty()) {
+		writer.reset(newd PNGWriter);
+		if(!writer->open(path, width, height, ImageWriter::PIXEL_RGBA)) {
+			error = "Could not open \"" + wxstr(path) + "\" for writing.";
+			return false;
+		}
+	}
+
+	// Bands are whole rows of tiles, as many as fit the byte budget
+	const size_t row_bytes = size_t(width) * 4;
+	const int band_tiles = std::max<int>(1, std::min<size_t>(RENDER_BAND_MAX_TILES, RENDER_BAND_BYTES / (row_bytes * TILE_SIZE)));
+	const int band_rows = band_tiles * TILE_SIZE;
+	const int band_count = (height + band_rows - 1) / band_rows;
+
+	if(threads <= 0)
+		threads = std::max<int>(1, std::thread::hardware_concurrency());
+	threads = std::min(threads, band_count);
+
+	// Workers render and compress ahead of the writer by at most window bands, each into its own slot
+	const int window = threads * 2;
+	std::vector<std::vector<uint8_t>> slots(window);
+	std::vector<PNGWriter::CompressedRows> compressed(window);
+	std::vector<int8_t> ready(band_count, 0);
+	int next_band = 0;
+	int written = 0;
+	bool stopped = false;
+	std::mutex mutex;
+	std::condition_variable changed;
+
+	std::vector<std::thread> workers;
+	for(int i = 0; i < threads; ++i) {
+		workers.push_back(std::thread([&]() {
+			std::unique_ptr<FileReadHandle> sprite_file(g_gui.gfx.openSpriteFile());
+			while(true) {
+				int index;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					changed.wait(lock, [&]() { return stopped || next_band >= band_count || next_band < written + window; });
+					if(stopped || next_band >= band_count)
+						return;
+					index = next_band++;
+				}
+
+				std::vector<uint8_t>& slot = slots[index % window];
+				slot.resize(row_bytes * band_rows);
+
+				Band band;
+				setView(band, x1, y1, x2 - x1 + 1, floor);
+				band.sprite_file = sprite_file.get();
+				band.pixels = slot.data();
+				band.y = index * band_rows;
+				band.rows = std::min(band_rows, height - band.y);
+				renderBand(band);
+				const bool done = !writer || PNGWriter::compressRows(band.pixels, band.rows, width, ImageWriter::PIXEL_RGBA, compressed[index % window]);
+				rows_done += band.rows;
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					ready[index] = done ? 1 : -1;
+				}
+				changed.notify_all();
+			}
+		}));
+	}
+
+	bool ok = true;
+	for(int index = 0; index < band_count && ok; ++index) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while(!ready[index]) {
+				changed.wait_for(lock, std::chrono::milliseconds(100));
+				if(showdialog) {
+					lock.unlock();
+					g_gui.SetLoadDone(int(std::min<uint64_t>(99, rows_done * 100 / height)));
+					lock.lock();
+				}
+			}
+		}
+
+		if(ready[index] < 0) {
+			error = "Could not compress the image.";
+			ok = false;
+		} else if(writer && !writer->writeCompressedRows(compressed[index % window])) {
+			error = "Could not write to \"" + wxstr(path) + "\".";
+			ok = false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			++written;
+			stopped = !ok;
+		}
+		changed.notify_all();
+	}
+
+	for(std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+		it->join();
+
+	if(ok && writer && !writer->close()) {
+		error = "Could not write to \"" + wxstr(path) + "\".";
+		ok = false;
+	}
+
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+bool RegionRenderCommand::IsRequested(const wxArrayString& arguments)
+{
+	return arguments.Index("--render-region") != wxNOT_FOUND;
+}
+
+bool RegionRenderCommand::Run(const wxArrayString& arguments)
+{
+	g_gui.SetHeadless(true);
+
+	wxString mapPath;
+	wxString output;
+	int x1 = 0, y1 = 0, x2 = -1, y2 = -1;
+	long floor = GROUND_LAYER;
+	long threads = 0;
+	long runs = 0;
+
+	bool valid = true;
+	for(size_t index = 1; index < arguments.size() && valid; ++index) {
+		const wxString& argument = arguments[index];
+		if(index + 1 == arguments.size()) {
+			g_gui.PrintMessage("Missing value for \"" + argument + "\".");
+			valid = false;
+			break;
+		}
+
+		const wxString& value = arguments[++index];
+		if(argument == "--render-region")
+			mapPath = value;
+		else if(argument == "--area")
+			valid = sscanf(value.mb_str(), "%d,%d,%d,%d", &x1, &y1, &x2, &y2) == 4;
+		else if(argument == "--floor")
+			valid = value.ToLong(&floor) && floor >= 0 && floor <= MAP_MAX_LAYER;
+		else if(argument == "--output")
+			output = value;
+		else if(argument == "--threads")
+			valid = value.ToLong(&threads) && threads >= 0;
+		else if(argument == "--benchmark")
+			valid = value.ToLong(&runs) && runs > 0;
+		else {
+			g_gui.PrintMessage("Unknown argument \"" + argument + "\".");
+			valid = false;
+			break;
+		}
+
+		if(!valid)
+			g_gui.PrintMessage("Invalid value \"" + value + "\" for \"" + argument + "\".");
+	}
+
+	if(!valid || mapPath.empty() || x2 < x1 || y2 < y1) {
+		g_gui.PrintMessage("Usage: rme --render-region <map.otbm> --area x1,y1,x2,y2 [--floor N] [--output file.png] [--threads N] [--benchmark runs]");
+		return false;
+	}
+
+	if(ClientVersion::getLatestVersion() == nullptr) {
+		g_gui.PrintMessage("No client versions are configured, run the editor once to set them up.");
+		return false;
+	}
+
+	std::unique_ptr<Editor> editor;
+	try
+	{
+		editor.reset(newd Editor(g_gui.copybuffer, FileName(mapPath)));
+	}
+	catch(std::runtime_error& e)
+	{
+		g_gui.PrintMessage(wxString(e.what(), wxConvUTF8));
+		return false;
+	}
+
+	if(!editor->map.hasFile()) {
+		g_gui.PrintMessage("Could not load \"" + mapPath + "\": " + editor->map.getError());
+		return false;
+	}
+
+	DrawingOptions options;
+	options.SetIngame();
+	SoftwareRenderer renderer(editor->map, options);
+
+	if(runs > 0) {
+		// The first run also decodes every sprite in the area, later ones draw from the cache
+		double best = 0.0, total = 0.0;
+		for(long run = 1; run <= runs; ++run) {
+			if(!renderer.render(std::string(), x1, y1, x2, y2, floor, threads, false)) {
+				g_gui.PrintMessage(renderer.getError());
+				return false;
+			}
+			const double speed = renderer.getMegapixelsPerSecond();
+			best = std::max(best, speed);
+			total += renderer.getSeconds();
+			g_gui.PrintMessage(wxString::Format("Run %ld: %dx%d in %.3f seconds, %.1f MP/s.",
+				run, renderer.getWidth(), renderer.getHeight(), renderer.getSeconds(), speed));
+		}
+
+		const double megapixels = double(renderer.getWidth()) * renderer.getHeight() / 1000000.0;
+		g_gui.PrintMessage(wxString::Format("Average %.1f MP/s, best %.1f MP/s, %llu sprite images decoded.",
+			megapixels * runs / total, best, static_cast<unsigned long long>(renderer.getCachedImageCount())));
+		return true;
+	}
+
+	if(output.empty())
+		output = FileName(mapPath).GetName() + "_" + i2ws(x1) + "_" + i2ws(y1) + "_" + i2ws(floor) + ".png";
+
+	g_gui.CreateLoadBar("Rendering area");
+	const bool ok = renderer.render(nstr(output), x1, y1, x2, y2, floor, threads, true);
+	g_gui.DestroyLoadBar();
+
+	if(!ok) {
+		g_gui.PrintMessage(renderer.getError());
+		return false;
+	}
+
+	g_gui.PrintMessage(wxString::Format("Rendered %dx%d pixels to %s in %.2f seconds, %.1f MP/s.",
+		renderer.getWidth(), renderer.getHeight(), output, renderer.getSeconds(), renderer.getMegapixelsPerSecond()));
+	return true;
+}
@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SOFTWARE_RENDERER_H_
+#define RME_SOFTWARE_RENDERER_H_
+
+#include "map_drawer.h"
+#include "outfit.h"
+#include "enums.h"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+
+class BaseMap;
+class Tile;
+class Item;
+class GameSprite;
+class FileReadHandle;
+
+// Tiles right of and below an area whose sprites may still reach into it,
+// big sprites and elevation draw up and left of their tile
+#define RENDER_MARGIN 4
+
+// Draws areas of a map on the CPU, so any size can be exported without a
+// window or GL context. Tiles are composited like MapDrawer::DrawTile draws
+// them in-game, band by band on worker threads, and the bands are streamed
+// out as a PNG in order. Decoded sprite images are shared by the workers.
+class SoftwareRenderer
+{
+public:
+	SoftwareRenderer(BaseMap& map, const DrawingOptions& options);
+	~SoftwareRenderer();
+
+	// Renders tiles [x1, x2] x [y1, y2] as seen from floor, TILE_SIZE pixels per tile.
+	// An empty path renders without writing anything, to measure the drawing alone.
+	bool render(const std::string& path, int x1, int y1, int x2, int y2, int floor, int threads, bool showdialog);
+	// Draws columns x rows tiles from x, y into pixels (RGBA, TILE_SIZE per tile).
+	// Can be called from several threads at once, each with its own sprite file
+	// handle from GraphicManager::openSpriteFile.
+	void draw(uint8_t* pixels, int x, int y, int columns, int rows, int floor, FileReadHandle* sprite_file);
+	// Lowest floor (highest z) drawn below floor, each one shifted a tile further right and down
+	int getStartFloor(int floor) const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	// Of the last render
+	double getSeconds() const { return seconds; }
+	double getMegapixelsPerSecond() const;
+	size_t getCachedImageCount() const;
+
+	const wxString& getError() const { return error; }
+
+protected:
+	// Rows [y, y + rows) of an image width pixels wide, showing floor from map tile start_x, start_y on
+	struct Band {
+		uint8_t* pixels;
+		int width;
+		int y;
+		int rows;
+		int start_x, start_y;
+		int floor, start_z;
+		// Of the thread drawing the band, sprites are decoded through it
+		FileReadHandle* sprite_file;
+	};
+
+	void setView(Band& band, int x, int y, int columns, int floor) const;
+
+	void renderBand(Band& band);
+	void drawTile(Band& band, const Tile* tile, int draw_x, int draw_y);
+	void drawItem(Band& band, int& draw_x, int& draw_y, const Tile* tile, const Item* item);
+	void drawCreature(Band& band, int draw_x, int draw_y, const Outfit& outfit, Direction dir);
+	void drawSprite(Band& band, int draw_x, int draw_y, GameSprite* spr);
+	// Blends a SPRITE_PIXELS square of RGBA pixels over the band
+	void blit(Band& band, int x, int y, const uint8_t* pixels, int alpha);
+	void shade(Band& band, int alpha);
+
+	// Decoded images, nullptr if one can't be read
+	const uint8_t* getImage(Band& band, uint32_t id);
+	const uint8_t* getOutfitImage(Band& band, uint32_t id, uint32_t template_id, const Outfit& outfit);
+	bool findImage(uint64_t key, const uint8_t*& pixels);
+	const uint8_t* storeImage(uint64_t key, uint8_t* pixels);
+
+	BaseMap& map;
+	DrawingOptions options;
+
+	int width, height;
+	double seconds;
+
+	static const int CACHE_SHARDS = 16;
+	struct CacheShard {
+		std::mutex mutex;
+		std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> images;
+	};
+	CacheShard cache[CACHE_SHARDS];
+
+	std::atomic<uint64_t> rows_done;
+	std::mutex error_mutex;
+	wxString error;
+};
+
+// Renders an area of a map to a PNG without opening a window, started with
+//   rme --render-region map.otbm --area x1,y1,x2,y2 [--floor N] [--output file.png]
+//       [--threads N] [--benchmark runs]
+// --benchmark draws the area the given number of times without writing it and
+// reports the throughput in megapixels per second.
+class RegionRenderCommand
+{
+public:
+	static bool IsRequested(const wxArrayString& arguments);
+	static bool Run(const wxArrayString& arguments);
+};
+
+#endif
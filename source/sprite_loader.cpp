@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "sprite_loader.h"
+
+// Prefetches beyond this are dropped, the view moves on faster than they decode
+static const size_t SPRITE_PREFETCH_MAX_PENDING = 4096;
+
+SpriteDecodeQueue::SpriteDecodeQueue(const DecoderFactory& createDecoder, const ReadyFunction& ready, size_t threadCount) :
+	createDecoder(createDecoder), ready(ready), prefetchCount(0), stopping(false)
+{
+	for(size_t i = 0; i < std::max<size_t>(1, threadCount); ++i) {
+		threads.emplace_back([this]() { run(); });
+	}
+}
+
+SpriteDecodeQueue::~SpriteDecodeQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+
+	for(std::thread& thread : threads) {
+		thread.join();
+	}
+
+	for(DecodedSprite& sprite : readySprites) {
+		delete[] sprite.rgba;
+	}
+}
+
+bool SpriteDecodeQueue::request(uint32_t id, bool prefetch)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(queuedSprites.count(id) != 0) {
+			return false;
+		}
+
+		if(prefetch) {
+			if(prefetchCount >= SPRITE_PREFETCH_MAX_PENDING) {
+				return false;
+			}
+			pendingSprites.push_back(id);
+			++prefetchCount;
+		} else {
+			pendingSprites.push_front(id);
+		}
+		queuedSprites.insert(id);
+	}
+	condition.notify_one();
+	return true;
+}
+
+size_t SpriteDecodeQueue::takeReady(std::vector<DecodedSprite>& sprites, size_t maxCount)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t count = 0;
+	while(count < maxCount && !readySprites.empty()) {
+		const DecodedSprite& sprite = readySprites.front();
+		queuedSprites.erase(sprite.id);
+		sprites.push_back(sprite);
+		readySprites.pop_front();
+		++count;
+	}
+	return count;
+}
+
+size_t SpriteDecodeQueue::getPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pendingSprites.size();
+}
+
+size_t SpriteDecodeQueue::getReadyCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return readySprites.size();
+}
+
+void SpriteDecodeQueue::run()
+{
+	DecodeFunction decode = createDecoder();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true) {
+		condition.wait(lock, [this]() { return stopping || !pendingSprites.empty(); });
+		if(stopping) {
+			return;
+		}
+
+		const uint32_t id = pendingSprites.front();
+		pendingSprites.pop_front();
+		// Prefetches are at the back, the count only has to be close
+		if(prefetchCount > pendingSprites.size()) {
+			prefetchCount = pendingSprites.size();
+		}
+
+		lock.unlock();
+		uint8_t* rgba = decode(id);
+		lock.lock();
+
+		if(!rgba) {
+			queuedSprites.erase(id);
+			continue;
+		}
+
+		readySprites.push_back(DecodedSprite { id, rgba });
+		if(ready) {
+			lock.unlock();
+			ready();
+			lock.lock();
+		}
+	}
+}
+
+std::vector<SpritePrefetchArea> getSpritePrefetchAreas(const SpritePrefetchArea& previous, const SpritePrefetchArea& current, int32_t margin)
+{
+	std::vector<SpritePrefetchArea> areas;
+	if(margin <= 0 || current.isEmpty()) {
+		return areas;
+	}
+
+	const int32_t dx = current.startX - previous.startX;
+	const int32_t dy = current.startY - previous.startY;
+
+	// Columns to the side the view is moving to
+	if(dx != 0) {
+		SpritePrefetchArea area = current;
+		if(dx > 0) {
+			area.startX = current.endX;
+			area.endX = current.endX + margin;
+		} else {
+			area.startX = current.startX - margin;
+			area.endX = current.startX;
+		}
+		areas.push_back(area);
+	}
+
+	// Rows above / below, including the corner when moving diagonally
+	if(dy != 0) {
+		SpritePrefetchArea area = current;
+		if(dy > 0) {
+			area.startY = current.endY;
+			area.endY = current.endY + margin;
+		} else {
+			area.startY = current.startY - margin;
+			area.endY = current.startY;
+		}
+		if(dx > 0) {
+			area.endX += margin;
+		} else if(dx < 0) {
+			area.startX -= margin;
+		}
+		areas.push_back(area);
+	}
+	return areas;
+}
@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_SPRITE_LOADER_H_
+#define RME_SPRITE_LOADER_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// RGBA pixels of a sprite decoded off the GL thread, the receiver owns the data
+struct DecodedSprite
+{
+	uint32_t id;
+	uint8_t* rgba;
+};
+
+// Decodes sprites on worker threads. Sprites that are about to be drawn go
+// to the front of the queue, prefetched ones to the back. Decoded sprites
+// wait in a ready queue until the GL thread uploads them.
+// Doesn't know about GL or the sprite file, the decoder is supplied.
+class SpriteDecodeQueue
+{
+	public:
+		// Returns newd RGBA data or nullptr, called from the worker threads
+		typedef std::function<uint8_t*(uint32_t)> DecodeFunction;
+		// Called once on every worker, the decoder it returns is only used by that worker
+		typedef std::function<DecodeFunction()> DecoderFactory;
+		// Called from a worker thread when a sprite became ready
+		typedef std::function<void()> ReadyFunction;
+
+		SpriteDecodeQueue(const DecoderFactory& createDecoder, const ReadyFunction& ready, size_t threadCount);
+		~SpriteDecodeQueue();
+
+		// Returns false if the sprite is already queued or waiting for upload
+		bool request(uint32_t id, bool prefetch);
+		// Moves up to maxCount decoded sprites into sprites
+		size_t takeReady(std::vector<DecodedSprite>& sprites, size_t maxCount);
+
+		size_t getPendingCount() const;
+		size_t getReadyCount() const;
+
+	private:
+		void run();
+
+		DecoderFactory createDecoder;
+		ReadyFunction ready;
+
+		mutable std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<uint32_t> pendingSprites;
+		std::deque<DecodedSprite> readySprites;
+		// Sprites pending, being decoded or ready
+		std::unordered_set<uint32_t> queuedSprites;
+		size_t prefetchCount;
+
+		std::vector<std::thread> threads;
+		bool stopping;
+};
+
+// Tile rectangle, end exclusive
+struct SpritePrefetchArea
+{
+	int32_t startX;
+	int32_t startY;
+	int32_t endX;
+	int32_t endY;
+
+	bool isEmpty() const { return startX >= endX || startY >= endY; }
+};
+
+// The bands of `margin` tiles just outside `current` in the direction the view
+// moved since `previous`, nothing if it didn't move
+std::vector<SpritePrefetchArea> getSpritePrefetchAreas(const SpritePrefetchArea& previous, const SpritePrefetchArea& current, int32_t margin);
+
+#endif
@@ -0,0 +1,548 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "tile_pyramid_export.h"
+#include "image_writer.h"
+#include "map.h"
+#include "tile.h"
+#include "item.h"
+#include "monster.h"
+#include "npc.h"
+#include "editor.h"
+#include "gui.h"
+#include "client_version.h"
+#include "filehandle.h"
+
+#include <thread>
+#include <chrono>
+
+namespace
+{
+	// Side of every image in pixels
+	const int TILE_PYRAMID_SIZE = 256;
+	// Zoom with 8 pixels per map tile, the smallest sprites are still drawn at
+	const int TILE_PYRAMID_SPRITE_ZOOM = 11;
+
+	const uint32_t MANIFEST_MAGIC = 0x544D5052; // "RPMT"
+	const uint32_t MANIFEST_VERSION = 1;
+
+	DrawingOptions getIngameOptions()
+	{
+		DrawingOptions options;
+		options.SetIngame();
+		return options;
+	}
+
+	inline uint64_t mixHash(uint64_t h)
+	{
+		h ^= h >> 30;
+		h *= 0xBF58476D1CE4E5B9ULL;
+		h ^= h >> 27;
+		h *= 0x94D049BB133111EBULL;
+		return h ^ (h >> 31);
+	}
+
+	inline void addHash(uint64_t& h, uint64_t value)
+	{
+		h = mixHash(h ^ (value + 0x9E3779B97F4A7C15ULL));
+	}
+
+	void addOutfitHash(uint64_t& h, const Outfit& outfit, Direction direction)
+	{
+		addHash(h, uint64_t(outfit.lookType) << 32 | uint32_t(outfit.lookItem));
+		addHash(h, uint64_t(outfit.lookAddon) << 40 | uint64_t(direction) << 32 | outfit.getColorHash());
+	}
+
+	// Hashes what the renderer and the minimap draw of the tiles of a leaf floor, 0 if there are none
+	void hashFloor(Floor* floor, uint64_t& sprites, uint64_t& colors)
+	{
+		bool found = false;
+		sprites = colors = 0;
+		for(int i = 0; i < 16; ++i) {
+			const Tile* tile = floor->locs[i].get();
+			if(!tile || tile->empty())
+				continue;
+
+			found = true;
+			addHash(sprites, i);
+			if(tile->ground)
+				addHash(sprites, tile->ground->getID());
+			for(ItemVector::const_iterator it = tile->items.begin(); it != tile->items.end(); ++it) {
+				const Item* item = *it;
+				addHash(sprites, uint64_t(item->getFrame()) << 32 | uint32_t(item->getSubtype()) << 16 | item->getID());
+			}
+			if(tile->monster)
+				addOutfitHash(sprites, tile->monster->getLookType(), tile->monster->getDirection());
+			if(tile->npc)
+				addOutfitHash(sprites, tile->npc->getLookType(), tile->npc->getDirection());
+
+			addHash(colors, i << 8 | tile->getMiniMapColor());
+		}
+
+		if(!found)
+			sprites = colors = 0;
+	}
+}
+
+TilePyramidExporter::TilePyramidExporter(Map& map) :
+	map(map),
+	renderer(map, getIngameOptions()),
+	tiles_done(0),
+	written(0),
+	unchanged(0),
+	removed(0)
+{
+	////
+}
+
+uint64_t TilePyramidExporter::getKey(int floor, int zoom, int x, int y)
+{
+	// Sorted by floor, zoom and column, as the directories are laid out
+	return uint64_t(floor) << 48 | uint64_t(zoom) << 40 | uint64_t(x) << 20 | uint64_t(y);
+}
+
+void TilePyramidExporter::splitKey(uint64_t key, int& floor, int& zoom, int& x, int& y)
+{
+	floor = int(key >> 48);
+	zoom = int(key >> 40) & 0xFF;
+	x = int(key >> 20) & 0xFFFFF;
+	y = int(key) & 0xFFFFF;
+}
+
+std::string TilePyramidExporter::getTilePath(uint64_t key) const
+{
+	int floor, zoom, x, y;
+	splitKey(key, floor, zoom, x, y);
+
+	const char separator = char(wxFileName::GetPathSeparator());
+	return base_path + i2s(floor) + separator + i2s(zoom) + separator + i2s(x) + separator + i2s(y) + ".png";
+}
+
+void TilePyramidExporter::collectTiles(const std::vector<int>& floors, int min_zoom, int max_zoom, HashMap& tiles)
+{
+	PositionVector leaves;
+	map.getNodeAreas(4, leaves);
+
+	// Images drawn with other sprites have to be drawn again
+	const uint64_t seed = mixHash(g_gui.GetCurrentVersionID());
+	const int minimap_max = std::min(max_zoom, TILE_PYRAMID_SPRITE_ZOOM - 1);
+	const int sprite_min = std::max(min_zoom, TILE_PYRAMID_SPRITE_ZOOM);
+
+	for(PositionVector::const_iterator it = leaves.begin(); it != leaves.end(); ++it) {
+		QTreeNode* node = map.getLeaf(it->x, it->y);
+		if(!node)
+			continue;
+
+		uint64_t sprites[MAP_LAYERS];
+		uint64_t colors[MAP_LAYERS];
+		for(int z = 0; z < MAP_LAYERS; ++z) {
+			Floor* floor = node->getFloor(z);
+			sprites[z] = colors[z] = 0;
+			if(floor)
+				hashFloor(floor, sprites[z], colors[z]);
+		}
+
+		// Images add up the hashes of their leaves, so the order leaves come in doesn't matter
+		uint64_t leaf = seed;
+		addHash(leaf, uint64_t(it->x) << 16 | it->y);
+
+		for(std::vector<int>::const_iterator floor = floors.begin(); floor != floors.end(); ++floor) {
+			if(colors[*floor]) {
+				for(int zoom = min_zoom; zoom <= minimap_max; ++zoom) {
+					const int shift = 16 - zoom;
+					tiles[getKey(*floor, zoom, it->x >> shift, it->y >> shift)] += mixHash(colors[*floor] ^ leaf);
+				}
+			}
+
+			// Lower floors are drawn shifted right and down, and sprites reach up and left of their tile
+			const int start_z = renderer.getStartFloor(*floor);
+			for(int z = *floor; z <= start_z; ++z) {
+				if(!sprites[z])
+					continue;
+
+				const uint64_t hash = mixHash(sprites[z] ^ leaf ^ uint64_t(z) << 56);
+				const int offset = z - *floor;
+				for(int zoom = sprite_min; zoom <= max_zoom; ++zoom) {
+					const int shift = 16 - zoom;
+					const int from_x = std::max(0, it->x + offset - RENDER_MARGIN) >> shift;
+					const int from_y = std::max(0, it->y + offset - RENDER_MARGIN) >> shift;
+					const int to_x = std::min(it->x + 3 + offset, MAP_MAX_WIDTH) >> shift;
+					const int to_y = std::min(it->y + 3 + offset, MAP_MAX_HEIGHT) >> shift;
+					for(int x = from_x; x <= to_x; ++x) {
+						for(int y = from_y; y <= to_y; ++y)
+							tiles[getKey(*floor, zoom, x, y)] += hash;
+					}
+				}
+			}
+		}
+	}
+}
+
+bool TilePyramidExporter::readManifest(const std::string& path, HashMap& tiles) const
+{
+	if(!wxFileExists(wxstr(path)))
+		return false;
+
+	FileReadHandle file(path);
+	uint32_t magic, version, count;
+	if(!file.isOk() || !file.getU32(magic) || !file.getU32(version) || !file.getU32(count))
+		return false;
+	if(magic != MANIFEST_MAGIC || version != MANIFEST_VERSION || file.size() != 12 + size_t(count) * 16)
+		return false;
+
+	for(uint32_t i = 0; i < count; ++i) {
+		uint64_t key, hash;
+		if(!file.getU64(key) || !file.getU64(hash))
+			return false;
+		tiles.emplace_hint(tiles.end(), key, hash);
+	}
+	return true;
+}
+
+bool TilePyramidExporter::writeManifest(const std::string& path, const HashMap& tiles) const
+{
+	FileWriteHandle file(path);
+	if(!file.isOk())
+		return false;
+
+	file.addU32(MANIFEST_MAGIC);
+	file.addU32(MANIFEST_VERSION);
+	file.addU32(uint32_t(tiles.size()));
+	for(HashMap::const_iterator it = tiles.begin(); it != tiles.end(); ++it) {
+		file.addU64(it->first);
+		file.addU64(it->second);
+	}
+	return file.isOk();
+}
+
+void TilePyramidExporter::drawSprites(int floor, int zoom, int x, int y, std::vector<uint8_t>& pixels, uint8_t* out, FileReadHandle* sprite_file)
+{
+	// Drawn at full size and averaged down to 256 pixels
+	const int span = 1 << (16 - zoom);
+	const int size = span * TILE_SIZE;
+	const int factor = size / TILE_PYRAMID_SIZE;
+	pixels.resize(size_t(size) * size * 4);
+	renderer.draw(pixels.data(), x * span, y * span, span, span, floor, sprite_file);
+
+	const int count = factor * factor;
+	for(int py = 0; py < TILE_PYRAMID_SIZE; ++py) {
+		for(int px = 0; px < TILE_PYRAMID_SIZE; ++px, out += 3) {
+			int red = 0, green = 0, blue = 0;
+			for(int sy = 0; sy < factor; ++sy) {
+				const uint8_t* src = &pixels[(size_t(py * factor + sy) * size + px * factor) * 4];
+				for(int sx = 0; sx < factor; ++sx, src += 4) {
+					red += src[0];
+					green += src[1];
+					blue += src[2];
+				}
+			}
+			out[0] = uint8_t(red / count);
+			out[1] = uint8_t(green / count);
+			out[2] = uint8_t(blue / count);
+		}
+	}
+}
+
+void TilePyramidExporter::drawMinimap(int floor, int zoom, int x, int y, std::vector<uint8_t>& colors, uint8_t* out)
+{
+	// Texels of a coarser cache level below zoom 8, whole tiles blown up above it
+	const int level = std::max(0, 8 - zoom);
+	const int scale = 1 << std::max(0, zoom - 8);
+	const int texels = TILE_PYRAMID_SIZE / scale;
+	colors.resize(size_t(texels) * texels);
+	{
+		std::lock_guard<std::mutex> lock(minimap_mutex);
+		map.minimap_cache.getColors(x * texels, y * texels, floor, texels, texels, colors.data(), level);
+	}
+
+	for(int py = 0; py < TILE_PYRAMID_SIZE; ++py) {
+		const uint8_t* src = &colors[size_t(py / scale) * texels];
+		for(int px = 0; px < TILE_PYRAMID_SIZE; ++px)
+			*out++ = src[px / scale];
+	}
+}
+
+bool TilePyramidExporter::writeTile(uint64_t key, std::vector<uint8_t>& pixels, std::vector<uint8_t>& image, FileReadHandle* sprite_file)
+{
+	int floor, zoom, x, y;
+	splitKey(key, floor, zoom, x, y);
+
+	const bool sprites = zoom >= TILE_PYRAMID_SPRITE_ZOOM;
+	const ImageWriter::PixelFormat format = sprites ? ImageWriter::PIXEL_RGB : ImageWriter::PIXEL_MINIMAP;
+	const size_t row_bytes = size_t(TILE_PYRAMID_SIZE) * ImageWriter::getBytesPerPixel(format);
+	image.resize(row_bytes * TILE_PYRAMID_SIZE);
+	if(sprites)
+		drawSprites(floor, zoom, x, y, pixels, image.data(), sprite_file);
+	else
+		drawMinimap(floor, zoom, x, y, pixels, image.data());
+
+	const std::string path = getTilePath(key);
+	PNGWriter writer;
+	if(!writer.open(path, TILE_PYRAMID_SIZE, TILE_PYRAMID_SIZE, format)) {
+		setError("Could not open \"" + wxstr(path) + "\" for writing.");
+		return false;
+	}
+
+	for(int row = 0; row < TILE_PYRAMID_SIZE; ++row) {
+		if(!writer.writeRow(&image[row * row_bytes])) {
+			setError("Could not write to \"" + wxstr(path) + "\".");
+			return false;
+		}
+	}
+
+	if(!writer.close()) {
+		setError("Could not write to \"" + wxstr(path) + "\".");
+		return false;
+	}
+	return true;
+}
+
+bool TilePyramidExporter::exportTiles(const FileName& directory, const std::vector<int>& floors, int min_zoom, int max_zoom,
+	int threads, bool full, bool showdialog)
+{
+	error.clear();
+	written = unchanged = removed = 0;
+	tiles_done = 0;
+	base_path = nstr(directory.GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR));
+
+	if(!wxFileName::Mkdir(wxstr(base_path), 0755, wxPATH_MKDIR_FULL)) {
+		error = "Could not create \"" + wxstr(base_path) + "\".";
+		return false;
+	}
+
+	HashMap tiles;
+	collectTiles(floors, min_zoom, max_zoom, tiles);
+
+	const std::string manifest_path = base_path + "tiles.manifest";
+	HashMap previous;
+	if(!readManifest(manifest_path, previous))
+		previous.clear();
+
+	// Entries of other floors and zooms are kept, images of these with nothing on them any more removed
+	HashMap manifest;
+	for(HashMap::const_iterator it = previous.begin(); it != previous.end(); ++it) {
+		int floor, zoom, x, y;
+		splitKey(it->first, floor, zoom, x, y);
+		if(zoom < min_zoom || zoom > max_zoom || std::find(floors.begin(), floors.end(), floor) == floors.end()) {
+			manifest.insert(*it);
+			continue;
+		}
+
+		if(tiles.find(it->first) == tiles.end()) {
+			const wxString path = wxstr(getTilePath(it->first));
+			if(wxFileExists(path) && wxRemoveFile(path))
+				++removed;
+		}
+	}
+
+	std::vector<uint64_t> jobs;
+	std::string last_directory;
+	for(HashMap::const_iterator it = tiles.begin(); it != tiles.end(); ++it) {
+		HashMap::const_iterator old = previous.find(it->first);
+		if(!full && old != previous.end() && old->second == it->second && wxFileExists(wxstr(getTilePath(it->first)))) {
+			manifest.insert(*it);
+			++unchanged;
+			continue;
+		}
+
+		// Keys are sorted by column, so every directory is made once and before the workers need it
+		const std::string path = getTilePath(it->first);
+		const std::string tile_directory = path.substr(0, path.find_last_of(char(wxFileName::GetPathSeparator())));
+		if(tile_directory != last_directory) {
+			if(!wxFileName::Mkdir(wxstr(tile_directory), 0755, wxPATH_MKDIR_FULL)) {
+				error = "Could not create \"" + wxstr(tile_directory) + "\".";
+				return false;
+			}
+			last_directory = tile_directory;
+		}
+		jobs.push_back(it->first);
+	}
+
+	bool ok = true;
+	if(!jobs.empty()) {
+		if(threads <= 0)
+			threads = std::max<int>(1, std::thread::hardware_concurrency());
+		threads = std::min<int>(threads, jobs.size());
+
+		// Images that fail stay out of the manifest, so the next export tries them again
+		std::vector<int8_t> done(jobs.size(), 0);
+		std::atomic<size_t> next_job(0);
+		std::atomic<int> running(threads);
+		std::atomic<bool> success(true);
+		std::vector<std::thread> workers;
+		for(int i = 0; i < threads; ++i) {
+			workers.push_back(std::thread([&]() {
+				std::vector<uint8_t> pixels;
+				std::vector<uint8_t> image;
+				std::unique_ptr<FileReadHandle> sprite_file(g_gui.gfx.openSpriteFile());
+				for(size_t index = next_job++; index < jobs.size() && success; index = next_job++) {
+					if(writeTile(jobs[index], pixels, image, sprite_file.get()))
+						done[index] = 1;
+					else
+						success = false;
+					++tiles_done;
+				}
+				--running;
+			}));
+		}
+
+		while(running > 0) {
+			if(showdialog)
+				g_gui.SetLoadDone(int(std::min<uint64_t>(99, tiles_done * 100 / jobs.size())));
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+
+		for(std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+			it->join();
+		map.minimap_cache.releaseLevels();
+
+		for(size_t index = 0; index < jobs.size(); ++index) {
+			if(done[index]) {
+				manifest[jobs[index]] = tiles[jobs[index]];
+				++written;
+			}
+		}
+		ok = success;
+	}
+
+	if(!writeManifest(manifest_path, manifest)) {
+		setError("Could not write to \"" + wxstr(manifest_path) + "\".");
+		return false;
+	}
+	return ok;
+}
+
+void TilePyramidExporter::setError(const wxString& message)
+{
+	std::lock_guard<std::mutex> lock(error_mutex);
+	if(error.empty())
+		error = message;
+}
+
+bool TilePyramidCommand::IsRequested(const wxArrayString& arguments)
+{
+	return arguments.Index("--export-tiles") != wxNOT_FOUND;
+}
+
+bool TilePyramidCommand::Run(const wxArrayString& arguments)
+{
+	g_gui.SetHeadless(true);
+
+	wxString mapPath;
+	wxString output;
+	long floor = -1;
+	long min_zoom = TILE_PYRAMID_MIN_ZOOM;
+	long max_zoom = TILE_PYRAMID_MAX_ZOOM;
+	long threads = 0;
+	bool full = false;
+
+	bool valid = true;
+	for(size_t index = 1; index < arguments.size() && valid; ++index) {
+		const wxString& argument = arguments[index];
+		if(argument == "--full") {
+			full = true;
+			continue;
+		}
+		if(index + 1 == arguments.size()) {
+			g_gui.PrintMessage("Missing value for \"" + argument + "\".");
+			valid = false;
+			break;
+		}
+
+		const wxString& value = arguments[++index];
+		if(argument == "--export-tiles")
+			mapPath = value;
+		else if(argument == "--output")
+			output = value;
+		else if(argument == "--floor")
+			valid = value.ToLong(&floor) && floor >= 0 && floor <= MAP_MAX_LAYER;
+		else if(argument == "--min-zoom")
+			valid = value.ToLong(&min_zoom) && min_zoom >= TILE_PYRAMID_MIN_ZOOM && min_zoom <= TILE_PYRAMID_MAX_ZOOM;
+		else if(argument == "--max-zoom")
+			valid = value.ToLong(&max_zoom) && max_zoom >= TILE_PYRAMID_MIN_ZOOM && max_zoom <= TILE_PYRAMID_MAX_ZOOM;
+		else if(argument == "--threads")
+			valid = value.ToLong(&threads) && threads >= 0;
+		else {
+			g_gui.PrintMessage("Unknown argument \"" + argument + "\".");
+			valid = false;
+			break;
+		}
+
+		if(!valid)
+			g_gui.PrintMessage("Invalid value \"" + value + "\" for \"" + argument + "\".");
+	}
+
+	if(!valid || mapPath.empty() || output.empty() || min_zoom > max_zoom) {
+		g_gui.PrintMessage(wxString::Format("Usage: rme --export-tiles <map.otbm> --output dir [--floor N] [--min-zoom N] [--max-zoom N] [--threads N] [--full]\n"
+			"Zoom levels go from %d to %d.", TILE_PYRAMID_MIN_ZOOM, TILE_PYRAMID_MAX_ZOOM));
+		return false;
+	}
+
+	if(ClientVersion::getLatestVersion() == nullptr) {
+		g_gui.PrintMessage("No client versions are configured, run the editor once to set them up.");
+		return false;
+	}
+
+	std::unique_ptr<Editor> editor;
+	try
+	{
+		editor.reset(newd Editor(g_gui.copybuffer, FileName(mapPath)));
+	}
+	catch(std::runtime_error& e)
+	{
+		g_gui.PrintMessage(wxString(e.what(), wxConvUTF8));
+		return false;
+	}
+
+	if(!editor->map.hasFile()) {
+		g_gui.PrintMessage("Could not load \"" + mapPath + "\": " + editor->map.getError());
+		return false;
+	}
+
+	std::vector<int> floors;
+	if(floor >= 0)
+		floors.push_back(floor);
+	else {
+		for(int z = 0; z <= MAP_MAX_LAYER; ++z)
+			floors.push_back(z);
+	}
+
+	FileName directory;
+	directory.AssignDir(output);
+	directory.MakeAbsolute();
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	TilePyramidExporter exporter(editor->map);
+	g_gui.CreateLoadBar("Exporting tiles");
+	const bool ok = exporter.exportTiles(directory, floors, min_zoom, max_zoom, threads, full, true);
+	g_gui.DestroyLoadBar();
+
+	if(!ok) {
+		g_gui.PrintMessage(exporter.getError());
+		return false;
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	g_gui.PrintMessage(wxString::Format("Wrote %llu images, %llu unchanged, %llu removed, to %s in %.2f seconds.",
+		static_cast<unsigned long long>(exporter.getWrittenCount()),
+		static_cast<unsigned long long>(exporter.getUnchangedCount()),
+		static_cast<unsigned long long>(exporter.getRemovedCount()),
+		directory.GetFullPath(), seconds));
+	return true;
+}
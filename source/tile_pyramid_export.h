@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_TILE_PYRAMID_EXPORT_H_
+#define RME_TILE_PYRAMID_EXPORT_H_
+
+#include "software_renderer.h"
+
+#include <map>
+
+class Map;
+
+// Zoom levels of the pyramid in slippy map numbering. Images are 256 pixels
+// square and zoom z shows 2^(z - 8) pixels per map tile, so the deepest level
+// draws sprites at their own size and the shallowest one texel per 32 tiles.
+#define TILE_PYRAMID_MIN_ZOOM 3
+#define TILE_PYRAMID_MAX_ZOOM 13
+
+// Writes a map as <directory>/<floor>/<z>/<x>/<y>.png for web map viewers.
+// Levels down to 8 pixels per tile are drawn from the sprites, the ones below
+// from the minimap colours. Only images with tree leaves under them are written,
+// and a manifest of hashes of those leaves lets later exports skip the images
+// that haven't changed and remove those that are gone.
+class TilePyramidExporter
+{
+public:
+	TilePyramidExporter(Map& map);
+
+	bool exportTiles(const FileName& directory, const std::vector<int>& floors, int min_zoom, int max_zoom,
+		int threads, bool full, bool showdialog);
+
+	size_t getWrittenCount() const { return written; }
+	size_t getUnchangedCount() const { return unchanged; }
+	size_t getRemovedCount() const { return removed; }
+	const wxString& getError() const { return error; }
+
+protected:
+	// Images by key, with the hash of what is drawn on them
+	typedef std::map<uint64_t, uint64_t> HashMap;
+
+	static uint64_t getKey(int floor, int zoom, int x, int y);
+	static void splitKey(uint64_t key, int& floor, int& zoom, int& x, int& y);
+
+	void collectTiles(const std::vector<int>& floors, int min_zoom, int max_zoom, HashMap& tiles);
+	bool readManifest(const std::string& path, HashMap& tiles) const;
+	bool writeManifest(const std::string& path, const HashMap& tiles) const;
+
+	std::string getTilePath(uint64_t key) const;
+	bool writeTile(uint64_t key, std::vector<uint8_t>& pixels, std::vector<uint8_t>& image, FileReadHandle* sprite_file);
+	void drawSprites(int floor, int zoom, int x, int y, std::vector<uint8_t>& pixels, uint8_t* out, FileReadHandle* sprite_file);
+	void drawMinimap(int floor, int zoom, int x, int y, std::vector<uint8_t>& colors, uint8_t* out);
+	void setError(const wxString& message);
+
+	Map& map;
+	SoftwareRenderer renderer;
+	std::string base_path;
+
+	// The minimap cache isn't shared between threads on its own
+	std::mutex minimap_mutex;
+	std::mutex error_mutex;
+	wxString error;
+
+	std::atomic<size_t> tiles_done;
+	size_t written;
+	size_t unchanged;
+	size_t removed;
+};
+
+// Exports the tile pyramid of a map without opening a window, started with
+//   rme --export-tiles map.otbm --output dir [--floor N] [--min-zoom N] [--max-zoom N]
+//       [--threads N] [--full]
+// --full rewrites every image instead of only those whose tiles changed.
+class TilePyramidCommand
+{
+public:
+	static bool IsRequested(const wxArrayString& arguments);
+	static bool Run(const wxArrayString& arguments);
+};
+
+#endif
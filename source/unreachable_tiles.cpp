@@ -0,0 +1,228 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#include "main.h"
+
+#include "unreachable_tiles.h"
+#include "map.h"
+#include "tile.h"
+
+#include <atomic>
+#include <thread>
+
+// Sets every cell to 1 if any cell within radius was set, in O(count)
+static void dilate(uint8_t* data, int count, int stride, int radius, std::vector<uint8_t>& line)
+{
+	line.resize(count);
+	for(int i = 0; i < count; ++i) {
+		line[i] = data[i * stride];
+	}
+
+	int inside = 0;
+	for(int i = 0; i < std::min(radius, count); ++i) {
+		inside += line[i];
+	}
+
+	for(int i = 0; i < count; ++i) {
+		if(i + radius < count)
+			inside += line[i + radius];
+		if(i - radius - 1 >= 0)
+			inside -= line[i - radius - 1];
+		data[i * stride] = (inside > 0 ? 1 : 0);
+	}
+}
+
+static int getThreadCount(int limit)
+{
+	return std::max<int>(1, std::min<int>(limit, std::thread::hardware_concurrency()));
+}
+
+void UnreachableTiles::Grid::assign(int min_x, int min_y, int max_x, int max_y)
+{
+	start_x = min_x - RANGE_X;
+	start_y = min_y - RANGE_Y;
+	width = max_x - min_x + 1 + 2 * RANGE_X;
+	height = max_y - min_y + 1 + 2 * RANGE_Y;
+	cells.assign(size_t(width) * height, 0);
+}
+
+void UnreachableTiles::Grid::dilate(std::vector<uint8_t>& line)
+{
+	for(int y = 0; y < height; ++y)
+		::dilate(&cells[size_t(y) * width], width, 1, RANGE_X, line);
+	for(int x = 0; x < width; ++x)
+		::dilate(&cells[x], height, width, RANGE_Y, line);
+}
+
+UnreachableTiles::UnreachableTiles(Map& map)
+{
+	// Only walkable tiles are marked, so they alone decide how large a grid is
+	int min_x[MAP_LAYERS], min_y[MAP_LAYERS], max_x[MAP_LAYERS], max_y[MAP_LAYERS];
+	for(int z = 0; z < MAP_LAYERS; ++z) {
+		min_x[z] = min_y[z] = std::numeric_limits<int>::max();
+		max_x[z] = max_y[z] = -1;
+	}
+
+	for(MapIterator mit = map.begin(); mit != map.end(); ++mit) {
+		Tile* tile = (*mit)->get();
+		if(!tile->isBlocking()) {
+			const Position& pos = tile->getPosition();
+			min_x[pos.z] = std::min(min_x[pos.z], pos.x);
+			min_y[pos.z] = std::min(min_y[pos.z], pos.y);
+			max_x[pos.z] = std::max(max_x[pos.z], pos.x);
+			max_y[pos.z] = std::max(max_y[pos.z], pos.y);
+		}
+	}
+
+	for(int z = 0; z < MAP_LAYERS; ++z) {
+		if(max_x[z] >= 0) {
+			walkable[z].assign(min_x[z], min_y[z], max_x[z], max_y[z]);
+		}
+	}
+
+	for(MapIterator mit = map.begin(); mit != map.end(); ++mit) {
+		Tile* tile = (*mit)->get();
+		if(!tile->isBlocking()) {
+			const Position& pos = tile->getPosition();
+			Grid& grid = walkable[pos.z];
+			grid.cells[grid.index(pos.x, pos.y)] = 1;
+		}
+	}
+
+	// Floors don't depend on each other, dilate them in parallel
+	std::atomic<int> next_floor(0);
+	auto worker = [this, &next_floor]() {
+		std::vector<uint8_t> line;
+		for(int z = next_floor++; z < MAP_LAYERS; z = next_floor++) {
+			if(!walkable[z].cells.empty())
+				walkable[z].dilate(line);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const int thread_count = getThreadCount(MAP_LAYERS);
+	for(int i = 1; i < thread_count; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for(std::thread& thread : threads)
+		thread.join();
+
+	// Every surface floor looks at the same floors (0 - 9), merge them once
+	int surface_min_x = std::numeric_limits<int>::max(), surface_min_y = std::numeric_limits<int>::max();
+	int surface_max_x = -1, surface_max_y = -1;
+	for(int z = 0; z <= 9; ++z) {
+		if(max_x[z] >= 0) {
+			surface_min_x = std::min(surface_min_x, min_x[z]);
+			surface_min_y = std::min(surface_min_y, min_y[z]);
+			surface_max_x = std::max(surface_max_x, max_x[z]);
+			surface_max_y = std::max(surface_max_y, max_y[z]);
+		}
+	}
+	if(surface_max_x < 0)
+		return;
+
+	surface.assign(surface_min_x, surface_min_y, surface_max_x, surface_max_y);
+	for(int z = 0; z <= 9; ++z) {
+		const Grid& grid = walkable[z];
+		if(grid.cells.empty())
+			continue;
+
+		// Row by row, the floor's grid lies within the merged one
+		for(int y = 0; y < grid.height; ++y) {
+			const uint8_t* from = &grid.cells[size_t(y) * grid.width];
+			uint8_t* to = &surface.cells[surface.index(grid.start_x, grid.start_y + y)];
+			for(int x = 0; x < grid.width; ++x)
+				to[x] |= from[x];
+		}
+	}
+}
+
+bool UnreachableTiles::isUnreachable(const Position& pos) const
+{
+	if(pos.z < 8)
+		return !surface.get(pos.x, pos.y);
+
+	// underground
+	int sz = std::max(pos.z - 2, GROUND_LAYER);
+	int ez = std::min(pos.z + 2, MAP_MAX_LAYER);
+	for(int z = sz; z <= ez; ++z) {
+		if(walkable[z].get(pos.x, pos.y))
+			return false;
+	}
+	return true;
+}
+
+bool UnreachableTiles::scan(Map& map, const Position& pos)
+{
+	int sx = std::max(pos.x - RANGE_X, 0);
+	int ex = std::min(pos.x + RANGE_X, 65535);
+	int sy = std::max(pos.y - RANGE_Y, 0);
+	int ey = std::min(pos.y + RANGE_Y, 65535);
+	int sz, ez;
+
+	if(pos.z < 8) {
+		sz = 0;
+		ez = 9;
+	} else {
+		// underground
+		sz = std::max(pos.z - 2, GROUND_LAYER);
+		ez = std::min(pos.z + 2, MAP_MAX_LAYER);
+	}
+
+	for(int z = sz; z <= ez; ++z) {
+		for(int y = sy; y <= ey; ++y) {
+			for(int x = sx; x <= ex; ++x) {
+				Tile* tile = map.getTile(x, y, z);
+				if(tile && !tile->isBlocking())
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+uint64_t UnreachableTiles::verify(Map& map, uint64_t& checked)
+{
+	const UnreachableTiles grids(map);
+
+	std::vector<Position> positions;
+	for(MapIterator mit = map.begin(); mit != map.end(); ++mit) {
+		positions.push_back((*mit)->getPosition());
+	}
+	checked = positions.size();
+
+	// The scan is thousands of lookups per tile, split the tiles over the cores.
+	// Nothing changes the map meanwhile, so reading it from several threads is safe.
+	std::atomic<size_t> next_position(0);
+	std::atomic<uint64_t> mismatches(0);
+	auto worker = [&]() {
+		for(size_t i = next_position++; i < positions.size(); i = next_position++) {
+			if(grids.isUnreachable(positions[i]) != scan(map, positions[i]))
+				++mismatches;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const int thread_count = getThreadCount(64);
+	for(int i = 1; i < thread_count; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for(std::thread& thread : threads)
+		thread.join();
+
+	return mismatches;
+}
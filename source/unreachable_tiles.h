@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////
+// This file is part of Remere's Map Editor
+//////////////////////////////////////////////////////////////////////
+// Remere's Map Editor is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Remere's Map Editor is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RME_UNREACHABLE_TILES_H_
+#define RME_UNREACHABLE_TILES_H_
+
+class Map;
+class Position;
+
+// A tile is unreachable when no walkable tile exists in the 21x17 area
+// around it on floors 0-9 (surface) or two floors up/down (underground).
+// Instead of testing the whole box for every tile, each floor gets a
+// grid of walkable tiles which is dilated by the box size with running
+// window counts, so every tile is answered with a handful of lookups.
+// A grid only covers the walkable tiles of its floor plus the box size.
+class UnreachableTiles
+{
+public:
+	// Tiles removed after this are always blocking, so the answers stay
+	// valid while unreachable tiles are being removed
+	UnreachableTiles(Map& map);
+
+	bool isUnreachable(const Position& pos) const;
+
+	// The original test of the whole box around pos
+	static bool scan(Map& map, const Position& pos);
+	// Compares isUnreachable against scan on every tile of the map,
+	// returns the number of tiles where they disagree
+	static uint64_t verify(Map& map, uint64_t& checked);
+
+protected:
+	enum {
+		RANGE_X = 10,
+		RANGE_Y = 8,
+	};
+
+	struct Grid {
+		Grid() : start_x(0), start_y(0), width(0), height(0) {}
+
+		// Covers the area plus the box size around it, all cells cleared
+		void assign(int min_x, int min_y, int max_x, int max_y);
+		void dilate(std::vector<uint8_t>& line);
+
+		bool contains(int x, int y) const
+		{
+			return x >= start_x && y >= start_y && x < start_x + width && y < start_y + height;
+		}
+		size_t index(int x, int y) const
+		{
+			return size_t(y - start_y) * width + (x - start_x);
+		}
+		// Nothing walkable is in range of a cell outside the grid
+		bool get(int x, int y) const
+		{
+			return contains(x, y) && cells[index(x, y)];
+		}
+
+		int start_x;
+		int start_y;
+		int width;
+		int height;
+		std::vector<uint8_t> cells;
+	};
+
+	Grid walkable[MAP_LAYERS];
+	Grid surface;
+};
+
+#endif